@@ -0,0 +1,53 @@
+# Training workload for the PGO=generate build, run by the pgo-train target:
+#
+#   cmake -DDEMOINFOGO=... -DDEMOINFOGO_GEN=... -DWORK_DIR=... -DPROFILE_DIR=... [-DPROFDATA=...]
+#         -P PgoTrain.cmake
+#
+# Generates a fixed set of synthetic demos and runs the instrumented demoinfogo over them in the
+# modes that matter, so the profile covers the bit reader, every prop decoder, entity deltas,
+# string tables, game events and the -hsbox bookkeeping. Everything is seeded, so two trainings
+# give the same profile. PROFDATA is llvm-profdata, for clang, which needs the raw profiles
+# merged before -fprofile-use.
+
+foreach(var DEMOINFOGO DEMOINFOGO_GEN WORK_DIR PROFILE_DIR)
+    if(NOT ${var})
+        message(FATAL_ERROR "PgoTrain.cmake needs -D${var}=...")
+    endif()
+endforeach()
+
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+function(run)
+    execute_process(COMMAND ${ARGN}
+        WORKING_DIRECTORY ${WORK_DIR}
+        OUTPUT_FILE ${WORK_DIR}/out.txt
+        ERROR_FILE ${WORK_DIR}/err.txt
+        RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "pgo-train: '${ARGN}' failed (${result})")
+    endif()
+endfunction()
+
+# a typical match, one with every prop encoding and many entities, and one heavy on floats
+message(STATUS "pgo-train: generating demos")
+run(${DEMOINFOGO_GEN} match.dem -ticks 6000 -seed 1)
+run(${DEMOINFOGO_GEN} wide.dem -ticks 1000 -entities 1200 -classes 120 -seed 2)
+run(${DEMOINFOGO_GEN} floats.dem -ticks 2000
+    -encodings coord,coordmp,cellcoord,normal,noscale,vector,vectorxy -seed 3)
+
+message(STATUS "pgo-train: training")
+foreach(demo match.dem wide.dem floats.dem)
+    run(${DEMOINFOGO} ${demo})
+    run(${DEMOINFOGO} -hsbox ${demo})
+    run(${DEMOINFOGO} -gameevents -nofootsteps -deathscsv ${demo})
+    run(${DEMOINFOGO} -json -gameevents ${demo})
+endforeach()
+run(${DEMOINFOGO} -packetentities floats.dem)
+run(${DEMOINFOGO} -sample-hz 16 match.dem)
+run(${DEMOINFOGO} -catalog match.dem wide.dem floats.dem)
+
+if(PROFDATA)
+    file(GLOB raw_profiles ${PROFILE_DIR}/*.profraw)
+    run(${PROFDATA} merge -output=${PROFILE_DIR}/default.profdata ${raw_profiles})
+endif()
+message(STATUS "pgo-train: done, reconfigure with -DPGO=use and rebuild")
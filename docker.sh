@@ -1,7 +1,11 @@
 #!/bin/bash
 
 cd demoinfogo/build
-cmake .. -DRPATH=ON -DCMAKE_BUILD_TYPE=Release
+# release builds are LTO + PGO: an instrumented build, trained on the bundled workload
+cmake .. -DRPATH=ON -DCMAKE_BUILD_TYPE=Release -DLTO=ON -DPGO=generate
+make
+make pgo-train
+cmake .. -DPGO=use
 make
 
 mkdir libs
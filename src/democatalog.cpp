@@ -0,0 +1,444 @@
+// -catalog: header only scan of many demos.
+//
+// Reads the demoheader_t and the signon data that follows it, which is all that's needed for the
+// map, server, duration, tick rate and player roster, and stops at the first dem_synctick or
+// dem_packet. Only a prefix of every file is read (pread on POSIX), so the cost per demo doesn't
+// depend on its length.
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include "democatalog.h"
+#include "demofilebitbuf.h"
+#include "stringtableparser.h"
+#include "trace.h"
+#include "win_stuff.h"
+#include "netmessages.pb.h"
+#if defined(_WIN32) || defined(_WIN64)
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// prefix reader
+//-----------------------------------------------------------------------------
+class CCatalogFile {
+public:
+    CCatalogFile() : m_nFileSize(0), m_fd(-1), m_fp(NULL) {}
+    ~CCatalogFile() { Close(); }
+
+    bool Open(const char *filename) {
+#if defined(_WIN32) || defined(_WIN64)
+        m_fp = fopen(filename, "rb");
+        if (!m_fp)
+            return false;
+        fseek(m_fp, 0, SEEK_END);
+        m_nFileSize = ftell(m_fp);
+#else
+        m_fd = open(filename, O_RDONLY);
+        if (m_fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            Close();
+            return false;
+        }
+        m_nFileSize = st.st_size;
+#endif
+        return true;
+    }
+
+    void Close() {
+#if defined(_WIN32) || defined(_WIN64)
+        if (m_fp)
+            fclose(m_fp);
+#else
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+        m_fd = -1;
+        m_fp = NULL;
+    }
+
+    // Makes m_buffer hold the first nBytes of the file (or all of it, if it's smaller).
+    bool ReadPrefix(size_t nBytes) {
+        nBytes = std::min(nBytes, m_nFileSize);
+        size_t nHave = m_buffer.size();
+        if (nBytes <= nHave)
+            return true;
+        m_buffer.resize(nBytes);
+#if defined(_WIN32) || defined(_WIN64)
+        fseek(m_fp, (long)nHave, SEEK_SET);
+        if (fread(&m_buffer[nHave], 1, nBytes - nHave, m_fp) != nBytes - nHave) {
+            m_buffer.resize(nHave);
+            return false;
+        }
+#else
+        while (nHave < nBytes) {
+            ssize_t n = pread(m_fd, &m_buffer[nHave], nBytes - nHave, nHave);
+            if (n <= 0) {
+                m_buffer.resize(nHave);
+                return false;
+            }
+            nHave += n;
+        }
+#endif
+        return true;
+    }
+
+    size_t m_nFileSize;
+    std::string m_buffer;
+
+private:
+    int m_fd;
+    FILE *m_fp;
+};
+
+//-----------------------------------------------------------------------------
+// signon parsing
+//-----------------------------------------------------------------------------
+enum CatalogResult {
+    Catalog_Done,
+    Catalog_NeedMore, // ran past the end of what has been read so far
+    Catalog_Error,
+};
+
+struct CatalogStringTable {
+    std::string name;
+    int nMaxEntries;
+    int nUserDataSize;
+    int nUserDataSizeBits;
+    int nUserDataFixedSize;
+};
+
+class CCatalogParser {
+public:
+    CCatalogParser(const std::string &buffer, DemoCatalogEntry &entry)
+        : m_buffer(buffer), m_nPos(sizeof(demoheader_t)), m_entry(entry),
+          m_bSnapshotUserInfo(false) {}
+
+    CatalogResult Parse() {
+        while (true) {
+            // cmd, tick, player slot
+            if (!Need(6))
+                return Catalog_NeedMore;
+            unsigned char cmd = m_buffer[m_nPos];
+            m_nPos += 6;
+
+            switch (cmd) {
+            case dem_signon: {
+                m_nPos += sizeof(democmdinfo_t) + 2 * sizeof(int32);
+                const char *pData;
+                int32 nSize;
+                if (!ReadBlock(pData, nSize))
+                    return Catalog_NeedMore;
+                if (!ParsePacket(Aligned(pData, nSize), nSize))
+                    return Catalog_Error;
+            } break;
+
+            case dem_stringtables: {
+                const char *pData;
+                int32 nSize;
+                if (!ReadBlock(pData, nSize))
+                    return Catalog_NeedMore;
+                CBitRead buf(Aligned(pData, nSize), nSize);
+                ParseStringTableSnapshot(buf, OnSnapshotTable, OnSnapshotEntry, this);
+            } break;
+
+            case dem_datatables:
+            case dem_consolecmd:
+            case dem_customdata: {
+                const char *pData;
+                int32 nSize;
+                if (!ReadBlock(pData, nSize))
+                    return Catalog_NeedMore;
+            } break;
+
+            case dem_usercmd: {
+                m_nPos += sizeof(int32);
+                const char *pData;
+                int32 nSize;
+                if (!ReadBlock(pData, nSize))
+                    return Catalog_NeedMore;
+            } break;
+
+            // end of the signon data
+            case dem_synctick:
+            case dem_packet:
+            case dem_stop:
+                return Catalog_Done;
+
+            default:
+                m_entry.error = "bad demo command";
+                return Catalog_Error;
+            }
+        }
+    }
+
+private:
+    bool Need(size_t nBytes) const { return m_nPos + nBytes <= m_buffer.size(); }
+
+    // CBitRead wants dword aligned data, blocks start anywhere in the file.
+    const char *Aligned(const char *pData, int32 nSize) {
+        if (((size_t)pData & 3) == 0)
+            return pData;
+        m_aligned.resize(nSize / 4 + 1);
+        memcpy(&m_aligned[0], pData, nSize);
+        return (const char *)&m_aligned[0];
+    }
+
+    bool ReadBlock(const char *&pData, int32 &nSize) {
+        if (!Need(sizeof(int32)))
+            return false;
+        memcpy(&nSize, &m_buffer[m_nPos], sizeof(int32));
+        if (nSize < 0 || !Need(sizeof(int32) + nSize))
+            return false;
+        pData = &m_buffer[m_nPos + sizeof(int32)];
+        m_nPos += sizeof(int32) + nSize;
+        return true;
+    }
+
+    bool ParsePacket(const char *pData, int nSize) {
+        CBitRead buf(pData, nSize);
+        while (buf.GetNumBytesRead() < nSize) {
+            int Cmd = buf.ReadVarInt32();
+            int Size = buf.ReadVarInt32();
+            if (buf.IsOverflowed() || Size < 0 || buf.GetNumBytesRead() + Size > nSize) {
+                m_entry.error = "bad signon packet";
+                return false;
+            }
+            const char *pMsg = pData + buf.GetNumBytesRead();
+
+            if (Cmd == svc_ServerInfo) {
+                CSVCMsg_ServerInfo msg;
+                if (msg.ParseFromArray(pMsg, Size)) {
+                    m_entry.mapName = msg.map_name();
+                    m_entry.flTickInterval = msg.tick_interval();
+                }
+            } else if (Cmd == svc_CreateStringTable) {
+                CSVCMsg_CreateStringTable msg;
+                if (msg.ParseFromArray(pMsg, Size)) {
+                    CatalogStringTable table = {msg.name(), msg.max_entries(),
+                                                msg.user_data_size(), msg.user_data_size_bits(),
+                                                msg.user_data_fixed_size()};
+                    m_tables.push_back(table);
+                    if (table.name == "userinfo") {
+                        CBitRead data(&msg.string_data()[0], msg.string_data().size());
+                        ParseUserInfoUpdate(data, msg.num_entries(), table);
+                    }
+                }
+            } else if (Cmd == svc_UpdateStringTable) {
+                CSVCMsg_UpdateStringTable msg;
+                if (msg.ParseFromArray(pMsg, Size) && msg.table_id() >= 0 &&
+                    msg.table_id() < (int)m_tables.size() &&
+                    m_tables[msg.table_id()].name == "userinfo") {
+                    CBitRead data(&msg.string_data()[0], msg.string_data().size());
+                    ParseUserInfoUpdate(data, msg.num_changed_entries(), m_tables[msg.table_id()]);
+                }
+            }
+
+            buf.SeekRelative(Size * 8);
+        }
+        return true;
+    }
+
+    static void OnUserInfoEntry(void *pContext, const StringTableEntry &entry) {
+        if (entry.nUserDataBytes > 0) {
+            player_info_t info;
+            PlayerInfoFromEntry(entry, info);
+            ((CCatalogParser *)pContext)->m_entry.players[entry.nIndex] = info;
+        }
+    }
+
+    static void OnSnapshotTable(void *pContext, const char *pName, int nEntries) {
+        CCatalogParser *pParser = (CCatalogParser *)pContext;
+        pParser->m_bSnapshotUserInfo = !strcmp(pName, "userinfo");
+        if (pParser->m_bSnapshotUserInfo)
+            pParser->m_entry.players.clear();
+    }
+
+    static void OnSnapshotEntry(void *pContext, const StringTableEntry &entry) {
+        if (((CCatalogParser *)pContext)->m_bSnapshotUserInfo && !entry.bClientSide)
+            OnUserInfoEntry(pContext, entry);
+    }
+
+    void ParseUserInfoUpdate(CBitRead &buf, int entries, const CatalogStringTable &table) {
+        // a roster cut short by bad data is still worth listing
+        std::string error;
+        ParseStringTableUpdate(buf, entries, table.nMaxEntries, table.nUserDataSize,
+                               table.nUserDataSizeBits, table.nUserDataFixedSize, OnUserInfoEntry,
+                               this, error);
+    }
+
+    const std::string &m_buffer;
+    size_t m_nPos;
+    DemoCatalogEntry &m_entry;
+    std::vector<CatalogStringTable> m_tables;
+    // copy of the block being parsed, when it isn't aligned
+    std::vector<uint32> m_aligned;
+    // whether the dem_stringtables table being parsed is userinfo
+    bool m_bSnapshotUserInfo;
+};
+
+bool CatalogDemo(const char *filename, DemoCatalogEntry &entry) {
+    TRACE_SCOPE("CatalogDemo");
+    entry = DemoCatalogEntry();
+    entry.filename = filename;
+
+    CCatalogFile file;
+    if (!file.Open(filename)) {
+        entry.error = "couldn't open file";
+        return false;
+    }
+    if (!file.ReadPrefix(CATALOG_INITIAL_READ_SIZE) || file.m_buffer.size() < sizeof(demoheader_t)) {
+        entry.error = "file too small";
+        return false;
+    }
+
+    memcpy(&entry.header, &file.m_buffer[0], sizeof(demoheader_t));
+    entry.header.demofilestamp[sizeof(entry.header.demofilestamp) - 1] = 0;
+    if (strcmp(entry.header.demofilestamp, DEMO_HEADER_ID)) {
+        entry.error = "invalid demo header ID";
+        return false;
+    }
+    if (entry.header.demoprotocol != DEMO_PROTOCOL) {
+        entry.error = "invalid demo protocol";
+        return false;
+    }
+    entry.header.servername[MAX_OSPATH - 1] = 0;
+    entry.header.mapname[MAX_OSPATH - 1] = 0;
+
+    // Parsing the signon data again after growing the window is cheaper than keeping the parse
+    // state resumable, and it almost never happens.
+    size_t nWindow = CATALOG_INITIAL_READ_SIZE;
+    while (true) {
+        DemoCatalogEntry parsed = entry;
+        CatalogResult result = CCatalogParser(file.m_buffer, parsed).Parse();
+        bool bEndOfFile = file.m_buffer.size() >= file.m_nFileSize;
+        if (result == Catalog_Done || (result == Catalog_NeedMore && bEndOfFile)) {
+            entry = parsed;
+            break;
+        }
+        if (result == Catalog_Error) {
+            entry.error = parsed.error;
+            entry.nBytesRead = file.m_buffer.size();
+            return false;
+        }
+        if (nWindow >= CATALOG_MAX_READ_SIZE) {
+            entry.error = "signon data too large";
+            entry.nBytesRead = file.m_buffer.size();
+            return false;
+        }
+        nWindow *= 4;
+        if (!file.ReadPrefix(nWindow)) {
+            entry.error = "read error";
+            return false;
+        }
+    }
+
+    if (entry.mapName.empty())
+        entry.mapName = entry.header.mapname;
+    entry.nBytesRead = file.m_buffer.size();
+    entry.bValid = true;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// output
+//-----------------------------------------------------------------------------
+
+// Tabs and newlines would break the row format.
+static std::string CatalogField(const char *pValue) {
+    std::string field = pValue;
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] == '\t' || field[i] == '\n' || field[i] == '\r')
+            field[i] = ' ';
+    }
+    return field;
+}
+
+static void PrintCatalogHeader() {
+    printf("file\tmap\tserver\tduration\tticks\ttickrate\tplayers\terror\n");
+}
+
+// players are xuid:name separated by ;, BOT:name for bots, GOTV relays are left out
+static void PrintCatalogEntry(const DemoCatalogEntry &entry) {
+    if (!entry.bValid) {
+        printf("%s\t\t\t\t\t\t\t%s\n", CatalogField(entry.filename.c_str()).c_str(),
+               entry.error.c_str());
+        return;
+    }
+
+    double flTickRate = 0;
+    if (entry.flTickInterval > 0)
+        flTickRate = 1.0 / entry.flTickInterval;
+    else if (entry.header.playback_time > 0)
+        flTickRate = entry.header.playback_ticks / entry.header.playback_time;
+
+    std::string players;
+    for (std::map<int, player_info_t>::const_iterator i = entry.players.begin();
+         i != entry.players.end(); i++) {
+        const player_info_t &info = i->second;
+        if (info.ishltv)
+            continue;
+        char xuid[32];
+        if (info.fakeplayer)
+            snprintf(xuid, sizeof(xuid), "BOT");
+        else
+            snprintf(xuid, sizeof(xuid), "%" PRIu64, info.xuid);
+        if (!players.empty())
+            players += ';';
+        players += xuid;
+        players += ':';
+        players += CatalogField(info.name);
+    }
+
+    printf("%s\t%s\t%s\t%.3f\t%d\t%.3f\t%s\t\n", CatalogField(entry.filename.c_str()).c_str(),
+           CatalogField(entry.mapName.c_str()).c_str(),
+           CatalogField(entry.header.servername).c_str(), entry.header.playback_time,
+           entry.header.playback_ticks, flTickRate, players.c_str());
+}
+
+void CatalogDemos(const std::vector<std::string> &files, int nThreads) {
+    if (nThreads <= 0)
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    nThreads = std::min<int>(nThreads, std::max<size_t>(files.size(), 1));
+
+    // Rows are printed in input order, as soon as every earlier file is done.
+    std::vector<DemoCatalogEntry> entries(files.size());
+    std::vector<char> done(files.size(), 0);
+    std::atomic<size_t> nNextFile(0);
+    std::mutex printMutex;
+    size_t nNextPrint = 0;
+
+    PrintCatalogHeader();
+    auto worker = [&]() {
+        while (true) {
+            size_t i = nNextFile++;
+            if (i >= files.size())
+                break;
+            CatalogDemo(files[i].c_str(), entries[i]);
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            done[i] = 1;
+            while (nNextPrint < files.size() && done[nNextPrint]) {
+                PrintCatalogEntry(entries[nNextPrint]);
+                // drop the player list, 100k rosters add up
+                entries[nNextPrint] = DemoCatalogEntry();
+                nNextPrint++;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    fflush(stdout);
+}
@@ -0,0 +1,41 @@
+#ifndef DEMOCATALOG_H
+#define DEMOCATALOG_H
+
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "demofile.h"
+#include "demofiledump.h"
+
+// How much of a demo -catalog reads at first, and how far it grows that window when the signon
+// data doesn't fit. Signon data is usually well below a MB.
+#define CATALOG_INITIAL_READ_SIZE (1 * 1024 * 1024)
+#define CATALOG_MAX_READ_SIZE (32 * 1024 * 1024)
+
+// What -catalog knows about a demo: the header, the ServerInfo and the userinfo string table as
+// of the end of the signon data.
+struct DemoCatalogEntry {
+    DemoCatalogEntry() : bValid(false), flTickInterval(0.0f), nBytesRead(0) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    std::string filename;
+    bool bValid;
+    std::string error;
+    demoheader_t header;
+    std::string mapName;
+    float flTickInterval;
+    size_t nBytesRead;
+    // userinfo string table entry index to player info
+    std::map<int, player_info_t> players;
+};
+
+// Fills entry from the header and signon data of filename, reading as little of it as possible.
+// Thread safe.
+bool CatalogDemo(const char *filename, DemoCatalogEntry &entry);
+
+// Catalogs every file on nThreads threads and prints one tab separated row per file, in order.
+void CatalogDemos(const std::vector<std::string> &files, int nThreads);
+
+#endif // DEMOCATALOG_H
@@ -25,9 +25,19 @@
 #include <stdio.h>
 #include <cstring>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 #include "demofile.h"
+#include "trace.h"
 
-CDemoFile::CDemoFile() {}
+CDemoFile::CDemoFile()
+    : m_fileBufferPos(0), m_nBytesRead(0), m_bReadDone(true), m_bStopReading(false),
+      m_bFollow(false), m_pFollowFile(NULL), m_nFollowNotify(-1), m_bFollowTimedOut(false) {}
 
 CDemoFile::~CDemoFile() { Close(); }
 
@@ -35,6 +45,7 @@ void CDemoFile::ReadSequenceInfo(int32 &nSeqNrIn, int32 &nSeqNrOut) {
     if (!m_fileBuffer.size())
         return;
 
+    WaitForData(m_fileBufferPos + 2 * sizeof(int32));
     nSeqNrIn = *(int32 *)(&m_fileBuffer[m_fileBufferPos]);
     m_fileBufferPos += sizeof(int32);
     nSeqNrOut = *(int32 *)(&m_fileBuffer[m_fileBufferPos]);
@@ -45,6 +56,7 @@ void CDemoFile::ReadCmdInfo(democmdinfo_t &info) {
     if (!m_fileBuffer.size())
         return;
 
+    WaitForData(m_fileBufferPos + sizeof(democmdinfo_t));
     memcpy(&info, &m_fileBuffer[m_fileBufferPos], sizeof(democmdinfo_t));
     m_fileBufferPos += sizeof(democmdinfo_t);
 }
@@ -53,6 +65,7 @@ void CDemoFile::ReadCmdHeader(unsigned char &cmd, int32 &tick, unsigned char &pl
     if (!m_fileBuffer.size())
         return;
 
+    WaitForData(m_fileBufferPos + 2 * sizeof(unsigned char) + sizeof(int32));
     // Read the command
     cmd = *(unsigned char *)(&m_fileBuffer[m_fileBufferPos]);
     m_fileBufferPos += sizeof(unsigned char);
@@ -78,6 +91,7 @@ int32 CDemoFile::ReadUserCmd(char *buffer, int32 &size) {
     if (!m_fileBuffer.size())
         return 0;
 
+    WaitForData(m_fileBufferPos + sizeof(int32));
     int32 outgoing_sequence = *(int32 *)(&m_fileBuffer[m_fileBufferPos]);
     m_fileBufferPos += sizeof(int32);
 
@@ -91,6 +105,7 @@ int32 CDemoFile::ReadRawData(char *buffer, int32 length) {
         return 0;
 
     // read length of data block
+    WaitForData(m_fileBufferPos + sizeof(int32));
     int32 size = *(int32 *)(&m_fileBuffer[m_fileBufferPos]);
     m_fileBufferPos += sizeof(int32);
 
@@ -101,6 +116,7 @@ int32 CDemoFile::ReadRawData(char *buffer, int32 length) {
 
     if (buffer) {
         // read data into buffer
+        WaitForData(m_fileBufferPos + size);
         memcpy(buffer, &m_fileBuffer[m_fileBufferPos], size);
         m_fileBufferPos += size;
     } else {
@@ -111,7 +127,7 @@ int32 CDemoFile::ReadRawData(char *buffer, int32 length) {
     return size;
 }
 
-bool CDemoFile::Open(const char *name) {
+bool CDemoFile::Open(const char *name, bool bFollow) {
     Close();
 
     FILE *fp = NULL;
@@ -146,25 +162,151 @@ bool CDemoFile::Open(const char *name) {
             return false;
         }
 
-        m_fileBuffer.resize(Length);
-        fread(&m_fileBuffer[0], 1, Length, fp);
+        if (bFollow) {
+            m_bFollow = true;
+            m_bFollowTimedOut = false;
+            m_pFollowFile = fp;
+#ifdef __linux__
+            m_nFollowNotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (m_nFollowNotify >= 0 && inotify_add_watch(m_nFollowNotify, name, IN_MODIFY) < 0) {
+                close(m_nFollowNotify);
+                m_nFollowNotify = -1;
+            }
+#endif
+            m_nBytesRead = 0;
+            m_fileBufferPos = 0;
+            m_szFileName = name;
+            // the reads bail out on an empty buffer, so wait for the first command
+            FollowData(1);
+            return true;
+        }
 
-        fclose(fp);
-        fp = NULL;
+        m_fileBuffer.resize(Length);
     }
 
     if (!m_fileBuffer.size()) {
         fprintf(stderr, "CDemoFile::Open: couldn't open file %s.\n", name);
+        if (fp)
+            fclose(fp);
         Close();
         return false;
     }
 
+    // the thread owns fp from here on
+    m_nBytesRead = 0;
+    m_bReadDone = false;
+    m_bStopReading = false;
+    m_reader =
+        std::thread(&CDemoFile::ReadFileThread, this, fp, &m_fileBuffer[0], m_fileBuffer.size());
+
     m_fileBufferPos = 0;
     m_szFileName = name;
     return true;
 }
 
+void CDemoFile::ReadFileThread(FILE *fp, char *pBuffer, size_t nLength) {
+    TRACE_SCOPE("ReadFile");
+    size_t nRead = 0;
+    while (nRead < nLength && !m_bStopReading.load(std::memory_order_relaxed)) {
+        size_t nChunk = std::min<size_t>(DEMO_READ_CHUNK_SIZE, nLength - nRead);
+        size_t nChunkRead = fread(pBuffer + nRead, 1, nChunk, fp);
+        nRead += nChunkRead;
+        m_nBytesRead.store(nRead, std::memory_order_release);
+        if (nChunkRead < nChunk)
+            break;
+    }
+    fclose(fp);
+    m_bReadDone.store(true, std::memory_order_release);
+}
+
+void CDemoFile::WaitForData(size_t nEnd) {
+    if (nEnd <= m_nBytesRead.load(std::memory_order_acquire))
+        return;
+    if (m_bFollow) {
+        FollowData(nEnd);
+        return;
+    }
+
+    // a short file reads as zeros past its end, like it always did
+    TRACE_SCOPE("WaitForData");
+    for (int nSpins = 0; nEnd > m_nBytesRead.load(std::memory_order_acquire) &&
+                         !m_bReadDone.load(std::memory_order_acquire);
+         nSpins++) {
+        if (nSpins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void CDemoFile::FollowData(size_t nEnd) {
+    TRACE_SCOPE("FollowData");
+    std::chrono::steady_clock::time_point lastGrowth = std::chrono::steady_clock::now();
+    bool bFlushed = false;
+    while (m_fileBuffer.size() < nEnd) {
+        if (m_bFollowTimedOut) {
+            m_fileBuffer.resize(nEnd);
+            break;
+        }
+
+        // whatever was appended since, a frame cut in half included: the rest of it is waited for
+        size_t nSize = m_fileBuffer.size();
+        char buffer[1 << 16];
+        size_t nRead;
+        while ((nRead = fread(buffer, 1, sizeof(buffer), m_pFollowFile)) > 0)
+            m_fileBuffer.append(buffer, nRead);
+        clearerr(m_pFollowFile);
+        if (m_fileBuffer.size() >= nEnd)
+            break;
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (m_fileBuffer.size() > nSize) {
+            lastGrowth = now;
+        } else if (now - lastGrowth > std::chrono::seconds(DEMO_FOLLOW_TIMEOUT_SECONDS)) {
+            // no dem_stop is coming, zeros end the parse at the next command header
+            fprintf(stderr, "CDemoFile::FollowData: %s stopped growing, stopping.\n",
+                    m_szFileName.c_str());
+            m_bFollowTimedOut = true;
+            continue;
+        }
+
+        // whoever reads the output gets what's parsed so far while the recorder catches up
+        if (!bFlushed) {
+            fflush(stdout);
+            bFlushed = true;
+        }
+#ifdef __linux__
+        if (m_nFollowNotify >= 0) {
+            struct pollfd pfd = {m_nFollowNotify, POLLIN, 0};
+            if (poll(&pfd, 1, 1000) > 0) {
+                char events[4096];
+                while (read(m_nFollowNotify, events, sizeof(events)) > 0) {
+                }
+            }
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(DEMO_FOLLOW_POLL_MS));
+    }
+    m_nBytesRead.store(m_fileBuffer.size(), std::memory_order_release);
+}
+
 void CDemoFile::Close() {
+    if (m_reader.joinable()) {
+        m_bStopReading = true;
+        m_reader.join();
+    }
+    if (m_pFollowFile) {
+        fclose(m_pFollowFile);
+        m_pFollowFile = NULL;
+    }
+#ifdef __linux__
+    if (m_nFollowNotify >= 0) {
+        close(m_nFollowNotify);
+        m_nFollowNotify = -1;
+    }
+#endif
+    m_bFollow = false;
     m_szFileName.clear();
 
     m_fileBufferPos = 0;
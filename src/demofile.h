@@ -28,13 +28,22 @@
 #pragma once
 #endif
 
+#include <stdio.h>
+#include <atomic>
 #include <string>
+#include <thread>
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
 #define DEMO_HEADER_ID		"HL2DEMO"
 #define DEMO_PROTOCOL		4
+// the demo is read in chunks of this size, parsing can start after the first
+#define DEMO_READ_CHUNK_SIZE	( 1 << 20 )
+// followed demos are checked for new data this often without inotify
+#define DEMO_FOLLOW_POLL_MS		250
+// a followed demo that didn't grow for this long is taken to be abandoned by its recorder
+#define DEMO_FOLLOW_TIMEOUT_SECONDS	300
 
 #if !defined( MAX_OSPATH )
 #define	MAX_OSPATH		260			// max length of a filesystem pathname
@@ -224,7 +233,9 @@ public:
 	CDemoFile();
 	virtual ~CDemoFile();
 
-	bool	Open( const char *name );
+	// With bFollow the demo may still be recorded: reads past the end wait for the recorder to
+	// append the data instead of hitting the end.
+	bool	Open( const char *name, bool bFollow = false );
 	void	Close();
 
 	int32	ReadRawData( char *buffer, int32 length );
@@ -246,6 +257,29 @@ public:
 
 	size_t m_fileBufferPos;
 	std::string m_fileBuffer;
+
+private:
+	// Open() only reads the header, a thread reads the rest into m_fileBuffer while the caller
+	// parses what's there. m_nBytesRead is how far it got.
+	void	ReadFileThread( FILE *fp, char *pBuffer, size_t nLength );
+	// Waits until the first nEnd bytes of m_fileBuffer are read, or all the file could give.
+	void	WaitForData( size_t nEnd );
+
+	// Followed demos are read on the parse thread instead, as far as nEnd, waiting for the
+	// recorder in between.
+	void	FollowData( size_t nEnd );
+
+	std::thread m_reader;
+	std::atomic<size_t> m_nBytesRead;
+	std::atomic<bool> m_bReadDone;
+	std::atomic<bool> m_bStopReading;
+
+	bool m_bFollow;
+	FILE *m_pFollowFile;
+	// inotify descriptor watching the followed demo, -1 to poll
+	int m_nFollowNotify;
+	// the recorder went away, what's missing reads as zeros
+	bool m_bFollowTimedOut;
 };
 
 #endif // DEMOFILE_H
@@ -23,6 +23,8 @@
 //===========================================================================//
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "demofilebitbuf.h"
 
 const uint32 CBitRead::s_nMaskTable[33] = {
@@ -130,6 +132,13 @@ unsigned int CBitRead::ReadUBitLong(int numbits) {
     }
 }
 
+unsigned int CBitRead::PeekUBitLong(int numbits) {
+    unsigned int nRet = m_nInBufWord;
+    if (m_nBitsAvail < numbits && m_pDataIn < m_pBufferEnd)
+        nRet |= *m_pDataIn << m_nBitsAvail;
+    return nRet & s_nMaskTable[numbits];
+}
+
 int CBitRead::ReadSBitLong(int numbits) {
     int nRet = ReadUBitLong(numbits);
     // sign extend
@@ -144,6 +153,19 @@ int CBitRead::ReadSBitLong(int numbits) {
                                 // packing benchmark
 #endif
 unsigned int CBitRead::ReadUBitVar(void) {
+    // all but the 32 bit form fit in 14 bits, decode those from a peek with the size from the
+    // selector bits
+    static const int s_nExtraBits[4] = {0, 4, 8, 28};
+    if (CanPeekUBitLong(14)) {
+        unsigned int nBits = PeekUBitLong(14);
+        int nSelector = (nBits >> 4) & 3;
+        if (nSelector != 3) {
+            int nExtra = s_nExtraBits[nSelector];
+            ReadUBitLong(6 + nExtra);
+            return (nBits & 15) | (((nBits >> 6) & s_nMaskTable[nExtra]) << 4);
+        }
+    }
+
     unsigned int ret = ReadUBitLong(6);
     switch (ret & (16 | 32)) {
     case 16:
@@ -563,3 +585,232 @@ float CBitRead::ReadBitFloat(void) {
     uint32 nvalue = ReadUBitLong(32);
     return *((float *)&nvalue);
 }
+
+void CBitWrite::WriteUBitLong(unsigned int data, int numbits) {
+    assert(numbits >= 0 && numbits <= 32);
+    if (numbits < 32) {
+        data &= (1u << numbits) - 1;
+    }
+
+    size_t nBytesNeeded = (m_nDataBits + numbits + 7) >> 3;
+    if (m_data.size() < nBytesNeeded) {
+        m_data.resize(nBytesNeeded, 0);
+    }
+
+    while (numbits > 0) {
+        int nBitOfs = m_nDataBits & 7;
+        int nBits = MIN(8 - nBitOfs, numbits);
+        m_data[m_nDataBits >> 3] |= (unsigned char)((data & ((1u << nBits) - 1)) << nBitOfs);
+        data >>= nBits;
+        numbits -= nBits;
+        m_nDataBits += nBits;
+    }
+}
+
+void CBitWrite::WriteSBitLong(int data, int numbits) { WriteUBitLong((unsigned int)data, numbits); }
+
+void CBitWrite::WriteUBitVar(unsigned int data) {
+    // inverse of CBitRead::ReadUBitVar: low nibble plus a 2 bit size selector
+    if (data < 16) {
+        WriteUBitLong(data, 6);
+    } else if (data < 256) {
+        WriteUBitLong((data & 15) | 16, 6);
+        WriteUBitLong(data >> 4, 4);
+    } else if (data < 4096) {
+        WriteUBitLong((data & 15) | 32, 6);
+        WriteUBitLong(data >> 4, 8);
+    } else {
+        WriteUBitLong((data & 15) | 48, 6);
+        WriteUBitLong(data >> 4, 32 - 4);
+    }
+}
+
+void CBitWrite::WriteOneBit(int nValue) { WriteUBitLong(nValue ? 1 : 0, 1); }
+
+void CBitWrite::WriteLong(int val) { WriteSBitLong(val, sizeof(int32) << 3); }
+
+void CBitWrite::WriteChar(int val) { WriteSBitLong(val, sizeof(char) << 3); }
+
+void CBitWrite::WriteByte(int val) { WriteUBitLong(val, sizeof(unsigned char) << 3); }
+
+void CBitWrite::WriteShort(int val) { WriteSBitLong(val, sizeof(short) << 3); }
+
+void CBitWrite::WriteWord(int val) { WriteUBitLong(val, sizeof(unsigned short) << 3); }
+
+void CBitWrite::WriteFloat(float val) { WriteBitFloat(val); }
+
+void CBitWrite::WriteBits(const void *pIn, int nBits) {
+    const unsigned char *pBytes = (const unsigned char *)pIn;
+    while (nBits >= 8) {
+        WriteUBitLong(*pBytes++, 8);
+        nBits -= 8;
+    }
+    if (nBits) {
+        WriteUBitLong(*pBytes, nBits);
+    }
+}
+
+void CBitWrite::WriteBytes(const void *pIn, int nBytes) { WriteBits(pIn, nBytes << 3); }
+
+void CBitWrite::WriteString(const char *pStr) {
+    if (pStr) {
+        while (*pStr) {
+            WriteChar(*pStr++);
+        }
+    }
+    WriteChar(0);
+}
+
+void CBitWrite::WriteVarInt32(uint32 data) {
+    while (data > 0x7F) {
+        WriteUBitLong((data & 0x7F) | 0x80, 8);
+        data >>= 7;
+    }
+    WriteUBitLong(data & 0x7F, 8);
+}
+
+void CBitWrite::WriteVarInt64(uint64 data) {
+    while (data > 0x7F) {
+        WriteUBitLong((uint32)(data & 0x7F) | 0x80, 8);
+        data >>= 7;
+    }
+    WriteUBitLong((uint32)(data & 0x7F), 8);
+}
+
+void CBitWrite::WriteBitAngle(float fAngle, int numbits) {
+    unsigned int shift = GetBitForBitnum(numbits);
+    unsigned int mask = shift - 1;
+
+    int d = (int)((fAngle / 360.0) * shift);
+    d &= mask;
+
+    WriteUBitLong((unsigned int)d, numbits);
+}
+
+void CBitWrite::WriteBitCoord(float f) {
+    int signbit = (f <= -COORD_RESOLUTION);
+    int intval = (int)fabsf(f);
+    int fractval = abs((int)(f * COORD_DENOMINATOR)) & (COORD_DENOMINATOR - 1);
+
+    // Send the bit flags that indicate whether we have an integer part and/or a fraction part.
+    WriteOneBit(intval);
+    WriteOneBit(fractval);
+
+    if (intval || fractval) {
+        WriteOneBit(signbit);
+
+        // Send the integer if we have one, shifted to [0..MAX_COORD_VALUE-1]
+        if (intval) {
+            WriteUBitLong((unsigned int)(intval - 1), COORD_INTEGER_BITS);
+        }
+
+        if (fractval) {
+            WriteUBitLong((unsigned int)fractval, COORD_FRACTIONAL_BITS);
+        }
+    }
+}
+
+void CBitWrite::WriteBitCoordMP(float f, EBitCoordType coordType) {
+    bool bIntegral = (coordType == kCW_Integral);
+    bool bLowPrecision = (coordType == kCW_LowPrecision);
+
+    int signbit = (f <= -(bLowPrecision ? COORD_RESOLUTION_LOWPRECISION : COORD_RESOLUTION));
+    int intval = (int)fabsf(f);
+    int fractval =
+        bLowPrecision
+            ? (abs((int)(f * COORD_DENOMINATOR_LOWPRECISION)) & (COORD_DENOMINATOR_LOWPRECISION - 1))
+            : (abs((int)(f * COORD_DENOMINATOR)) & (COORD_DENOMINATOR - 1));
+
+    bool bInBounds = intval < (1 << COORD_INTEGER_BITS_MP);
+    WriteOneBit(bInBounds);
+
+    if (bIntegral) {
+        WriteOneBit(intval);
+        if (intval) {
+            WriteOneBit(signbit);
+            WriteUBitLong((unsigned int)(intval - 1),
+                          bInBounds ? COORD_INTEGER_BITS_MP : COORD_INTEGER_BITS);
+        }
+    } else {
+        WriteOneBit(intval);
+        WriteOneBit(signbit);
+        if (intval) {
+            WriteUBitLong((unsigned int)(intval - 1),
+                          bInBounds ? COORD_INTEGER_BITS_MP : COORD_INTEGER_BITS);
+        }
+        WriteUBitLong((unsigned int)fractval, bLowPrecision ? COORD_FRACTIONAL_BITS_MP_LOWPRECISION
+                                                            : COORD_FRACTIONAL_BITS);
+    }
+}
+
+void CBitWrite::WriteBitCellCoord(float f, int bits, EBitCoordType coordType) {
+    bool bIntegral = (coordType == kCW_Integral);
+    bool bLowPrecision = (coordType == kCW_LowPrecision);
+
+    int intval = (int)fabsf(f);
+
+    if (bIntegral) {
+        WriteUBitLong((unsigned int)intval, bits);
+    } else {
+        int fractval = bLowPrecision ? (abs((int)(f * COORD_DENOMINATOR_LOWPRECISION)) &
+                                        (COORD_DENOMINATOR_LOWPRECISION - 1))
+                                     : (abs((int)(f * COORD_DENOMINATOR)) & (COORD_DENOMINATOR - 1));
+
+        WriteUBitLong((unsigned int)intval, bits);
+        WriteUBitLong((unsigned int)fractval, bLowPrecision ? COORD_FRACTIONAL_BITS_MP_LOWPRECISION
+                                                            : COORD_FRACTIONAL_BITS);
+    }
+}
+
+void CBitWrite::WriteBitVec3Coord(const Vector &fa) {
+    int xflag = (fa.x >= COORD_RESOLUTION) || (fa.x <= -COORD_RESOLUTION);
+    int yflag = (fa.y >= COORD_RESOLUTION) || (fa.y <= -COORD_RESOLUTION);
+    int zflag = (fa.z >= COORD_RESOLUTION) || (fa.z <= -COORD_RESOLUTION);
+
+    WriteOneBit(xflag);
+    WriteOneBit(yflag);
+    WriteOneBit(zflag);
+
+    if (xflag)
+        WriteBitCoord(fa.x);
+    if (yflag)
+        WriteBitCoord(fa.y);
+    if (zflag)
+        WriteBitCoord(fa.z);
+}
+
+void CBitWrite::WriteBitNormal(float f) {
+    int signbit = (f <= -NORMAL_RESOLUTION);
+
+    // NOTE: Since +/-1 are valid values for a normal, I'm going to encode that as all ones
+    unsigned int fractval = abs((int)(f * NORMAL_DENOMINATOR));
+
+    // clamp..
+    if (fractval > NORMAL_DENOMINATOR)
+        fractval = NORMAL_DENOMINATOR;
+
+    WriteOneBit(signbit);
+    WriteUBitLong(fractval, NORMAL_FRACTIONAL_BITS);
+}
+
+void CBitWrite::WriteBitVec3Normal(const Vector &fa) {
+    int xflag = (fa.x >= NORMAL_RESOLUTION) || (fa.x <= -NORMAL_RESOLUTION);
+    int yflag = (fa.y >= NORMAL_RESOLUTION) || (fa.y <= -NORMAL_RESOLUTION);
+
+    WriteOneBit(xflag);
+    WriteOneBit(yflag);
+
+    if (xflag)
+        WriteBitNormal(fa.x);
+    if (yflag)
+        WriteBitNormal(fa.y);
+
+    // Write z sign bit
+    WriteOneBit(fa.z <= -NORMAL_RESOLUTION);
+}
+
+void CBitWrite::WriteBitFloat(float val) {
+    uint32 nvalue;
+    memcpy(&nvalue, &val, sizeof(nvalue));
+    WriteUBitLong(nvalue, 32);
+}
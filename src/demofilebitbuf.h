@@ -26,6 +26,7 @@
 #define DEMOFILEBITBUF_H
 
 #include <math.h>
+#include <vector>
 #include "demofile.h"
 
 // OVERALL Coordinate Size Limits used in COMMON.C MSG_*BitCoord() Routines (and someday the HUD)
@@ -188,7 +189,14 @@ public:
 	unsigned int ReadUBitLong( int numbits );
 	int ReadSBitLong( int numbits );
 	unsigned int ReadUBitVar( void );
+	// The next numbits bits without reading them. Past the end of the buffer they read as 0, see
+	// CanPeekUBitLong.
 	unsigned int PeekUBitLong( int numbits );
+	// True if the next numbits bits are all in the buffer.
+	bool CanPeekUBitLong( int numbits ) const
+	{
+		return m_nBitsAvail >= numbits || m_pDataIn < m_pBufferEnd;
+	}
 	bool ReadBytes( void *pOut, int nBytes );
 
 	// Returns 0 or 1.
@@ -233,6 +241,74 @@ public:
 	int64 ReadSignedVarInt64() { return bitbuf::ZigZagDecode64( ReadVarInt64() ); }
 };
 
+// Writes bitstreams in the layout CBitRead expects: bits are packed LSB first
+// into consecutive bytes, so a buffer produced here can be fed straight back
+// into CBitRead (after padding it to a dword boundary).
+class CBitWrite
+{
+	std::vector< unsigned char > m_data;
+	int m_nDataBits;
+
+public:
+	CBitWrite( void )
+	{
+		m_nDataBits = 0;
+	}
+
+	void Reset( void )
+	{
+		m_data.clear();
+		m_nDataBits = 0;
+	}
+
+	int GetNumBitsWritten( void ) const
+	{
+		return m_nDataBits;
+	}
+
+	int GetNumBytesWritten( void ) const
+	{
+		return ( m_nDataBits + 7 ) >> 3;
+	}
+
+	const unsigned char *GetData( void ) const
+	{
+		return m_data.empty() ? NULL : &m_data[ 0 ];
+	}
+
+	void WriteUBitLong( unsigned int data, int numbits );
+	void WriteSBitLong( int data, int numbits );
+	void WriteUBitVar( unsigned int data );
+	void WriteBytes( const void *pIn, int nBytes );
+	void WriteBits( const void *pIn, int nBits );
+
+	void WriteOneBit( int nValue );
+	void WriteLong( int val );
+	void WriteChar( int val );
+	void WriteByte( int val );
+	void WriteShort( int val );
+	void WriteWord( int val );
+	void WriteFloat( float val );
+
+	void WriteBitCoord( float f );
+	void WriteBitCoordMP( float f, EBitCoordType coordType );
+	void WriteBitCellCoord( float f, int bits, EBitCoordType coordType );
+	void WriteBitNormal( float f );
+	void WriteBitVec3Coord( const Vector& fa );
+	void WriteBitVec3Normal( const Vector& fa );
+	void WriteBitAngle( float fAngle, int numbits );
+	void WriteBitFloat( float val );
+
+	// Writes the string followed by a null terminator.
+	void WriteString( const char *pStr );
+
+	// writes a varint encoded integer
+	void WriteVarInt32( uint32 data );
+	void WriteVarInt64( uint64 data );
+	void WriteSignedVarInt32( int32 data ) { WriteVarInt32( bitbuf::ZigZagEncode32( data ) ); }
+	void WriteSignedVarInt64( int64 data ) { WriteVarInt64( bitbuf::ZigZagEncode64( data ) ); }
+};
+
 #ifndef MIN
 #define MIN( a, b ) ( ( ( a ) < ( b ) ) ? ( a ) : ( b ) )
 #endif
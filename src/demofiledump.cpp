@@ -23,14 +23,29 @@
 //===========================================================================//
 
 #include <algorithm>
+#include <deque>
 #include <stdarg.h>
 #include <string>
 #include <set>
 #include <unordered_map>
+#include <unordered_set>
 #include <json_spirit_writer.h>
 #include "demofile.h"
 #include "demofiledump.h"
 #include "demofilepropdecode.h"
+#include "entityhistory.h"
+#include "entitylog.h"
+#include "eventfilter.h"
+#include "matchstats.h"
+#include "memstats.h"
+#include "outputstreams.h"
+#include "outputwriter.h"
+#include "playerregistry.h"
+#include "propwatch.h"
+#include "stringinterner.h"
+#include "stringtableparser.h"
+#include "textformat.h"
+#include "trace.h"
 #include "win_stuff.h"
 #include "geometry.h"
 #include "google/protobuf/descriptor.h"
@@ -55,13 +70,17 @@ static StringTableData_t s_StringTables[MAX_STRING_TABLES];
 
 static int s_nServerClassBits = 0;
 static std::vector<ServerClass_t> s_ServerClasses;
-static std::vector<CSVCMsg_SendTable> s_DataTables;
-static std::vector<ExcludeEntry> s_currentExcludes;
+// a deque so the flattened props' pointers into the tables stay put as tables are added
+static std::deque<CSVCMsg_SendTable> s_DataTables;
+// s_DataTables index by net table name, the first table of a name
+static std::unordered_map<std::string, int> s_DataTableIndices;
+// dem_datatables payload s_DataTables and s_ServerClasses were built from
+static std::string s_dataTablesRaw;
+// var names of the props excluded from each table, for the class being flattened
+static std::unordered_map<const CSVCMsg_SendTable *, std::unordered_set<std::string>>
+    s_currentExcludes;
 static std::vector<EntityEntry *> s_Entities;
-static std::vector<player_info_t> s_PlayerInfos;
-static std::map<int, player_info_t> userid_info;
-// map xuid to player slot
-static std::map<uint64, int> player_slot;
+static CPlayerRegistry s_Players;
 enum { DT_CSPlayer = 0, DT_CSGameRulesProxy = 1, DT_CSTeam = 2 };
 std::set<int> playerEntityProperties;
 int serverClassesIds[3];
@@ -78,9 +97,30 @@ extern bool g_bDumpStringTables;
 extern bool g_bDumpDataTables;
 extern bool g_bDumpPacketEntities;
 extern bool g_bDumpNetMessages;
+extern float g_flSampleHz;
+extern const char *g_pSampleProps;
+extern const char *g_pWhere;
+extern int g_nKeyframeInterval;
+extern const char *g_pStateAtTicks;
+extern const char *g_pEntityLog;
+extern bool g_bMatchStats;
+extern bool g_bFollow;
+extern const char *g_pOutputFile;
+extern const char *g_pOutputPaths[kOutput_Count];
 
 static bool s_bMatchStartOccured = false;
 static int s_nCurrentTick;
+// -stateat: every entity change of the demo, queried once it's parsed
+static CEntityHistory s_EntityHistory;
+// -entitylog
+static CEntityLog s_EntityLog;
+// -where, compiled against every game event list
+static CEventFilter s_EventFilter;
+// callbacks of the -hsbox prop driven events
+static CPropWatch s_PropWatch;
+// -stats, and the rounds it closed for -json
+static CMatchStats s_MatchStats;
+static json_spirit::wmArray s_roundStats;
 json_spirit::wmObject player_names;
 
 EntityEntry *FindEntity(int nEntity);
@@ -101,12 +141,34 @@ std::wstring toWide(const std::string &s) {
     }
 }
 
-void addUserId(const player_info_t &playerInfo) {
-    userid_info[playerInfo.userID] = playerInfo;
-    if (!playerInfo.fakeplayer && !playerInfo.ishltv) {
-        player_names[std::to_wstring(playerInfo.xuid)] = toWide(playerInfo.name);
-        player_slot[playerInfo.xuid] = playerInfo.entityID;
+// toWide of interned strings, by id, so each distinct event name, key, value or player name is
+// converted once per demo
+static std::vector<std::wstring> s_wideStrings;
+static std::vector<bool> s_bWideStrings;
+
+const std::wstring &toWideInterned(const char *pString, size_t nLength) {
+    uint32 id = CStringInterner::Id(g_StringInterner.Intern(pString, nLength));
+    if (id >= s_wideStrings.size()) {
+        s_wideStrings.resize(id + 1);
+        s_bWideStrings.resize(id + 1, false);
+    }
+    if (!s_bWideStrings[id]) {
+        s_wideStrings[id] = toWide(std::string(pString, nLength));
+        s_bWideStrings[id] = true;
     }
+    return s_wideStrings[id];
+}
+
+const std::wstring &toWideInterned(const std::string &s) {
+    return toWideInterned(s.data(), s.size());
+}
+
+// Adds the player to its slot or replaces whoever was there. True if the slot was empty.
+bool addPlayer(const player_info_t &playerInfo) {
+    if (!playerInfo.fakeplayer && !playerInfo.ishltv)
+        player_names[std::to_wstring(playerInfo.xuid)] =
+            toWideInterned(playerInfo.name, strnlen(playerInfo.name, sizeof(playerInfo.name)));
+    return s_Players.Set(playerInfo);
 }
 
 uint64 guid2xuid(std::string guid) {
@@ -125,32 +187,32 @@ struct Team {
 std::unordered_map<int, int> id2teamno;
 Team teams[4];
 double tick_rate = -1;
-std::map<uint64_t, int> jumped_last;
-std::map<uint64_t, int> scoped_since;
+std::unordered_map<uint64_t, int> jumped_last;
+std::unordered_map<uint64_t, int> scoped_since;
 const double jump_duration = 0.75; // seconds
 const double smoke_radius = 140;
 const double player_height = 72;
 const double player_crouch_height = 50;
 const double smoke_height = 130;
-std::map<uint64_t, int> bot_takeover;
-// Map entityid to Point
-std::map<int, Point> smokes;
+std::unordered_map<uint64_t, int> bot_takeover;
+// Active smokes by entityid
+SmokeIndex smokes(smoke_radius, smoke_height);
 
 json_spirit::wmArray point_to_json(const Point &p) {
     return json_spirit::wmArray({int(p.x), int(p.y), int(p.z)});
 }
 
 void addSmokes(Point p1, Point p2, json_spirit::wmObject &event) {
+    static std::vector<int> blocked;
+    blocked.clear();
+    Point killer(p1.x, p1.y, p1.z + player_crouch_height);
+    // Check if shooting to the legs AND head of the victim goes through smoke
+    Point from[2] = {killer, killer};
+    Point to[2] = {p2, Point(p2.x, p2.y, p2.z + player_height)};
+    smokes.blocking(from, to, 2, blocked);
     json_spirit::wmArray tmp;
-    for (auto &kv : smokes) {
-        Point killer(p1.x, p1.y, p1.z + player_crouch_height);
-        // Check if shooting to the legs AND head of the victim goes through smoke
-        if (intersects(killer, p2, kv.second, smoke_radius, smoke_height) &&
-            intersects(killer, Point(p2.x, p2.y, p2.z + player_height), kv.second, smoke_radius,
-                       smoke_height)) {
-            tmp.push_back(point_to_json(kv.second));
-        }
-    }
+    for (int id : blocked)
+        tmp.push_back(point_to_json(smokes.center(id)));
     if (!tmp.empty())
         event[L"smoke"] = tmp;
 }
@@ -167,7 +229,9 @@ static std::set<std::wstring> hsbox_events = {L"player_death",
                                               L"player_disconnected",
                                               L"round_officially_ended"};
 
-void addEvent(const std::map<std::wstring, json_spirit::wmConfig::Value_type> &object_) {
+// bOutput false still does the -hsbox bookkeeping, but leaves the event out of the output
+void addEvent(const std::map<std::wstring, json_spirit::wmConfig::Value_type> &object_,
+              bool bOutput = true) {
     std::map<std::wstring, json_spirit::wmConfig::Value_type> object = object_;
     if (g_bOnlyHsBoxEvents) {
         std::wstring type = object.at(L"type").get_str();
@@ -181,23 +245,25 @@ void addEvent(const std::map<std::wstring, json_spirit::wmConfig::Value_type> &o
             jumped_last[object.at(L"userid").get_int64()] = s_nCurrentTick;
         } else if (type == L"player_death") {
             uint64 attackerid = object.at(L"attacker").get_int64();
-            if (tick_rate > 0 && jumped_last.count(attackerid) &&
-                jumped_last[attackerid] >= s_nCurrentTick - jump_duration / tick_rate) {
-                object[L"jump"] = s_nCurrentTick - jumped_last[attackerid];
+            auto jumped = jumped_last.find(attackerid);
+            if (tick_rate > 0 && jumped != jumped_last.end() &&
+                jumped->second >= s_nCurrentTick - jump_duration / tick_rate) {
+                object[L"jump"] = s_nCurrentTick - jumped->second;
             }
         } else if (type == L"bot_takeover") {
             uint64 human = object.at(L"userid").get_int64();
             int bot = object.at(L"botid").get_int();
             bot_takeover[human] = bot;
         } else if (type == L"smokegrenade_detonate") {
-            smokes[object.at(L"entityid").get_int()] = Point(
-                object.at(L"x").get_real(), object.at(L"y").get_real(), object.at(L"z").get_real());
+            smokes.add(object.at(L"entityid").get_int(),
+                       Point(object.at(L"x").get_real(), object.at(L"y").get_real(),
+                             object.at(L"z").get_real()));
         } else if (type == L"smokegrenade_expired") {
-            smokes.erase(object.at(L"entityid").get_int());
+            smokes.remove(object.at(L"entityid").get_int());
         }
     }
-    if (!g_bOnlyHsBoxEvents ||
-        (g_bOnlyHsBoxEvents && hsbox_events.count(object.at(L"type").get_str())))
+    if (bOutput && (!g_bOnlyHsBoxEvents ||
+                    (g_bOnlyHsBoxEvents && hsbox_events.count(object.at(L"type").get_str()))))
         events.push_back(object);
 }
 
@@ -222,7 +288,9 @@ void fatal_errorf(const char *fmt, ...) {
 }
 
 bool CDemoFileDump::Open(const char *filename) {
-    if (!m_demofile.Open(filename)) {
+    TRACE_SCOPE("Open");
+    MEM_SCOPE(kMem_FileBuffer);
+    if (!m_demofile.Open(filename, g_bFollow)) {
         fprintf(stderr, "Couldn't open '%s'\n", filename);
         return false;
     }
@@ -230,13 +298,15 @@ bool CDemoFileDump::Open(const char *filename) {
     return true;
 }
 
+void CDemoFileDump::Close() { m_demofile.Close(); }
+
 void CDemoFileDump::MsgPrintf(const ::google::protobuf::Message &msg, int size) {
     if (g_bDumpNetMessages && !g_bDumpJson) {
         const std::string &TypeName = msg.GetTypeName();
 
         // Print the message type and size
-        printf("---- %s (%d bytes) -----------------\n%s", TypeName.c_str(), size,
-               msg.DebugString().c_str());
+        fprintf(OutputStream(kOutput_NetMessages), "---- %s (%d bytes) -----------------\n%s",
+                TypeName.c_str(), size, msg.DebugString().c_str());
     }
 }
 
@@ -357,6 +427,10 @@ void PrintNetMessage(CDemoFileDump &Demo, const void *parseBuffer, int BufferSiz
     if (msg.ParseFromArray(parseBuffer, BufferSize)) {
         if (msgType == svc_GameEventList) {
             Demo.m_GameEventList.CopyFrom(msg);
+            if (g_pWhere)
+                s_EventFilter.Compile(Demo.m_GameEventList);
+            if (g_bMatchStats)
+                s_MatchStats.Compile(Demo.m_GameEventList);
         }
         Demo.MsgPrintf(msg, BufferSize);
     }
@@ -367,15 +441,18 @@ void PrintNetMessage<CSVCMsg_ServerInfo, svc_ServerInfo>(CDemoFileDump &Demo,
                                                          const void *parseBuffer,
                                                          int BufferSize) {
     CSVCMsg_ServerInfo serverInfo;
+    bool bParsed = serverInfo.ParseFromArray(parseBuffer, BufferSize);
 
     if (g_bDumpJson) {
-        if (serverInfo.ParseFromArray(parseBuffer, BufferSize) && serverInfo.has_map_name()) {
+        if (bParsed && serverInfo.has_map_name()) {
             match[L"map"] = toWide(serverInfo.map_name());
             match[L"tickrate"] = serverInfo.tick_interval();
         }
     } else
         Demo.DumpUserMessage(parseBuffer, BufferSize);
     tick_rate = serverInfo.tick_interval();
+    if (tick_rate > 0)
+        s_MatchStats.SetTradeWindow((int)(MATCHSTATS_TRADE_SECONDS / tick_rate + 0.5));
 }
 
 template <>
@@ -385,27 +462,9 @@ void PrintNetMessage<CSVCMsg_UserMessage, svc_UserMessage>(CDemoFileDump &Demo,
     Demo.DumpUserMessage(parseBuffer, BufferSize);
 }
 
-player_info_t *FindPlayerInfo(int userId) {
-    for (std::vector<player_info_t>::iterator i = s_PlayerInfos.begin(); i != s_PlayerInfos.end();
-         i++) {
-        if (i->userID == userId) {
-            return &(*i);
-        }
-    }
+player_info_t *FindPlayerInfo(int userId) { return s_Players.FindByUserId(userId); }
 
-    return NULL;
-}
-
-player_info_t *FindPlayerByEntity(int entityId) {
-    for (std::vector<player_info_t>::iterator j = s_PlayerInfos.begin(); j != s_PlayerInfos.end();
-         j++) {
-        if (j->entityID == entityId) {
-            return &(*j);
-        }
-    }
-
-    return NULL;
-}
+player_info_t *FindPlayerByEntity(int entityId) { return s_Players.FindByEntity(entityId); }
 
 const CSVCMsg_GameEventList::descriptor_t *GetGameEventDescriptor(const CSVCMsg_GameEvent &msg,
                                                                   CDemoFileDump &Demo) {
@@ -422,7 +481,7 @@ const CSVCMsg_GameEventList::descriptor_t *GetGameEventDescriptor(const CSVCMsg_
     if (iDescriptor == Demo.m_GameEventList.descriptors().size()) {
         if (g_bDumpGameEvents) {
             if (!g_bDumpJson)
-                printf("%s", msg.DebugString().c_str());
+                fprintf(OutputStream(kOutput_GameEvents), "%s", msg.DebugString().c_str());
         }
         return NULL;
     }
@@ -431,12 +490,14 @@ const CSVCMsg_GameEventList::descriptor_t *GetGameEventDescriptor(const CSVCMsg_
 }
 
 bool HandlePlayerConnectDisconnectEvents(const CSVCMsg_GameEvent &msg,
-                                         const CSVCMsg_GameEventList::descriptor_t *pDescriptor) {
+                                         const CSVCMsg_GameEventList::descriptor_t *pDescriptor,
+                                         bool bWanted) {
     // need to handle player_connect and player_disconnect because this is the only place bots get
     // added to our player info array
     // actual players come in via string tables
     bool bPlayerDisconnect = (pDescriptor->name().compare("player_disconnect") == 0);
     if (pDescriptor->name().compare("player_connect") == 0 || bPlayerDisconnect) {
+        FILE *fp = OutputStream(kOutput_GameEvents);
         int numKeys = msg.keys().size();
         int userid = -1;
         unsigned int index = -1;
@@ -464,10 +525,10 @@ bool HandlePlayerConnectDisconnectEvents(const CSVCMsg_GameEvent &msg,
             }
         }
         if (!g_bDumpJson)
-            printf("userid %d index %d\n", userid, index);
+            fprintf(fp, "userid %d index %d\n", userid, index);
 
         if (bPlayerDisconnect) {
-            if (g_bDumpGameEvents) {
+            if (g_bDumpGameEvents && bWanted) {
                 if (g_bDumpJson)
                     addEvent({{L"type", L"player_disconnected"},
                               {L"name", toWide(name)},
@@ -475,17 +536,16 @@ bool HandlePlayerConnectDisconnectEvents(const CSVCMsg_GameEvent &msg,
                               {L"reason", toWide(reason)},
                               {L"userid", getXuid(userid)}});
                 else
-                    printf("Player %s (id:%d) disconnected. reason:%s\n", name, userid, reason);
+                    fprintf(fp, "Player %s (id:%d) disconnected. reason:%s\n", name, userid,
+                            reason);
             }
             // mark the player info slot as disconnected
             player_info_t *pPlayerInfo = FindPlayerInfo(userid);
             if (pPlayerInfo) {
                 if (!g_bDumpJson)
-                    printf("Mark Player %s %s (id:%d) as disconnected\n", pPlayerInfo->name,
-                           pPlayerInfo->guid, pPlayerInfo->userID);
-                strcpy(pPlayerInfo->name, "disconnected");
-                pPlayerInfo->userID = -1;
-                pPlayerInfo->guid[0] = 0;
+                    fprintf(fp, "Mark Player %s %s (id:%d) as disconnected\n", pPlayerInfo->name,
+                            pPlayerInfo->guid, pPlayerInfo->userID);
+                s_Players.Disconnect(pPlayerInfo);
             }
         } else {
             player_info_t newPlayer;
@@ -501,29 +561,28 @@ bool HandlePlayerConnectDisconnectEvents(const CSVCMsg_GameEvent &msg,
             }
 
             newPlayer.entityID = index;
-            addUserId(newPlayer);
             auto existing = FindPlayerByEntity(index);
 
             // add entity if it doesn't exist, update if it does
             if (!existing) {
-                if (g_bDumpGameEvents) {
+                if (g_bDumpGameEvents && bWanted) {
                     if (g_bDumpJson)
                         addEvent({{L"type", L"connect"},
                                   {L"name", toWide(name)},
                                   {L"steamid", toWide(newPlayer.guid)},
                                   {L"userid", userid}});
                     else
-                        printf("Player %s %s (id:%d) connected.\n", newPlayer.guid, name, userid);
+                        fprintf(fp, "Player %s %s (id:%d) connected.\n", newPlayer.guid, name,
+                                userid);
                 }
-                s_PlayerInfos.push_back(newPlayer);
             } else {
                 if (!g_bDumpJson) {
-                    printf("Player %s %s %" PRIu64 " (id:%d) replaced with Player %s %s %" PRIu64 " (id:%d).\n",
-                           existing->guid, existing->name, existing->xuid, existing->userID,
-                           newPlayer.guid, newPlayer.name, newPlayer.xuid, newPlayer.userID);
+                    fprintf(fp, "Player %s %s %" PRIu64 " (id:%d) replaced with Player %s %s %" PRIu64 " (id:%d).\n",
+                            existing->guid, existing->name, existing->xuid, existing->userID,
+                            newPlayer.guid, newPlayer.name, newPlayer.xuid, newPlayer.userID);
                 }
-                *existing = newPlayer;
             }
+            addPlayer(newPlayer);
         }
         return true;
     }
@@ -553,13 +612,14 @@ bool ShowPlayerInfo(json_spirit::wmObject &event,
                     int nIndex,
                     bool bShowDetails = true,
                     bool bCSV = false) {
+    FILE *fp = OutputStream(bCSV ? kOutput_Deaths : kOutput_GameEvents);
     player_info_t *pPlayerInfo = FindPlayerInfo(nIndex);
     if (pPlayerInfo) {
         if (bCSV) {
-            printf("%s, %s, %d", pField, pPlayerInfo->name, nIndex);
+            fprintf(fp, "%s, %s, %d", pField, pPlayerInfo->name, nIndex);
         } else {
             if (g_bDumpJson) {
-                std::wstring field = toWide(pField);
+                std::wstring field = toWideInterned(pField, strlen(pField));
                 if (pPlayerInfo->fakeplayer)
                     event[field] = nIndex;
                 else {
@@ -569,53 +629,52 @@ bool ShowPlayerInfo(json_spirit::wmObject &event,
                     // bot_takeover map)
                     // Also ignore player_death's assister field as csgo does the same
                     // (resulting in awarding assists to the controlling human instead of the bot)
-                    if (bot_takeover.count(pPlayerInfo->xuid) && type != L"bot_takeover" &&
+                    auto bot = bot_takeover.find(pPlayerInfo->xuid);
+                    if (bot != bot_takeover.end() && type != L"bot_takeover" &&
                         type != L"player_spawn" &&
                         (type != L"player_death" ||
                          (type == L"player_death" && field != L"assister")))
-                        event[field] = bot_takeover[pPlayerInfo->xuid];
+                        event[field] = bot->second;
                 }
             } else
-                printf(" %s: %s %" PRIu64 " (id:%d)\n", pField, pPlayerInfo->name, pPlayerInfo->xuid, nIndex);
+                fprintf(fp, " %s: %s %" PRIu64 " (id:%d)\n", pField, pPlayerInfo->name, pPlayerInfo->xuid, nIndex);
         }
 
         if (bShowDetails) {
             int nEntityIndex = pPlayerInfo->entityID + 1;
             EntityEntry *pEntity = FindEntity(nEntityIndex);
             if (pEntity) {
+                char line[3 * TEXTFORMAT_FIXED_CHARS + 32];
                 PropEntry *pXYProp = pEntity->FindProp("m_vecOrigin");
                 PropEntry *pZProp = pEntity->FindProp("m_vecOrigin[2]");
                 if (pXYProp && pZProp) {
-                    if (bCSV) {
-                        printf(", %f, %f, %f", pXYProp->m_pPropValue->m_value.m_vector.x,
-                               pXYProp->m_pPropValue->m_value.m_vector.y,
-                               pZProp->m_pPropValue->m_value.m_float);
-                    } else {
-                        printf("  position: %f, %f, %f\n",
-                               pXYProp->m_pPropValue->m_value.m_vector.x,
-                               pXYProp->m_pPropValue->m_value.m_vector.y,
-                               pZProp->m_pPropValue->m_value.m_float);
-                    }
+                    char *p = FormatText(line, bCSV ? ", " : "  position: ");
+                    p = FormatFixed(p, pXYProp->m_pPropValue->m_value.m_vector.x);
+                    p = FormatText(p, ", ");
+                    p = FormatFixed(p, pXYProp->m_pPropValue->m_value.m_vector.y);
+                    p = FormatText(p, ", ");
+                    p = FormatFixed(p, pZProp->m_pPropValue->m_value.m_float);
+                    p = FormatText(p, bCSV ? "" : "\n");
+                    fwrite(line, 1, p - line, fp);
                 }
                 PropEntry *pAngle0Prop = pEntity->FindProp("m_angEyeAngles[0]");
                 PropEntry *pAngle1Prop = pEntity->FindProp("m_angEyeAngles[1]");
                 if (pAngle0Prop && pAngle1Prop) {
-                    if (bCSV) {
-                        printf(", %f, %f", pAngle0Prop->m_pPropValue->m_value.m_float,
-                               pAngle1Prop->m_pPropValue->m_value.m_float);
-                    } else {
-                        printf("  facing: pitch:%f, yaw:%f\n",
-                               pAngle0Prop->m_pPropValue->m_value.m_float,
-                               pAngle1Prop->m_pPropValue->m_value.m_float);
-                    }
+                    char *p = FormatText(line, bCSV ? ", " : "  facing: pitch:");
+                    p = FormatFixed(p, pAngle0Prop->m_pPropValue->m_value.m_float);
+                    p = FormatText(p, bCSV ? ", " : ", yaw:");
+                    p = FormatFixed(p, pAngle1Prop->m_pPropValue->m_value.m_float);
+                    p = FormatText(p, bCSV ? "" : "\n");
+                    fwrite(line, 1, p - line, fp);
                 }
                 PropEntry *pTeamProp = pEntity->FindProp("m_iTeamNum");
                 if (pTeamProp) {
                     if (bCSV) {
-                        printf(", %s", (pTeamProp->m_pPropValue->m_value.m_int == 2) ? "T" : "CT");
+                        fprintf(fp, ", %s",
+                                (pTeamProp->m_pPropValue->m_value.m_int == 2) ? "T" : "CT");
                     } else {
-                        printf("  team: %s\n",
-                               (pTeamProp->m_pPropValue->m_value.m_int == 2) ? "T" : "CT");
+                        fprintf(fp, "  team: %s\n",
+                                (pTeamProp->m_pPropValue->m_value.m_int == 2) ? "T" : "CT");
                     }
                 }
             }
@@ -623,7 +682,7 @@ bool ShowPlayerInfo(json_spirit::wmObject &event,
         return true;
     }
     if (!g_bDumpJson)
-        printf("Cannot find player %d info.\n", nIndex);
+        fprintf(fp, "Cannot find player %d info.\n", nIndex);
     return false;
 }
 
@@ -635,7 +694,7 @@ void HandlePlayerDeath(json_spirit::wmObject &event,
     int userid = -1;
     int attackerid = -1;
     int assisterid = 0;
-    const char *pWeaponName = NULL;
+    const char *pWeaponName = "";
     bool bHeadshot = false;
     for (int i = 0; i < numKeys; i++) {
         const CSVCMsg_GameEventList::key_t &Key = pDescriptor->keys(i);
@@ -654,27 +713,38 @@ void HandlePlayerDeath(json_spirit::wmObject &event,
         }
     }
 
+    // the CSV line is written with -json too, -out can send it to a file of its own
+    FILE *fp = OutputStream(kOutput_Deaths);
     ShowPlayerInfo(event, "victim", userid, true, true);
-    if (!g_bDumpJson)
-        printf(", ");
+    fprintf(fp, ", ");
     ShowPlayerInfo(event, "attacker", attackerid, true, true);
-    if (!g_bDumpJson)
-        printf(", %s, %s", pWeaponName, bHeadshot ? "true" : "false");
+    fprintf(fp, ", %s, %s", pWeaponName, bHeadshot ? "true" : "false");
     if (assisterid != 0) {
-        if (!g_bDumpJson)
-            printf(", ");
+        fprintf(fp, ", ");
         ShowPlayerInfo(event, "assister", assisterid, true, true);
     }
-    if (!g_bDumpJson)
-        printf("\n");
+    fprintf(fp, "\n");
 }
 
+static void PrintProperty(FILE *fp, float value) { fprintf(fp, "%g ", value); }
+static void PrintProperty(FILE *fp, int value) { fprintf(fp, "%d ", value); }
+static void PrintProperty(FILE *fp, bool value) { fprintf(fp, "%d ", value); }
+static void PrintProperty(FILE *fp, uint64 value) { fprintf(fp, "%" PRIu64 " ", value); }
+
 template <typename T>
 void addProperty(json_spirit::wmObject &event, const std::string &key, const T &value) {
     if (g_bDumpJson)
-        event[toWide(key)] = value;
+        event[toWideInterned(key)] = value;
+    else
+        PrintProperty(OutputStream(kOutput_GameEvents), value);
+}
+
+// Strings are printed as they came, UTF-8.
+void addProperty(json_spirit::wmObject &event, const std::string &key, const std::string &value) {
+    if (g_bDumpJson)
+        event[toWideInterned(key)] = toWideInterned(value);
     else
-        std::wcout << value << " ";
+        fprintf(OutputStream(kOutput_GameEvents), "%s ", value.c_str());
 }
 
 void addPropFloat(EntityEntry *pEntity,
@@ -694,32 +764,140 @@ void addKillerProps(int killer, json_spirit::wmObject &event) {
     if (!pEntity)
         return;
     addPropFloat(pEntity, "m_vecVelocity[2]", L"air_velocity", event);
-    if (scoped_since.count(pInfo->xuid))
-        event[L"scoped_since"] = scoped_since[pInfo->xuid];
+    auto scoped = scoped_since.find(pInfo->xuid);
+    if (scoped != scoped_since.end())
+        event[L"scoped_since"] = scoped->second;
+}
+
+// Team number of the player's entity, 0 if it isn't known.
+int getPlayerTeam(int userid) {
+    player_info_t *pInfo = FindPlayerInfo(userid);
+    if (!pInfo)
+        return 0;
+    EntityEntry *pEntity = FindEntity(pInfo->entityID + 1);
+    if (!pEntity)
+        return 0;
+    PropEntry *pTeamProp = pEntity->FindProp("m_iTeamNum");
+    return pTeamProp ? pTeamProp->m_pPropValue->m_value.m_int : 0;
+}
+
+void addStatsPlayer(json_spirit::wmObject &object, const CMatchStats::Player &player) {
+    object[L"kills"] = player.kills;
+    object[L"deaths"] = player.deaths;
+    object[L"assists"] = player.assists;
+    object[L"headshots"] = player.headshots;
+    object[L"damage"] = player.damage;
+    object[L"team_damage"] = player.teamDamage;
+    object[L"trades"] = player.trades;
+    object[L"traded"] = player.traded;
+}
+
+// A round closed by -stats, or with bMatch the match totals.
+void PrintRoundStats(const CMatchStats::Round &round, bool bMatch) {
+    FILE *fp = OutputStream(kOutput_Stats);
+    int nPlayers = (int)round.players.size();
+    json_spirit::wmArray players;
+    json_spirit::wmArray damage;
+    if (!g_bDumpJson) {
+        if (bMatch)
+            fprintf(fp, "match rounds %d end tick %d\n", round.nRound, round.nEndTick);
+        else
+            fprintf(fp, "round %d start tick %d end tick %d winner %d\n", round.nRound,
+                    round.nStartTick, round.nEndTick, round.winner);
+    }
+    for (int i = 0; i < nPlayers; i++) {
+        const CMatchStats::Player &player = round.players[i];
+        uint64 xuid = s_MatchStats.Xuid(i);
+        if (g_bDumpJson) {
+            json_spirit::wmObject object;
+            object[L"xuid"] = xuid;
+            addStatsPlayer(object, player);
+            if (bMatch) {
+                object[L"adr"] = round.nRound ? (double)player.damage / round.nRound : 0.0;
+                object[L"2k"] = player.multikills[1];
+                object[L"3k"] = player.multikills[2];
+                object[L"4k"] = player.multikills[3];
+                object[L"5k"] = player.multikills[4];
+            }
+            players.push_back(object);
+        } else {
+            fprintf(fp, " player %llu kills %d deaths %d assists %d headshots %d damage %d"
+                    " team_damage %d trades %d traded %d",
+                    (unsigned long long)xuid, player.kills, player.deaths, player.assists,
+                    player.headshots, player.damage, player.teamDamage, player.trades,
+                    player.traded);
+            if (bMatch)
+                fprintf(fp, " adr %.1f 2k %d 3k %d 4k %d 5k %d",
+                        round.nRound ? (double)player.damage / round.nRound : 0.0,
+                        player.multikills[1], player.multikills[2], player.multikills[3],
+                        player.multikills[4]);
+            fprintf(fp, "\n");
+        }
+    }
+    for (int i = 0; i < nPlayers; i++) {
+        for (int j = 0; j < nPlayers; j++) {
+            int nDamage = round.damage[i * nPlayers + j];
+            if (!nDamage)
+                continue;
+            if (g_bDumpJson)
+                damage.push_back(json_spirit::wmObject({{L"attacker", s_MatchStats.Xuid(i)},
+                                                        {L"victim", s_MatchStats.Xuid(j)},
+                                                        {L"damage", nDamage}}));
+            else
+                fprintf(fp, " damage %llu %llu %d\n", (unsigned long long)s_MatchStats.Xuid(i),
+                        (unsigned long long)s_MatchStats.Xuid(j), nDamage);
+        }
+    }
+    if (!g_bDumpJson)
+        return;
+
+    json_spirit::wmObject object;
+    object[L"round"] = round.nRound;
+    if (!bMatch) {
+        object[L"start_tick"] = round.nStartTick;
+        object[L"winner"] = round.winner;
+    }
+    object[L"end_tick"] = round.nEndTick;
+    object[L"players"] = players;
+    object[L"damage"] = damage;
+    if (bMatch)
+        match[L"stats"] = object;
+    else
+        s_roundStats.push_back(object);
 }
 
 void ParseGameEvent(const CSVCMsg_GameEvent &msg,
                     const CSVCMsg_GameEventList::descriptor_t *pDescriptor) {
     if (pDescriptor) {
         if (!(pDescriptor->name().compare("player_footstep") == 0 && g_bSupressFootstepEvents)) {
-            if (!HandlePlayerConnectDisconnectEvents(msg, pDescriptor)) {
+            bool bWanted = !g_pWhere || s_EventFilter.Matches(msg, getXuid);
+            if (!HandlePlayerConnectDisconnectEvents(msg, pDescriptor, bWanted)) {
                 if (pDescriptor->name().compare("round_announce_match_start") == 0) {
                     s_bMatchStartOccured = true;
                 }
+                // counted whatever -where says, it would leave rounds without their ends
+                if (g_bMatchStats &&
+                    s_MatchStats.Event(msg, s_nCurrentTick, getXuid, getPlayerTeam)) {
+                    PrintRoundStats(s_MatchStats.LastRound(), false);
+                }
+                // only the -hsbox bookkeeping needs the events -where rejects
+                if (!bWanted && !g_bOnlyHsBoxEvents)
+                    return;
 
+                FILE *fp = OutputStream(kOutput_GameEvents);
                 json_spirit::wmObject event;
                 bool bAllowDeathReport = !g_bSupressWarmupDeaths || s_bMatchStartOccured;
                 if (pDescriptor->name().compare("player_death") == 0 && g_bDumpDeaths &&
-                    bAllowDeathReport) {
+                    bAllowDeathReport && bWanted) {
                     HandlePlayerDeath(event, msg, pDescriptor);
                 }
 
                 if (g_bDumpGameEvents) {
                     if (g_bDumpJson) {
-                        event[L"type"] = toWide(pDescriptor->name());
+                        event[L"type"] = toWideInterned(pDescriptor->name());
                         event[L"tick"] = s_nCurrentTick;
                     } else
-                        printf("%s\n{\n", pDescriptor->name().c_str());
+                        fprintf(fp, "%s\n{\n", pDescriptor->name().c_str());
                 }
                 int numKeys = msg.keys().size();
                 int killer = -1, dead = -1;
@@ -744,10 +922,10 @@ void ParseGameEvent(const CSVCMsg_GameEvent &msg,
                         }
                         if (!bHandled) {
                             if (!g_bDumpJson)
-                                printf(" %s: ", Key.name().c_str());
+                                fprintf(fp, " %s: ", Key.name().c_str());
 
                             if (KeyValue.has_val_string()) {
-                                addProperty(event, Key.name(), toWide(KeyValue.val_string()));
+                                addProperty(event, Key.name(), KeyValue.val_string());
                             }
                             if (KeyValue.has_val_float()) {
                                 addProperty(event, Key.name(), KeyValue.val_float());
@@ -768,7 +946,7 @@ void ParseGameEvent(const CSVCMsg_GameEvent &msg,
                                 addProperty(event, Key.name(), KeyValue.val_uint64());
                             }
                             if (!g_bDumpJson)
-                                printf("\n");
+                                fprintf(fp, "\n");
                         }
                     }
                 }
@@ -786,9 +964,9 @@ void ParseGameEvent(const CSVCMsg_GameEvent &msg,
 
                 if (g_bDumpGameEvents) {
                     if (g_bDumpJson)
-                        addEvent(event);
+                        addEvent(event, bWanted);
                     else
-                        printf("}\n");
+                        fprintf(fp, "}\n");
                 }
             }
         }
@@ -804,161 +982,56 @@ void PrintNetMessage<CSVCMsg_GameEvent, svc_GameEvent>(CDemoFileDump &Demo,
     if (msg.ParseFromArray(parseBuffer, BufferSize)) {
         const CSVCMsg_GameEventList::descriptor_t *pDescriptor = GetGameEventDescriptor(msg, Demo);
         if (pDescriptor) {
+            MEM_SCOPE(kMem_Events);
             ParseGameEvent(msg, pDescriptor);
         }
     }
 }
 
-template <typename T>
-static void LowLevelByteSwap(T *output, const T *input) {
-    T temp = *output;
-    for (unsigned int i = 0; i < sizeof(T); i++) {
-        ((unsigned char *)&temp)[i] = ((unsigned char *)input)[sizeof(T) - (i + 1)];
-    }
-    memcpy(output, &temp, sizeof(T));
-}
-
-void ParseStringTableUpdate(CBitRead &buf,
-                            int entries,
-                            int nMaxEntries,
-                            int user_data_size,
-                            int user_data_size_bits,
-                            int user_data_fixed_size,
-                            bool bIsUserInfo) {
-    struct StringHistoryEntry {
-        char string[(1 << SUBSTRING_BITS)];
-    };
-
-    int lastEntry = -1;
-
-    // perform integer log2() to set nEntryBits
-    int nTemp = nMaxEntries;
-    int nEntryBits = 0;
-    while (nTemp >>= 1)
-        ++nEntryBits;
-
-    bool bEncodeUsingDictionaries = buf.ReadOneBit() ? true : false;
+static void DumpStringTableEntry(void *pContext, const StringTableEntry &entry) {
+    if (g_bDumpStringTables) {
+        // "(null)" is what glibc printed for the missing user data
+        const char *pUserData = entry.pUserData ? (const char *)entry.pUserData : "(null)";
+        fprintf(OutputStream(kOutput_StringTables), " %d, %s, %d, %s \n", entry.nIndex,
+                entry.pString, entry.nUserDataBytes, pUserData);
+    }
+}
 
-    if (bEncodeUsingDictionaries) {
-        printf("ParseStringTableUpdate: Encoded with dictionaries, unable to decode.\n");
+static void DumpUserInfoEntry(void *pContext, const StringTableEntry &entry) {
+    if (!entry.pUserData) {
+        DumpStringTableEntry(pContext, entry);
         return;
     }
 
-    std::vector<StringHistoryEntry> history;
-
-    for (int i = 0; i < entries; i++) {
-        int entryIndex = lastEntry + 1;
+    player_info_t playerInfo;
+    PlayerInfoFromEntry(entry, playerInfo);
+    bool bAdded = addPlayer(playerInfo);
 
-        if (!buf.ReadOneBit()) {
-            entryIndex = buf.ReadUBitLong(nEntryBits);
-        }
-
-        lastEntry = entryIndex;
-
-        if (entryIndex < 0 || entryIndex >= nMaxEntries) {
-            printf("ParseStringTableUpdate: bogus string index %i\n", entryIndex);
-            return;
-        }
-
-        const char *pEntry = NULL;
-        char entry[1024];
-        char substr[1024];
-        entry[0] = 0;
-
-        if (buf.ReadOneBit()) {
-            bool substringcheck = buf.ReadOneBit() ? true : false;
-
-            if (substringcheck) {
-                int index = buf.ReadUBitLong(5);
-                if ( size_t ( index ) >= history.size() ) {
-                    printf ( "ParseStringTableUpdate: Invalid index %d, expected < %u\n", index, ( unsigned ) history.size() );
-                    exit ( -1 );
-                }
-                int bytestocopy = buf.ReadUBitLong(SUBSTRING_BITS);
-                snprintf(entry, bytestocopy + 1, "%s", history[index].string);
-                buf.ReadString(substr, sizeof(substr));
-                snprintf(entry, sizeof(entry), "%s%s", entry, substr);
-            } else {
-                buf.ReadString(entry, sizeof(entry));
-            }
-
-            pEntry = entry;
-        }
-
-        // Read in the user data.
-        unsigned char tempbuf[MAX_USERDATA_SIZE];
-        memset(tempbuf, 0, sizeof(tempbuf));
-        const void *pUserData = NULL;
-        int nBytes = 0;
-
-        if (buf.ReadOneBit()) {
-            if (user_data_fixed_size) {
-                // Don't need to read length, it's fixed length and the length was networked down
-                // already.
-                nBytes = user_data_size;
-                assert(nBytes > 0);
-                tempbuf[nBytes - 1] = 0; // be safe, clear last byte
-                buf.ReadBits(tempbuf, user_data_size_bits);
-            } else {
-                nBytes = buf.ReadUBitLong(MAX_USERDATA_BITS);
-                if (size_t(nBytes) > sizeof(tempbuf)) {
-                    printf("ParseStringTableUpdate: user data too large (%d bytes).", nBytes);
-                    return;
-                }
-
-                buf.ReadBytes(tempbuf, nBytes);
-            }
-
-            pUserData = tempbuf;
-        }
-
-        if (pEntry == NULL) {
-            pEntry = ""; // avoid crash because of NULL strings
-        }
-
-        if (bIsUserInfo && pUserData != NULL) {
-            const player_info_t *pUnswappedPlayerInfo = (const player_info_t *)pUserData;
-            player_info_t playerInfo = *pUnswappedPlayerInfo;
-            playerInfo.entityID = entryIndex;
-
-            LowLevelByteSwap(&playerInfo.xuid, &pUnswappedPlayerInfo->xuid);
-            LowLevelByteSwap(&playerInfo.userID, &pUnswappedPlayerInfo->userID);
-            LowLevelByteSwap(&playerInfo.friendsID, &pUnswappedPlayerInfo->friendsID);
-
-            bool bAdded = false;
-            auto existing = FindPlayerByEntity(entryIndex);
-            if (!existing) {
-                bAdded = true;
-                s_PlayerInfos.push_back(playerInfo);
-            } else {
-                *existing = playerInfo;
-            }
-
-            addUserId(playerInfo);
-
-            if (g_bDumpStringTables) {
-                printf("player info\n{\n %s:true\n xuid:%" PRId64
-                       "\n name:%s\n userID:%d\n guid:%s\n friendsID:%d\n friendsName:%s\n "
-                       "fakeplayer:%d\n ishltv:%d\n filesDownloaded:%d\n}\n",
-                       bAdded ? "adding" : "updating", playerInfo.xuid, playerInfo.name,
-                       playerInfo.userID, playerInfo.guid, playerInfo.friendsID,
-                       playerInfo.friendsName, playerInfo.fakeplayer, playerInfo.ishltv,
-                       playerInfo.filesDownloaded);
-            }
-        } else {
-            if (g_bDumpStringTables) {
-                printf(" %d, %s, %d, %s \n", entryIndex, pEntry, nBytes,
-                       static_cast<const char *>(pUserData));
-            }
-        }
-
-        if (history.size() > 31) {
-            history.erase(history.begin());
-        }
+    if (g_bDumpStringTables) {
+        fprintf(OutputStream(kOutput_StringTables),
+                "player info\n{\n %s:true\n xuid:%" PRId64
+                "\n name:%s\n userID:%d\n guid:%s\n friendsID:%d\n friendsName:%s\n "
+                "fakeplayer:%d\n ishltv:%d\n filesDownloaded:%d\n}\n",
+                bAdded ? "adding" : "updating", playerInfo.xuid, playerInfo.name,
+                playerInfo.userID, playerInfo.guid, playerInfo.friendsID, playerInfo.friendsName,
+                playerInfo.fakeplayer, playerInfo.ishltv, playerInfo.filesDownloaded);
+    }
+}
 
-        StringHistoryEntry she;
-        snprintf(she.string, sizeof(she.string), "%s", pEntry);
-        history.push_back(she);
+static void DumpStringTableUpdate(CBitRead &buf,
+                                  int entries,
+                                  int nMaxEntries,
+                                  int user_data_size,
+                                  int user_data_size_bits,
+                                  int user_data_fixed_size,
+                                  bool bIsUserInfo) {
+    std::string error;
+    if (!ParseStringTableUpdate(buf, entries, nMaxEntries, user_data_size, user_data_size_bits,
+                                user_data_fixed_size,
+                                bIsUserInfo ? DumpUserInfoEntry : DumpStringTableEntry, NULL,
+                                error)) {
+        fprintf(OutputStream(kOutput_StringTables), "ParseStringTableUpdate: %s\n",
+                error.c_str());
     }
 }
 
@@ -969,14 +1042,16 @@ void PrintNetMessage<CSVCMsg_CreateStringTable, svc_CreateStringTable>(CDemoFile
     CSVCMsg_CreateStringTable msg;
 
     if (msg.ParseFromArray(parseBuffer, BufferSize)) {
+        MEM_SCOPE(kMem_StringTables);
         bool bIsUserInfo = !strcmp(msg.name().c_str(), "userinfo");
         if (g_bDumpStringTables) {
-            printf("CreateStringTable:%s:%d:%d:%d:%d:\n", msg.name().c_str(), msg.max_entries(),
-                   msg.num_entries(), msg.user_data_size(), msg.user_data_size_bits());
+            fprintf(OutputStream(kOutput_StringTables), "CreateStringTable:%s:%d:%d:%d:%d:\n",
+                    msg.name().c_str(), msg.max_entries(), msg.num_entries(),
+                    msg.user_data_size(), msg.user_data_size_bits());
         }
         CBitRead data(&msg.string_data()[0], msg.string_data().size());
-        ParseStringTableUpdate(data, msg.num_entries(), msg.max_entries(), msg.user_data_size(),
-                               msg.user_data_size_bits(), msg.user_data_fixed_size(), bIsUserInfo);
+        DumpStringTableUpdate(data, msg.num_entries(), msg.max_entries(), msg.user_data_size(),
+                              msg.user_data_size_bits(), msg.user_data_fixed_size(), bIsUserInfo);
 
         snprintf(s_StringTables[s_nNumStringTables].szName,
                  sizeof(s_StringTables[s_nNumStringTables].szName), "%s", msg.name().c_str());
@@ -995,40 +1070,44 @@ void PrintNetMessage<CSVCMsg_UpdateStringTable, svc_UpdateStringTable>(CDemoFile
     CSVCMsg_UpdateStringTable msg;
 
     if (msg.ParseFromArray(parseBuffer, BufferSize)) {
+        MEM_SCOPE(kMem_StringTables);
+        FILE *fp = OutputStream(kOutput_StringTables);
         CBitRead data(&msg.string_data()[0], msg.string_data().size());
 
         if (msg.table_id() < s_nNumStringTables && s_StringTables[msg.table_id()].nMaxEntries > msg.num_changed_entries()) {
             const StringTableData_t &table = s_StringTables[ msg.table_id() ];
             bool bIsUserInfo = !strcmp ( table.szName, "userinfo" );
             if ( g_bDumpStringTables ) {
-                printf ( "UpdateStringTable:%d(%s):%d:\n", msg.table_id(), table.szName, msg.num_changed_entries() );
+                fprintf(fp, "UpdateStringTable:%d(%s):%d:\n", msg.table_id(), table.szName, msg.num_changed_entries() );
             }
-            ParseStringTableUpdate ( data, msg.num_changed_entries(), table.nMaxEntries, table.nUserDataSize, table.nUserDataSizeBits, table.nUserDataFixedSize, bIsUserInfo );
+            DumpStringTableUpdate ( data, msg.num_changed_entries(), table.nMaxEntries, table.nUserDataSize, table.nUserDataSizeBits, table.nUserDataFixedSize, bIsUserInfo );
         } else {
-            printf("Bad UpdateStringTable:%d:%d!\n", msg.table_id(), msg.num_changed_entries());
+            fprintf(fp, "Bad UpdateStringTable:%d:%d!\n", msg.table_id(),
+                    msg.num_changed_entries());
         }
     }
 }
 
 void RecvTable_ReadInfos(const CSVCMsg_SendTable &msg) {
     if (g_bDumpDataTables) {
-        printf("%s:%d\n", msg.net_table_name().c_str(), msg.props_size());
+        FILE *fp = OutputStream(kOutput_DataTables);
+        fprintf(fp, "%s:%d\n", msg.net_table_name().c_str(), msg.props_size());
 
         for (int iProp = 0; iProp < msg.props_size(); iProp++) {
             const CSVCMsg_SendTable::sendprop_t &sendProp = msg.props(iProp);
 
             if ((sendProp.type() == DPT_DataTable) || (sendProp.flags() & SPROP_EXCLUDE)) {
-                printf("%d:%06X:%s:%s%s\n", sendProp.type(), sendProp.flags(),
-                       sendProp.var_name().c_str(), sendProp.dt_name().c_str(),
-                       (sendProp.flags() & SPROP_EXCLUDE) ? " exclude" : "");
+                fprintf(fp, "%d:%06X:%s:%s%s\n", sendProp.type(), sendProp.flags(),
+                        sendProp.var_name().c_str(), sendProp.dt_name().c_str(),
+                        (sendProp.flags() & SPROP_EXCLUDE) ? " exclude" : "");
             } else if (sendProp.type() == DPT_Array) {
-                printf("%d:%06X:%s[%d]\n", sendProp.type(), sendProp.flags(),
-                       sendProp.var_name().c_str(), sendProp.num_elements());
+                fprintf(fp, "%d:%06X:%s[%d]\n", sendProp.type(), sendProp.flags(),
+                        sendProp.var_name().c_str(), sendProp.num_elements());
             } else {
-                printf("%d:%06X:%s:%f,%f,%08X%s\n", sendProp.type(), sendProp.flags(),
-                       sendProp.var_name().c_str(), sendProp.low_value(), sendProp.high_value(),
-                       sendProp.num_bits(),
-                       (sendProp.flags() & SPROP_INSIDEARRAY) ? " inside array" : "");
+                fprintf(fp, "%d:%06X:%s:%f,%f,%08X%s\n", sendProp.type(), sendProp.flags(),
+                        sendProp.var_name().c_str(), sendProp.low_value(), sendProp.high_value(),
+                        sendProp.num_bits(),
+                        (sendProp.flags() & SPROP_INSIDEARRAY) ? " inside array" : "");
             }
         }
     }
@@ -1054,13 +1133,9 @@ CSVCMsg_SendTable *GetTableByClassID(uint32 nClassID) {
     return NULL;
 }
 
-CSVCMsg_SendTable *GetTableByName(const char *pName) {
-    for (unsigned int i = 0; i < s_DataTables.size(); i++) {
-        if (s_DataTables[i].net_table_name().compare(pName) == 0) {
-            return &(s_DataTables[i]);
-        }
-    }
-    return NULL;
+CSVCMsg_SendTable *GetTableByName(const std::string &name) {
+    std::unordered_map<std::string, int>::const_iterator i = s_DataTableIndices.find(name);
+    return i != s_DataTableIndices.end() ? &s_DataTables[i->second] : NULL;
 }
 
 FlattenedPropEntry *GetSendPropByIndex(uint32 uClass, uint32 uIndex) {
@@ -1071,26 +1146,25 @@ FlattenedPropEntry *GetSendPropByIndex(uint32 uClass, uint32 uIndex) {
 }
 
 bool IsPropExcluded(CSVCMsg_SendTable *pTable, const CSVCMsg_SendTable::sendprop_t &checkSendProp) {
-    for (unsigned int i = 0; i < s_currentExcludes.size(); i++) {
-        if (pTable->net_table_name().compare(s_currentExcludes[i].m_pDTName) == 0 &&
-            checkSendProp.var_name().compare(s_currentExcludes[i].m_pVarName) == 0) {
-            return true;
-        }
-    }
-    return false;
+    if (s_currentExcludes.empty())
+        return false;
+    std::unordered_map<const CSVCMsg_SendTable *, std::unordered_set<std::string>>::const_iterator
+        i = s_currentExcludes.find(pTable);
+    return i != s_currentExcludes.end() && i->second.count(checkSendProp.var_name());
 }
 
 void GatherExcludes(CSVCMsg_SendTable *pTable) {
     for (int iProp = 0; iProp < pTable->props_size(); iProp++) {
         const CSVCMsg_SendTable::sendprop_t &sendProp = pTable->props(iProp);
         if (sendProp.flags() & SPROP_EXCLUDE) {
-            s_currentExcludes.push_back(ExcludeEntry(sendProp.var_name().c_str(),
-                                                     sendProp.dt_name().c_str(),
-                                                     pTable->net_table_name().c_str()));
+            // dt_name is the table the excluded prop is in, which can't match if there is none
+            CSVCMsg_SendTable *pExcludedTable = GetTableByName(sendProp.dt_name());
+            if (pExcludedTable != NULL)
+                s_currentExcludes[pExcludedTable].insert(sendProp.var_name());
         }
 
         if (sendProp.type() == DPT_DataTable) {
-            CSVCMsg_SendTable *pSubTable = GetTableByName(sendProp.dt_name().c_str());
+            CSVCMsg_SendTable *pSubTable = GetTableByName(sendProp.dt_name());
             if (pSubTable != NULL) {
                 GatherExcludes(pSubTable);
             }
@@ -1112,7 +1186,7 @@ void GatherProps_IterateProps(CSVCMsg_SendTable *pTable,
         }
 
         if (sendProp.type() == DPT_DataTable) {
-            CSVCMsg_SendTable *pSubTable = GetTableByName(sendProp.dt_name().c_str());
+            CSVCMsg_SendTable *pSubTable = GetTableByName(sendProp.dt_name());
             if (pSubTable != NULL) {
                 if (sendProp.flags() & SPROP_COLLAPSIBLE) {
                     GatherProps_IterateProps(pSubTable, nServerClass, flattenedProps);
@@ -1142,6 +1216,7 @@ void GatherProps(CSVCMsg_SendTable *pTable, int nServerClass) {
 }
 
 void FlattenDataTable(int nServerClass) {
+    TRACE_SCOPE_ARG("FlattenDataTable", "class", nServerClass);
     CSVCMsg_SendTable *pTable = &s_DataTables[s_ServerClasses[nServerClass].nDataTable];
 
     s_currentExcludes.clear();
@@ -1172,45 +1247,84 @@ void FlattenDataTable(int nServerClass) {
 
     std::sort(priorities.begin(), priorities.end());
 
-    // sort flattenedProps by priority
+    // sort flattenedProps by priority: each priority in turn partitions the props left to the
+    // front, swapping them into place the way the game does, so the order isn't a stable one and
+    // the field indices depend on it
     uint32 start = 0;
     for (uint32 priority_index = 0; priority_index < priorities.size(); ++priority_index) {
         uint32 priority = priorities[priority_index];
 
-        while (true) {
-            uint32 currentProp = start;
-            while (currentProp < flattenedProps.size()) {
-                const CSVCMsg_SendTable::sendprop_t *prop = flattenedProps[currentProp].m_prop;
-
-                if (prop->priority() == priority ||
-                    (priority == 64 && (SPROP_CHANGES_OFTEN & prop->flags()))) {
-                    if (start != currentProp) {
-                        FlattenedPropEntry temp = flattenedProps[start];
-                        flattenedProps[start] = flattenedProps[currentProp];
-                        flattenedProps[currentProp] = temp;
-                    }
-                    start++;
-                    break;
+        for (uint32 currentProp = start; currentProp < flattenedProps.size(); currentProp++) {
+            const CSVCMsg_SendTable::sendprop_t *prop = flattenedProps[currentProp].m_prop;
+
+            if (prop->priority() == priority ||
+                (priority == 64 && (SPROP_CHANGES_OFTEN & prop->flags()))) {
+                if (start != currentProp) {
+                    std::swap(flattenedProps[start], flattenedProps[currentProp]);
                 }
-                currentProp++;
+                start++;
             }
-
-            if (currentProp == flattenedProps.size())
-                break;
         }
     }
+}
 
-    std::set<std::string> interesting({
-        "m_vecOrigin", "m_vecOrigin[2]", "m_bIsScoped", "m_vecVelocity[2]",
-    });
-    if (nServerClass == serverClassesIds[DT_CSPlayer]) {
-        for (size_t i = 0; i < flattenedProps.size(); ++i)
-            if (interesting.count(flattenedProps[i].m_prop->var_name()))
-                playerEntityProperties.insert(i);
+// field indices read for one entity update, end marker included
+#define FIELD_INDEX_MAX 20000
+
+// New way field indices are a +1 bit, then a 3 bit or a 7 bit (plus 2, 4 or 7 more) delta, 16
+// bits at most. Codes of up to FIELD_INDEX_TABLE_BITS are looked up by those bits.
+#define FIELD_INDEX_TABLE_BITS 11
+
+struct FieldIndexCode {
+    // delta past lastIndex + 1
+    unsigned char nValue;
+    // bits taken, 0 for codes longer than FIELD_INDEX_TABLE_BITS
+    unsigned char nLength;
+};
+
+static struct FieldIndexTable {
+    FieldIndexTable() {
+        for (uint32 nBits = 0; nBits < (1 << FIELD_INDEX_TABLE_BITS); nBits++) {
+            FieldIndexCode &code = codes[nBits];
+            uint32 ret = (nBits >> 2) & 127;
+            code.nValue = 0;
+            code.nLength = 0;
+            if (nBits & 1) {
+                code.nLength = 1;
+            } else if (nBits & 2) {
+                code.nValue = (nBits >> 2) & 7;
+                code.nLength = 5;
+            } else if ((ret & 96) == 0) {
+                code.nValue = ret;
+                code.nLength = 9;
+            } else if ((ret & 96) == 32) {
+                code.nValue = (ret & 31) | (((nBits >> 9) & 3) << 5);
+                code.nLength = 11;
+            }
+        }
     }
-}
+
+    FieldIndexCode codes[1 << FIELD_INDEX_TABLE_BITS];
+} s_fieldIndexTable;
 
 int ReadFieldIndex(CBitRead &entityBitBuffer, int lastIndex, bool bNewWay) {
+    if (bNewWay && entityBitBuffer.CanPeekUBitLong(16)) {
+        uint32 nBits = entityBitBuffer.PeekUBitLong(16);
+        const FieldIndexCode &code =
+            s_fieldIndexTable.codes[nBits & ((1 << FIELD_INDEX_TABLE_BITS) - 1)];
+        int ret = code.nValue;
+        int nLength = code.nLength;
+        if (!nLength) {
+            // 4 or 7 more bits for deltas from 128, the end marker among them; 32 is only set
+            // with 64 here
+            bool bLong = (nBits & (32 << 2)) != 0;
+            ret = ((nBits >> 2) & 31) | (((nBits >> 9) & (bLong ? 127 : 15)) << 5);
+            nLength = bLong ? 16 : 13;
+        }
+        entityBitBuffer.ReadUBitLong(nLength);
+        return ret == 0xFFF ? -1 : lastIndex + 1 + ret;
+    }
+
     if (bNewWay) {
         if (entityBitBuffer.ReadOneBit()) {
             return lastIndex + 1;
@@ -1259,54 +1373,65 @@ bool updateTeamScore(uint32 entity_id, int val) {
     return true;
 }
 
-void handleTeamProp(uint32 entity_id, const std::string &key, const Prop_t &value) {
-    if (key == "m_iTeamNum") {
-        if (value.m_value.m_int == 2 || value.m_value.m_int == 3)
-            id2teamno[entity_id] = value.m_value.m_int;
-        return;
-    }
+// -hsbox prop callbacks, see SetupServerClasses
+void onTeamNum(const EntityEntry *pEntity, const Prop_t *pOld, const Prop_t *pNew) {
+    if (pNew->m_value.m_int == 2 || pNew->m_value.m_int == 3)
+        id2teamno[pEntity->m_uSerialNum] = pNew->m_value.m_int;
+}
+
+void onTeamScore(const EntityEntry *pEntity, const Prop_t *pOld, const Prop_t *pNew) {
+    uint32 entity_id = pEntity->m_uSerialNum;
     if (!id2teamno.count(entity_id))
         return;
 
-    if (key != "m_scoreTotal")
-        return;
-    bool changed = updateTeamScore(entity_id, value.m_value.m_int);
+    bool changed = updateTeamScore(entity_id, pNew->m_value.m_int);
     if (changed) {
-        if (g_bOnlyHsBoxEvents)
-            events.push_back(json_spirit::wmObject(
-                {{L"type", L"score_changed"},
-                 {L"tick", s_nCurrentTick},
-                 {L"score", json_spirit::wmArray({teams[2].total_score, teams[3].total_score})}}));
+        events.push_back(json_spirit::wmObject(
+            {{L"type", L"score_changed"},
+             {L"tick", s_nCurrentTick},
+             {L"score", json_spirit::wmArray({teams[2].total_score, teams[3].total_score})}}));
+    }
+}
+
+void onGameRestart(const EntityEntry *pEntity, const Prop_t *pOld, const Prop_t *pNew) {
+    if (pNew->m_value.m_int)
+        addEvent({{L"type", L"game_restart"}, {L"tick", s_nCurrentTick}});
+}
+
+void onScoped(const EntityEntry *pEntity, const Prop_t *pOld, const Prop_t *pNew) {
+    player_info_t *playerInfo = FindPlayerByEntity(pEntity->m_nEntity - 1);
+    if (playerInfo) {
+        if (pNew->m_value.m_int)
+            scoped_since[playerInfo->xuid] = s_nCurrentTick;
+        else
+            scoped_since.erase(playerInfo->xuid);
     }
 }
 
 bool ReadNewEntity(CBitRead &entityBitBuffer, EntityEntry *pEntity) {
     bool bNewWay = (entityBitBuffer.ReadOneBit() == 1); // 0 = old way, 1 = new way
 
-    static std::vector<int> fieldIndices(5000);
-    fieldIndices.clear();
+    static int fieldIndices[FIELD_INDEX_MAX];
+    int nFieldIndices = 0;
 
-    int steps = 0;
     int index = -1;
-    do {
-        index = ReadFieldIndex(entityBitBuffer, index, bNewWay);
-        if (index != -1) {
-            fieldIndices.push_back(index);
-        }
+    while ((index = ReadFieldIndex(entityBitBuffer, index, bNewWay)) != -1) {
         // Sometimes this loop never ends: demo is probably corrupted
         // Hoping valid packets never get to 20000 indices
-        if (++steps > 20000) {
+        if (nFieldIndices == FIELD_INDEX_MAX - 1) {
             fprintf(stderr, "Corrupted demo\n");
             exit(1);
         }
-    } while (index != -1);
+        fieldIndices[nFieldIndices++] = index;
+    }
 
     CSVCMsg_SendTable *pTable = GetTableByClassID(pEntity->m_uClass);
     if (g_bDumpPacketEntities) {
-        printf("Table: %s\n", pTable->net_table_name().c_str());
+        fprintf(OutputStream(kOutput_PacketEntities), "Table: %s\n",
+                pTable->net_table_name().c_str());
     }
 
-    for (unsigned int i = 0; i < fieldIndices.size(); i++) {
+    for (int i = 0; i < nFieldIndices; i++) {
         FlattenedPropEntry *pSendProp = GetSendPropByIndex(pEntity->m_uClass, fieldIndices[i]);
         if (pSendProp) {
             // for -hsbox update only the entities and properties we need
@@ -1318,22 +1443,19 @@ bool ReadNewEntity(CBitRead &entityBitBuffer, EntityEntry *pEntity) {
                     (player && playerEntityProperties.count(fieldIndices[i]))) {
                     Prop_t *pProp = DecodeProp(entityBitBuffer, pSendProp, pEntity->m_uClass,
                                                fieldIndices[i], !g_bDumpPacketEntities);
-                    pEntity->AddOrUpdateProp(pSendProp, pProp);
-                    if (team) {
-                        handleTeamProp(pEntity->m_uSerialNum, pSendProp->m_prop->var_name(),
-                                       *pProp);
-                    } else if (gamerules && pSendProp->m_prop->var_name() == "m_bGameRestart" &&
-                               pProp->m_value.m_int) {
-                        addEvent({{L"type", L"game_restart"}, {L"tick", s_nCurrentTick}});
-                    } else if (player && pSendProp->m_prop->var_name() == "m_bIsScoped") {
-                        player_info_t *playerInfo = FindPlayerByEntity(pEntity->m_nEntity - 1);
-                        if (playerInfo) {
-                            if (pProp->m_value.m_int)
-                                scoped_since[playerInfo->xuid] = s_nCurrentTick;
-                            else
-                                scoped_since.erase(playerInfo->xuid);
-                        }
+                    if (s_PropWatch.IsWatched(pEntity->m_uClass, fieldIndices[i])) {
+                        Prop_t *pReplaced;
+                        PropEntry *pEntry = pEntity->AddOrUpdateProp(pSendProp, pProp, &pReplaced);
+                        s_PropWatch.Changed(pEntity, fieldIndices[i], pEntry, pReplaced);
+                        delete pReplaced;
+                    } else {
+                        pEntity->AddOrUpdateProp(pSendProp, pProp);
                     }
+                    if (g_pStateAtTicks)
+                        s_EntityHistory.PropChanged(s_nCurrentTick, pEntity->m_nEntity,
+                                                    fieldIndices[i], pProp);
+                    if (s_EntityLog.IsOpen())
+                        s_EntityLog.Prop(fieldIndices[i], pSendProp, pProp);
                 } else
                     DecodePropFake(entityBitBuffer, pSendProp, pEntity->m_uClass, fieldIndices[i],
                                    !g_bDumpPacketEntities);
@@ -1341,6 +1463,11 @@ bool ReadNewEntity(CBitRead &entityBitBuffer, EntityEntry *pEntity) {
                 Prop_t *pProp = DecodeProp(entityBitBuffer, pSendProp, pEntity->m_uClass,
                                            fieldIndices[i], !g_bDumpPacketEntities);
                 pEntity->AddOrUpdateProp(pSendProp, pProp);
+                if (g_pStateAtTicks)
+                    s_EntityHistory.PropChanged(s_nCurrentTick, pEntity->m_nEntity,
+                                                fieldIndices[i], pProp);
+                if (s_EntityLog.IsOpen())
+                    s_EntityLog.Prop(fieldIndices[i], pSendProp, pProp);
             }
         } else {
             return false;
@@ -1370,6 +1497,8 @@ EntityEntry *AddEntity(int nEntity, uint32 uClass, uint32 uSerialNum) {
         pEntity = new EntityEntry(nEntity, uClass, uSerialNum);
         s_Entities.push_back(pEntity);
     }
+    if (g_pStateAtTicks)
+        s_EntityHistory.EntityEnter(s_nCurrentTick, nEntity, uClass, uSerialNum);
 
     return pEntity;
 }
@@ -1379,12 +1508,29 @@ void RemoveEntity(int nEntity) {
         EntityEntry *pEntity = *i;
         if (pEntity->m_nEntity == nEntity) {
             s_Entities.erase(i);
+            s_PropWatch.Forget(pEntity);
             delete pEntity;
+            if (g_pStateAtTicks)
+                s_EntityHistory.EntityLeave(s_nCurrentTick, nEntity);
             break;
         }
     }
 }
 
+// "pWhat: id:%d, class:%d, serial:%d", the line before the props -packetentities shows.
+static void PrintEntityHeader(FILE *fp, const char *pWhat, int nEntity, int nClass, int nSerial) {
+    char line[128];
+    char *p = FormatText(line, pWhat);
+    p = FormatText(p, ": id:");
+    p = FormatInt(p, nEntity);
+    p = FormatText(p, ", class:");
+    p = FormatInt(p, nClass);
+    p = FormatText(p, ", serial:");
+    p = FormatInt(p, nSerial);
+    *p++ = '\n';
+    fwrite(line, 1, p - line, fp);
+}
+
 template <>
 void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &Demo,
                                                                  const void *parseBuffer,
@@ -1392,7 +1538,10 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
     CSVCMsg_PacketEntities msg;
 
     if (msg.ParseFromArray(parseBuffer, BufferSize)) {
+        TRACE_SCOPE_ARG("ReadNewEntity", "entities", msg.updated_entries());
+        MEM_SCOPE(kMem_Entities);
         CBitRead entityBitBuffer(&msg.entity_data()[0], msg.entity_data().size());
+        FILE *fp = OutputStream(kOutput_PacketEntities);
         bool bAsDelta = msg.is_delta();
         int nHeaderCount = msg.updated_entries();
         int nHeaderBase = -1;
@@ -1448,13 +1597,19 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
                     uint32 uSerialNum =
                         entityBitBuffer.ReadUBitLong(NUM_NETWORKED_EHANDLE_SERIAL_NUMBER_BITS);
                     if (g_bDumpPacketEntities) {
-                        printf("Entity Enters PVS: id:%d, class:%d, serial:%d\n", nNewEntity,
-                               uClass, uSerialNum);
+                        PrintEntityHeader(fp, "Entity Enters PVS", nNewEntity, uClass, uSerialNum);
                     }
                     EntityEntry *pEntity = AddEntity(nNewEntity, uClass, uSerialNum);
-                    if (!ReadNewEntity(entityBitBuffer, pEntity)) {
+                    if (s_EntityLog.IsOpen())
+                        s_EntityLog.BeginEnter(s_nCurrentTick, nNewEntity, uClass, uSerialNum);
+                    bool bRead = ReadNewEntity(entityBitBuffer, pEntity);
+                    // the props read so far, so the log stays readable
+                    if (s_EntityLog.IsOpen())
+                        s_EntityLog.EndEntity();
+                    if (!bRead) {
                         fprintf(stderr,
                                 "*****Error reading entity! Bailing on this PacketEntities!\n");
+                        s_PropWatch.Flush();
                         return;
                     }
                 } break;
@@ -1462,18 +1617,22 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
                 case LeavePVS: {
                     if (!bAsDelta) // Should never happen on a full update.
                     {
-                        printf("WARNING: LeavePVS on full update");
+                        fprintf(fp, "WARNING: LeavePVS on full update");
                         updateType = Failed; // break out
                         assert(0);
                     } else {
                         if (g_bDumpPacketEntities) {
                             if (UpdateFlags & FHDR_DELETE) {
-                                printf("Entity leaves PVS and is deleted: id:%d\n", nNewEntity);
+                                fprintf(fp, "Entity leaves PVS and is deleted: id:%d\n",
+                                        nNewEntity);
                             } else {
-                                printf("Entity leaves PVS: id:%d\n", nNewEntity);
+                                fprintf(fp, "Entity leaves PVS: id:%d\n", nNewEntity);
                             }
                         }
                         RemoveEntity(nNewEntity);
+                        if (s_EntityLog.IsOpen())
+                            s_EntityLog.Leave(s_nCurrentTick, nNewEntity,
+                                              (UpdateFlags & FHDR_DELETE) != 0);
                     }
                 } break;
 
@@ -1481,12 +1640,18 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
                     EntityEntry *pEntity = FindEntity(nNewEntity);
                     if (pEntity) {
                         if (g_bDumpPacketEntities) {
-                            printf("Entity Delta update: id:%d, class:%d, serial:%d\n",
-                                   pEntity->m_nEntity, pEntity->m_uClass, pEntity->m_uSerialNum);
+                            PrintEntityHeader(fp, "Entity Delta update", pEntity->m_nEntity,
+                                              pEntity->m_uClass, pEntity->m_uSerialNum);
                         }
-                        if (!ReadNewEntity(entityBitBuffer, pEntity)) {
+                        if (s_EntityLog.IsOpen())
+                            s_EntityLog.BeginDelta(s_nCurrentTick, pEntity->m_nEntity);
+                        bool bRead = ReadNewEntity(entityBitBuffer, pEntity);
+                        if (s_EntityLog.IsOpen())
+                            s_EntityLog.EndEntity();
+                        if (!bRead) {
                             fprintf(stderr,
                                     "*****Error reading entity! Bailing on this PacketEntities!\n");
+                            s_PropWatch.Flush();
                             return;
                         }
                     } else {
@@ -1497,16 +1662,16 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
                 case PreserveEnt: {
                     if (!bAsDelta) // Should never happen on a full update.
                     {
-                        printf("WARNING: PreserveEnt on full update");
+                        fprintf(fp, "WARNING: PreserveEnt on full update");
                         updateType = Failed; // break out
                         assert(0);
                     } else {
                         if (nNewEntity >= MAX_EDICTS) {
-                            printf("PreserveEnt: nNewEntity == MAX_EDICTS");
+                            fprintf(fp, "PreserveEnt: nNewEntity == MAX_EDICTS");
                             assert(0);
                         } else {
                             if (g_bDumpPacketEntities) {
-                                printf("PreserveEnt: id:%d\n", nNewEntity);
+                                fprintf(fp, "PreserveEnt: id:%d\n", nNewEntity);
                             }
                         }
                     }
@@ -1517,6 +1682,176 @@ void PrintNetMessage<CSVCMsg_PacketEntities, svc_PacketEntities>(CDemoFileDump &
                 }
             }
         }
+        s_PropWatch.Flush();
+    }
+}
+
+// -sample-hz: names of the selected props for every server class, empty for classes that have
+// none of them. Resolved once the data tables are flattened.
+static std::vector<std::vector<std::string>> s_sampleProps;
+static double s_flNextSampleTick = -1.0;
+
+void ResolveSampleProps() {
+    std::vector<std::string> requested;
+    std::string list = g_pSampleProps ? g_pSampleProps : "DT_CSPlayer.m_vecOrigin,"
+                                                         "DT_CSPlayer.m_vecOrigin[2]";
+    for (size_t pos = 0; pos <= list.size();) {
+        size_t end = std::min(list.find(',', pos), list.size());
+        if (end > pos)
+            requested.push_back(list.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    s_sampleProps.assign(s_ServerClasses.size(), std::vector<std::string>());
+    for (size_t i = 0; i < s_ServerClasses.size(); i++) {
+        const ServerClass_t &serverClass = s_ServerClasses[i];
+        for (const std::string &entry : requested) {
+            // either "prop" for every class that has it, or "DT_Table.prop"
+            std::string name = entry;
+            size_t dot = entry.find('.');
+            if (dot != std::string::npos && entry.compare(0, 3, "DT_") == 0) {
+                if (entry.compare(0, dot, serverClass.strDTName) != 0)
+                    continue;
+                name = entry.substr(dot + 1);
+            }
+            for (const FlattenedPropEntry &prop : serverClass.flattenedProps) {
+                if (prop.m_prop->var_name() == name) {
+                    s_sampleProps[i].push_back(name);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// "tick, entity, DT_Name", how the line of a sampled or -stateat entity starts.
+static void PrintEntityLineStart(FILE *fp,
+                                 int tick,
+                                 int nEntity,
+                                 const ServerClass_t &serverClass) {
+    char line[64 + sizeof(serverClass.strDTName)];
+    char *p = FormatInt(line, tick);
+    p = FormatText(p, ", ");
+    p = FormatInt(p, nEntity);
+    p = FormatText(p, ", ");
+    p = FormatText(p, serverClass.strDTName);
+    fwrite(line, 1, p - line, fp);
+}
+
+// ", name=value", the elements of an array separated by spaces.
+static void PrintSampleValue(FILE *fp, const std::string &name, const Prop_t &prop) {
+    fputs(", ", fp);
+    fwrite(name.data(), 1, name.size(), fp);
+    putc('=', fp);
+
+    char line[3 * TEXTFORMAT_FIXED_CHARS + 8];
+    int nElements = std::max(prop.m_nNumElements, 1);
+    for (int i = 0; i < nElements; i++) {
+        const Prop_t &value = (&prop)[i];
+        char *p = line;
+        if (i)
+            *p++ = ' ';
+        switch (value.m_type) {
+        case DPT_Int:
+            p = FormatInt(p, value.m_value.m_int);
+            break;
+        case DPT_Float:
+            p = FormatFixed(p, value.m_value.m_float);
+            break;
+        case DPT_Vector:
+            p = FormatFixed(p, value.m_value.m_vector.x);
+            *p++ = ' ';
+            p = FormatFixed(p, value.m_value.m_vector.y);
+            *p++ = ' ';
+            p = FormatFixed(p, value.m_value.m_vector.z);
+            break;
+        case DPT_VectorXY:
+            p = FormatFixed(p, value.m_value.m_vector.x);
+            *p++ = ' ';
+            p = FormatFixed(p, value.m_value.m_vector.y);
+            break;
+        case DPT_String:
+            fwrite(line, 1, p - line, fp);
+            fputs(value.m_value.m_pString, fp);
+            p = line;
+            break;
+        case DPT_Int64:
+            p = FormatInt64(p, value.m_value.m_int64);
+            break;
+        default:
+            break;
+        }
+        fwrite(line, 1, p - line, fp);
+    }
+}
+
+// Called once all packets of a tick have been read. Prints one line per live entity of the
+// selected classes when the tick is due for a sample.
+void SampleEntities(int tick) {
+    if (tick_rate <= 0 || s_sampleProps.empty())
+        return;
+    if (s_flNextSampleTick < 0)
+        s_flNextSampleTick = tick;
+    if (tick < s_flNextSampleTick)
+        return;
+    double interval = 1.0 / (g_flSampleHz * tick_rate);
+    while (s_flNextSampleTick <= tick)
+        s_flNextSampleTick += interval;
+
+    FILE *fp = OutputStream(kOutput_Samples);
+    for (EntityEntry *pEntity : s_Entities) {
+        const std::vector<std::string> &props = s_sampleProps[pEntity->m_uClass];
+        if (props.empty())
+            continue;
+        PrintEntityLineStart(fp, tick, pEntity->m_nEntity, s_ServerClasses[pEntity->m_uClass]);
+        for (const std::string &name : props) {
+            PropEntry *pProp = pEntity->FindProp(name.c_str());
+            if (pProp)
+                PrintSampleValue(fp, name, *pProp->m_pPropValue);
+        }
+        putc('\n', fp);
+    }
+}
+
+// -stateat: prints the state of every entity at each of the ticks, rebuilt from the history.
+// With -props, only the selected props of the classes that have them.
+void PrintEntityStates() {
+    TRACE_SCOPE("PrintEntityStates");
+    MEM_SCOPE(kMem_Output);
+    FILE *fp = OutputStream(kOutput_StateAt);
+    std::string list = g_pStateAtTicks;
+    for (size_t pos = 0; pos <= list.size();) {
+        size_t end = std::min(list.find(',', pos), list.size());
+        if (end > pos) {
+            int tick = atoi(list.substr(pos, end - pos).c_str());
+            HistoryState state;
+            s_EntityHistory.StateAt(tick, state);
+            for (const auto &kv : state) {
+                const HistoryEntity &entity = kv.second;
+                if (entity.uClass >= s_ServerClasses.size())
+                    continue;
+                const ServerClass_t &serverClass = s_ServerClasses[entity.uClass];
+                const std::vector<std::string> *pSelected = NULL;
+                if (g_pSampleProps) {
+                    pSelected = &s_sampleProps[entity.uClass];
+                    if (pSelected->empty())
+                        continue;
+                }
+                PrintEntityLineStart(fp, tick, kv.first, serverClass);
+                for (const auto &prop : entity.props) {
+                    if (prop.second.empty() || prop.first >= (int)serverClass.flattenedProps.size())
+                        continue;
+                    const std::string &name =
+                        serverClass.flattenedProps[prop.first].m_prop->var_name();
+                    if (pSelected &&
+                        std::find(pSelected->begin(), pSelected->end(), name) == pSelected->end())
+                        continue;
+                    PrintSampleValue(fp, name, prop.second[0]);
+                }
+                putc('\n', fp);
+            }
+        }
+        pos = end + 1;
     }
 }
 
@@ -1544,15 +1879,21 @@ void CDemoFileDump::DumpDemoPacket(CBitRead &buf, int length) {
 
         switch (Cmd) {
 #define HANDLE_NetMsg(_x)                                                                          \
-    case net_##_x:                                                                                 \
+    case net_##_x: {                                                                               \
+        TRACE_SCOPE("net_" #_x);                                                                   \
+        MEM_SCOPE(kMem_Protobuf);                                                                  \
+        MEM_MESSAGE_SCOPE(net_##_x, "net_" #_x);                                                   \
         PrintNetMessage<CNETMsg_##_x, net_##_x>(                                                   \
             *this, buf.GetBasePointer() + buf.GetNumBytesRead(), Size);                            \
-        break
+    } break
 #define HANDLE_SvcMsg(_x)                                                                          \
-    case svc_##_x:                                                                                 \
+    case svc_##_x: {                                                                               \
+        TRACE_SCOPE("svc_" #_x);                                                                   \
+        MEM_SCOPE(kMem_Protobuf);                                                                  \
+        MEM_MESSAGE_SCOPE(svc_##_x, "svc_" #_x);                                                   \
         PrintNetMessage<CSVCMsg_##_x, svc_##_x>(                                                   \
             *this, buf.GetBasePointer() + buf.GetNumBytesRead(), Size);                            \
-        break
+    } break
 
         default:
             // unknown net message
@@ -1639,25 +1980,31 @@ bool ReadFromBuffer(CBitRead &buffer, void **pBuffer, int &size) {
 }
 
 bool ParseDataTable(CBitRead &buf) {
-    CSVCMsg_SendTable msg;
+    TRACE_SCOPE("ParseDataTable");
+    FILE *fp = OutputStream(kOutput_DataTables);
     while (1) {
         buf.ReadVarInt32();
 
         void *pBuffer = NULL;
         int size = 0;
         if (!ReadFromBuffer(buf, &pBuffer, size)) {
-            printf("ParseDataTable: ReadFromBuffer failed.\n");
+            fprintf(fp, "ParseDataTable: ReadFromBuffer failed.\n");
             return false;
         }
+        // parsed in place rather than copied in
+        s_DataTables.push_back(CSVCMsg_SendTable());
+        CSVCMsg_SendTable &msg = s_DataTables.back();
         msg.ParseFromArray(pBuffer, size);
         free(pBuffer);
 
-        if (msg.is_end())
+        if (msg.is_end()) {
+            s_DataTables.pop_back();
             break;
+        }
 
         RecvTable_ReadInfos(msg);
 
-        s_DataTables.push_back(msg);
+        s_DataTableIndices.insert(std::make_pair(msg.net_table_name(), s_DataTables.size() - 1));
     }
 
     short nServerClasses = buf.ReadShort();
@@ -1666,7 +2013,7 @@ bool ParseDataTable(CBitRead &buf) {
         ServerClass_t entry;
         entry.nClassID = buf.ReadShort();
         if (entry.nClassID >= nServerClasses) {
-            printf("ParseDataTable: invalid class index (%d).\n", entry.nClassID);
+            fprintf(fp, "ParseDataTable: invalid class index (%d).\n", entry.nClassID);
             return false;
         }
 
@@ -1675,37 +2022,25 @@ bool ParseDataTable(CBitRead &buf) {
         buf.ReadString(entry.strDTName, sizeof(entry.strDTName), false, &nChars);
 
         // find the data table by name
-        entry.nDataTable = -1;
-        for (unsigned int j = 0; j < s_DataTables.size(); j++) {
-            if (strcmp(entry.strDTName, s_DataTables[j].net_table_name().c_str()) == 0) {
-                entry.nDataTable = j;
-                break;
-            }
-        }
+        std::unordered_map<std::string, int>::const_iterator table =
+            s_DataTableIndices.find(entry.strDTName);
+        entry.nDataTable = table != s_DataTableIndices.end() ? table->second : -1;
 
         if (g_bDumpDataTables) {
-            printf("class:%d:%s:%s(%d)\n", entry.nClassID, entry.strName, entry.strDTName,
-                   entry.nDataTable);
+            fprintf(fp, "class:%d:%s:%s(%d)\n", entry.nClassID, entry.strName, entry.strDTName,
+                    entry.nDataTable);
         }
         s_ServerClasses.push_back(entry);
-        if (g_bOnlyHsBoxEvents) {
-            if (!strcmp(entry.strDTName, "DT_CSPlayer"))
-                serverClassesIds[DT_CSPlayer] = entry.nClassID;
-            else if (!strcmp(entry.strDTName, "DT_CSTeam"))
-                serverClassesIds[DT_CSTeam] = entry.nClassID;
-            else if (!strcmp(entry.strDTName, "DT_CSGameRulesProxy"))
-                serverClassesIds[DT_CSGameRulesProxy] = entry.nClassID;
-        }
     }
 
     if (g_bDumpDataTables) {
-        printf("Flattening data tables...");
+        fprintf(fp, "Flattening data tables...");
     }
     for (int i = 0; i < nServerClasses; i++) {
         FlattenDataTable(i);
     }
     if (g_bDumpDataTables) {
-        printf("Done.\n");
+        fprintf(fp, "Done.\n");
     }
 
     // perform integer log2() to set s_nServerClassBits
@@ -1719,135 +2054,173 @@ bool ParseDataTable(CBitRead &buf) {
     return true;
 }
 
-bool DumpStringTable(CBitRead &buf, bool bIsUserInfo) {
-    int numstrings = buf.ReadWord();
+// What depends on the options rather than the tables, redone for every demo since -serve keeps
+// the flattened tables of the previous demo when they are the same.
+void SetupServerClasses() {
+    s_PropWatch.Clear();
+    if (g_bOnlyHsBoxEvents && !s_ServerClasses.empty()) {
+        for (const ServerClass_t &entry : s_ServerClasses) {
+            if (!strcmp(entry.strDTName, "DT_CSPlayer"))
+                serverClassesIds[DT_CSPlayer] = entry.nClassID;
+            else if (!strcmp(entry.strDTName, "DT_CSTeam"))
+                serverClassesIds[DT_CSTeam] = entry.nClassID;
+            else if (!strcmp(entry.strDTName, "DT_CSGameRulesProxy"))
+                serverClassesIds[DT_CSGameRulesProxy] = entry.nClassID;
+        }
+
+        s_PropWatch.Watch("DT_CSTeam", "m_iTeamNum", onTeamNum);
+        s_PropWatch.Watch("DT_CSTeam", "m_scoreTotal", onTeamScore);
+        s_PropWatch.Watch("DT_CSGameRulesProxy", "m_bGameRestart", onGameRestart);
+        s_PropWatch.Watch("DT_CSPlayer", "m_bIsScoped", onScoped);
+
+        std::set<std::string> interesting({
+            "m_vecOrigin", "m_vecOrigin[2]", "m_bIsScoped", "m_vecVelocity[2]",
+        });
+        if (g_bMatchStats)
+            interesting.insert("m_iTeamNum");
+        const std::vector<FlattenedPropEntry> &flattenedProps =
+            s_ServerClasses[serverClassesIds[DT_CSPlayer]].flattenedProps;
+        for (size_t i = 0; i < flattenedProps.size(); ++i)
+            if (interesting.count(flattenedProps[i].m_prop->var_name()))
+                playerEntityProperties.insert(i);
+    }
+    if (g_flSampleHz > 0 || (g_pStateAtTicks && g_pSampleProps)) {
+        ResolveSampleProps();
+    }
+    if (s_EntityLog.IsOpen()) {
+        s_EntityLog.Schema(s_ServerClasses);
+    }
+    s_PropWatch.Resolve(s_ServerClasses);
+}
+
+// dem_stringtables callbacks, pContext is whether the current table is userinfo
+static void DumpSnapshotTable(void *pContext, const char *pName, int nEntries) {
+    FILE *fp = OutputStream(kOutput_StringTables);
+    bool &bIsUserInfo = *(bool *)pContext;
+    bIsUserInfo = !strcmp(pName, "userinfo");
     if (g_bDumpStringTables) {
-        printf("%d\n", numstrings);
+        fprintf(fp, "ReadStringTable:%s:%d\n", pName, nEntries);
     }
 
     if (bIsUserInfo) {
         if (g_bDumpStringTables) {
-            printf("Clearing player info array.\n");
+            fprintf(fp, "Clearing player info array.\n");
         }
-        s_PlayerInfos.clear();
+        s_Players.ClearSlots();
     }
+}
 
-    for (int i = 0; i < numstrings; i++) {
-        char stringname[4096];
-
-        buf.ReadString(stringname, sizeof(stringname));
-
-        assert(strlen(stringname) < 100);
-
-        if (buf.ReadOneBit() == 1) {
-            int userDataSize = (int)buf.ReadWord();
-            assert(userDataSize > 0);
-            unsigned char *data = new unsigned char[userDataSize + 4];
-            assert(data);
-
-            buf.ReadBytes(data, userDataSize);
-
-            if (bIsUserInfo && data != NULL) {
-                const player_info_t *pUnswappedPlayerInfo = (const player_info_t *)data;
-                player_info_t playerInfo = *pUnswappedPlayerInfo;
-                playerInfo.entityID = i;
-
-                LowLevelByteSwap(&playerInfo.xuid, &pUnswappedPlayerInfo->xuid);
-                LowLevelByteSwap(&playerInfo.userID, &pUnswappedPlayerInfo->userID);
-                LowLevelByteSwap(&playerInfo.friendsID, &pUnswappedPlayerInfo->friendsID);
-
-                // shouldn't ever exist, but just incase
-                auto existing = FindPlayerByEntity(i);
-                if (!existing) {
-                    if (g_bDumpStringTables) {
-                        printf("adding:player entity:%d info:\n xuid:%" PRIu64 "\n name:%s\n userID:%d\n "
-                               "guid:%s\n friendsID:%d\n friendsName:%s\n fakeplayer:%d\n "
-                               "ishltv:%d\n filesDownloaded:%d\n",
-                               i, playerInfo.xuid, playerInfo.name, playerInfo.userID,
-                               playerInfo.guid, playerInfo.friendsID, playerInfo.friendsName,
-                               playerInfo.fakeplayer, playerInfo.ishltv,
-                               playerInfo.filesDownloaded);
-                    }
-                    s_PlayerInfos.push_back(playerInfo);
-                } else {
-                    *existing = playerInfo;
-                }
-
-                addUserId(playerInfo);
-            } else {
-                if (g_bDumpStringTables) {
-                    printf(" %d, %s, userdata[%d] \n", i, stringname, userDataSize);
-                }
-            }
+static void DumpSnapshotEntry(void *pContext, const StringTableEntry &entry) {
+    FILE *fp = OutputStream(kOutput_StringTables);
+    bool bIsUserInfo = *(bool *)pContext;
 
-            delete[] data;
+    if (bIsUserInfo && !entry.bClientSide && entry.pUserData) {
+        player_info_t playerInfo;
+        PlayerInfoFromEntry(entry, playerInfo);
 
-            assert(buf.GetNumBytesLeft() > 10);
-        } else {
+        // shouldn't ever exist, but just incase
+        if (!FindPlayerByEntity(entry.nIndex)) {
             if (g_bDumpStringTables) {
-                printf(" %d, %s \n", i, stringname);
+                fprintf(fp, "adding:player entity:%d info:\n xuid:%" PRIu64 "\n name:%s\n userID:%d\n "
+                        "guid:%s\n friendsID:%d\n friendsName:%s\n fakeplayer:%d\n "
+                        "ishltv:%d\n filesDownloaded:%d\n",
+                        entry.nIndex, playerInfo.xuid, playerInfo.name, playerInfo.userID,
+                        playerInfo.guid, playerInfo.friendsID, playerInfo.friendsName,
+                        playerInfo.fakeplayer, playerInfo.ishltv,
+                        playerInfo.filesDownloaded);
             }
         }
-    }
-
-    // Client side stuff
-    if (buf.ReadOneBit() == 1) {
-        int numstrings = buf.ReadWord();
-        for (int i = 0; i < numstrings; i++) {
-            char stringname[4096];
-
-            buf.ReadString(stringname, sizeof(stringname));
-
-            if (buf.ReadOneBit() == 1) {
-                int userDataSize = (int)buf.ReadWord();
-                assert(userDataSize > 0);
-                unsigned char *data = new unsigned char[userDataSize + 4];
-                assert(data);
-
-                buf.ReadBytes(data, userDataSize);
-
-                if (i >= 2) {
-                    if (g_bDumpStringTables) {
-                        printf(" %d, %s, userdata[%d] \n", i, stringname, userDataSize);
-                    }
-                }
-
-                delete[] data;
 
-            } else {
-                if (i >= 2) {
-                    if (g_bDumpStringTables) {
-                        printf(" %d, %s \n", i, stringname);
-                    }
-                }
-            }
-        }
+        addPlayer(playerInfo);
+        return;
     }
 
-    return true;
+    // the first two client side entries aren't shown
+    if (!g_bDumpStringTables || (entry.bClientSide && entry.nIndex < 2))
+        return;
+    if (entry.pUserData) {
+        fprintf(fp, " %d, %s, userdata[%d] \n", entry.nIndex, entry.pString,
+                entry.nUserDataBytes);
+    } else {
+        fprintf(fp, " %d, %s \n", entry.nIndex, entry.pString);
+    }
 }
 
 bool DumpStringTables(CBitRead &buf) {
-    int numTables = buf.ReadByte();
-    for (int i = 0; i < numTables; i++) {
-        char tablename[256];
-        buf.ReadString(tablename, sizeof(tablename));
-
-        if (g_bDumpStringTables) {
-            printf("ReadStringTable:%s:", tablename);
-        }
+    TRACE_SCOPE("DumpStringTables");
+    bool bIsUserInfo = false;
+    ParseStringTableSnapshot(buf, DumpSnapshotTable, DumpSnapshotEntry, &bIsUserInfo);
+    return true;
+}
 
-        bool bIsUserInfo = !strcmp(tablename, "userinfo");
-        if (!DumpStringTable(buf, bIsUserInfo)) {
-            printf("Error reading string table %s\n", tablename);
-        }
-    }
+// frame span names, by demo command
+static const char *const s_DemoCmdNames[dem_lastcmd + 1] = {
+    "dem_unknown", "dem_signon",     "dem_packet", "dem_synctick",   "dem_consolecmd",
+    "dem_usercmd", "dem_datatables", "dem_stop",   "dem_customdata", "dem_stringtables",
+};
 
-    return true;
+void CDemoFileDump::Reset() {
+    m_GameEventList.Clear();
+    m_nFrameNumber = 0;
+
+    // everything but the tables, see dem_datatables
+    s_nNumStringTables = 0;
+    for (EntityEntry *pEntity : s_Entities)
+        delete pEntity;
+    s_Entities.clear();
+    s_Players.Clear();
+    playerEntityProperties.clear();
+    memset(serverClassesIds, 0, sizeof(serverClassesIds));
+    s_bMatchStartOccured = false;
+    s_nCurrentTick = 0;
+    s_EntityHistory.Clear();
+    // after everything holding interned strings
+    g_StringInterner.Clear();
+    s_wideStrings.clear();
+    s_bWideStrings.clear();
+    s_MatchStats.Clear();
+    s_roundStats.clear();
+    player_names.clear();
+    events.clear();
+    match.clear();
+    mm_rank_update.clear();
+    score_snapshot = std::pair<int, int>();
+    id2teamno.clear();
+    memset(teams, 0, sizeof(teams));
+    tick_rate = -1;
+    jumped_last.clear();
+    scoped_since.clear();
+    bot_takeover.clear();
+    smokes.clear();
+    s_sampleProps.clear();
+    s_flNextSampleTick = -1.0;
 }
 
 void CDemoFileDump::DoDump() {
     s_bMatchStartOccured = false;
+    if (g_pWhere) {
+        std::string error;
+        if (!s_EventFilter.Parse(g_pWhere, error))
+            fatal_errorf("-where: %s", error.c_str());
+    }
+    if (g_pStateAtTicks) {
+        s_EntityHistory.Clear();
+        s_EntityHistory.SetKeyframeInterval(g_nKeyframeInterval);
+    }
+    if (g_pEntityLog && !s_EntityLog.Open(g_pEntityLog)) {
+        fatal_errorf("-entitylog: couldn't open '%s'", g_pEntityLog);
+    }
+    for (int i = 0; i < kOutput_Count; i++) {
+        std::string error;
+        if (g_pOutputPaths[i] && !OutputStreamOpen((OutputKind)i, g_pOutputPaths[i], error))
+            fatal_errorf("-out: %s", error.c_str());
+    }
+    // the file is read on a thread of its own, and compressed -o output written on another
+    if (g_pOutputFile) {
+        std::string error;
+        if (!OutputWriterStartFile(g_pOutputFile, error))
+            fatal_errorf("-o: %s", error.c_str());
+    }
 
     bool demofinished = false;
     while (!demofinished) {
@@ -1855,7 +2228,12 @@ void CDemoFileDump::DoDump() {
         unsigned char cmd;
         unsigned char playerSlot;
         m_demofile.ReadCmdHeader(cmd, tick, playerSlot);
+        if (g_flSampleHz > 0 && (tick != s_nCurrentTick || cmd == dem_stop)) {
+            SampleEntities(s_nCurrentTick);
+        }
         s_nCurrentTick = tick;
+        TRACE_SCOPE_ARG(cmd <= dem_lastcmd ? s_DemoCmdNames[cmd] : "dem_unknown", "tick", tick);
+        MemStatsPoll();
         // COMMAND HANDLERS
         switch (cmd) {
         case dem_synctick:
@@ -1870,23 +2248,39 @@ void CDemoFileDump::DoDump() {
         } break;
 
         case dem_datatables: {
+            MEM_SCOPE(kMem_Schema);
             char *data = (char *)malloc(DEMO_RECORD_BUFFER_SIZE);
             CBitRead buf(data, DEMO_RECORD_BUFFER_SIZE);
-            m_demofile.ReadRawData((char *)buf.GetBasePointer(), buf.GetNumBytesLeft());
+            int length =
+                m_demofile.ReadRawData((char *)buf.GetBasePointer(), buf.GetNumBytesLeft());
             buf.Seek(0);
-            if (!ParseDataTable(buf)) {
-                printf("Error parsing data tables. \n");
+            // demos from the same game build have the same tables, so -serve only flattens them
+            // again when they change
+            bool bCached = !g_bDumpDataTables && !s_ServerClasses.empty() &&
+                           s_dataTablesRaw.size() == (size_t)length &&
+                           memcmp(s_dataTablesRaw.data(), data, length) == 0;
+            if (!bCached) {
+                s_DataTables.clear();
+                s_DataTableIndices.clear();
+                s_ServerClasses.clear();
+                s_dataTablesRaw.clear();
+                if (ParseDataTable(buf))
+                    s_dataTablesRaw.assign(data, length);
+                else
+                    fprintf(OutputStream(kOutput_DataTables), "Error parsing data tables. \n");
             }
+            SetupServerClasses();
             free(data);
         } break;
 
         case dem_stringtables: {
+            MEM_SCOPE(kMem_StringTables);
             char *data = (char *)malloc(DEMO_RECORD_BUFFER_SIZE);
             CBitRead buf(data, DEMO_RECORD_BUFFER_SIZE);
             m_demofile.ReadRawData((char *)buf.GetBasePointer(), buf.GetNumBytesLeft());
             buf.Seek(0);
             if (!DumpStringTables(buf)) {
-                printf("Error parsing string tables. \n");
+                fprintf(OutputStream(kOutput_StringTables), "Error parsing string tables. \n");
             }
             free(data);
         } break;
@@ -1905,20 +2299,31 @@ void CDemoFileDump::DoDump() {
             break;
         }
     }
+    if (g_pStateAtTicks) {
+        PrintEntityStates();
+    }
+    s_EntityLog.Close();
+    if (g_bMatchStats) {
+        if (s_MatchStats.Finish(s_nCurrentTick))
+            PrintRoundStats(s_MatchStats.LastRound(), false);
+        PrintRoundStats(s_MatchStats.Match(), true);
+    }
     if (g_bDumpJson) {
         match[L"events"] = events;
+        if (g_bMatchStats)
+            match[L"round_stats"] = s_roundStats;
         match[L"servername"] = toWide(m_demofile.m_DemoHeader.servername);
         match[L"player_names"] = player_names;
         json_spirit::wmArray gotv_bots;
-        for (const auto &kv : userid_info)
-            if (kv.second.ishltv)
-                gotv_bots.push_back(toWide(kv.second.name));
+        for (const player_info_t *pInfo : s_Players.SeenUserIds())
+            if (pInfo->ishltv)
+                gotv_bots.push_back(toWide(pInfo->name));
         match[L"gotv_bots"] = gotv_bots;
         if (!mm_rank_update.empty())
             match[L"mm_rank_update"] = mm_rank_update;
 
         json_spirit::wmObject uids;
-        for (const auto &kv : player_slot)
+        for (const auto &kv : s_Players.XuidSlots())
             uids[std::to_wstring(kv.first)] = kv.second;
         match[L"player_slots"] = uids;
 
@@ -1928,6 +2333,20 @@ void CDemoFileDump::DoDump() {
 #if defined(_WIN32) || defined(_WIN64)
         _setmode(_fileno(stdout), _O_U8TEXT);
 #endif
-        json_spirit::write(match, std::wcout, options);
+        TRACE_SCOPE("WriteJson");
+        MEM_SCOPE(kMem_Output);
+        FILE *pJson = OutputStream(kOutput_Json);
+        if (pJson == stdout) {
+            json_spirit::write(match, std::wcout, options);
+            std::wcout.flush();
+        } else {
+            COutputWideBuf buffer(pJson);
+            std::wostream out(&buffer);
+            json_spirit::write(match, out, options);
+        }
     }
+    OutputStreamsClose();
+    TRACE_SCOPE("FlushOutput");
+    fflush(stdout);
+    OutputWriterStop();
 }
@@ -91,20 +91,6 @@ struct player_info_t
 	int			entityID;
 };
 
-struct ExcludeEntry
-{
-	ExcludeEntry( const char *pVarName, const char *pDTName, const char *pDTExcluding )
-		: m_pVarName( pVarName )
-		, m_pDTName( pDTName )
-		, m_pDTExcluding( pDTExcluding )
-	{
-	}
-
-	const char *m_pVarName;
-	const char *m_pDTName;
-	const char *m_pDTExcluding;
-};
-
 struct FlattenedPropEntry
 {
 	FlattenedPropEntry( const CSVCMsg_SendTable::sendprop_t *prop, const CSVCMsg_SendTable::sendprop_t *arrayElementProp )
@@ -148,6 +134,7 @@ struct EntityEntry
 		: m_nEntity( nEntity )
 		, m_uClass( uClass )
 		, m_uSerialNum( uSerialNum )
+		, m_nWatchSlot( -1 )
 	{
 	}
 	~EntityEntry()
@@ -169,16 +156,25 @@ struct EntityEntry
 		}
 		return NULL;
 	}
-	void AddOrUpdateProp( FlattenedPropEntry *pFlattenedProp, Prop_t *pPropValue )
+	// The prop's entry. With ppReplaced the value it had is handed back instead of deleted, NULL
+	// for a new prop.
+	PropEntry *AddOrUpdateProp( FlattenedPropEntry *pFlattenedProp, Prop_t *pPropValue, Prop_t **ppReplaced = NULL )
 	{
 		//if ( m_uClass == 34 && pFlattenedProp->m_prop->var_name().compare( "m_vecOrigin" ) == 0 )
 		//{
 		//	printf("got vec origin!\n" );
 		//}
 		PropEntry *pProp = FindProp( pFlattenedProp->m_prop->var_name().c_str() );
+		if ( ppReplaced )
+		{
+			*ppReplaced = pProp ? pProp->m_pPropValue : NULL;
+		}
 		if ( pProp )
 		{
-			delete pProp->m_pPropValue;
+			if ( !ppReplaced )
+			{
+				delete pProp->m_pPropValue;
+			}
 			pProp->m_pPropValue = pPropValue;
 		}
 		else
@@ -186,10 +182,13 @@ struct EntityEntry
 			pProp = new PropEntry( pFlattenedProp, pPropValue );
 			m_props.push_back( pProp );
 		}
+		return pProp;
 	}
 	int m_nEntity;
 	uint32 m_uClass;
 	uint32 m_uSerialNum;
+	// CPropWatch's slot for the entity's changes of the current message
+	int m_nWatchSlot;
 
 	std::vector< PropEntry * > m_props;
 };
@@ -225,7 +224,11 @@ public:
 	}
 
 	bool Open( const char *filename );
+	// Forgets the previous demo, so the next DoDump() can parse another one.
+	void Reset();
 	void DoDump();
+	// Closes the demo, once its reader thread is done.
+	void Close();
 	void HandleDemoPacket();
 
 public:
@@ -22,8 +22,12 @@
 // THE POSSIBILITY OF SUCH DAMAGE.
 //===========================================================================//
 
+#include <algorithm>
 #include "demofiledump.h"
 #include "demofilepropdecode.h"
+#include "outputstreams.h"
+#include "stringinterner.h"
+#include "textformat.h"
 
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/reflection_ops.h"
@@ -32,6 +36,16 @@
 #include "cstrike15_usermessages.pb.h"
 #include "netmessages.pb.h"
 
+// SSE2 is part of x86-64, and its scalar float math is SSE too, so the batched results match the
+// one at a time ones bit for bit
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PROPDECODE_X86_SIMD
+#include <emmintrin.h>
+#endif
+
+// quantized values dequantized at a time in Array_Decode
+#define DEQUANTIZE_BATCH 64
+
 // in demofiledump.cpp
 extern const CSVCMsg_SendTable::sendprop_t *GetSendPropByIndex(uint32 uClass, uint32 uIndex);
 
@@ -92,24 +106,77 @@ static inline bool DecodeSpecialFloat(CBitRead &entityBitBuffer,
     return false;
 }
 
+#define SPROP_SPECIAL_FLOAT                                                                       \
+    (SPROP_COORD | SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION | SPROP_COORD_MP_INTEGRAL |       \
+     SPROP_NOSCALE | SPROP_NORMAL | SPROP_CELL_COORD | SPROP_CELL_COORD_LOWPRECISION |             \
+     SPROP_CELL_COORD_INTEGRAL)
+
+// Scale of a quantized float prop: raw / steps is lerped from low to high.
+struct FloatQuantization {
+    explicit FloatQuantization(const CSVCMsg_SendTable::sendprop_t *pSendProp)
+        : flLow(pSendProp->low_value()),
+          flRange(pSendProp->high_value() - pSendProp->low_value()),
+          flSteps((float)((1 << pSendProp->num_bits()) - 1)) {}
+
+    float flLow;
+    float flRange;
+    float flSteps;
+};
+
+static inline float Dequantize(uint32 nRaw, const FloatQuantization &quant) {
+    return quant.flLow + quant.flRange * ((float)nRaw / quant.flSteps);
+}
+
+// Dequantize() of nCount raw values, four at a time where the CPU can. The SIMD conversion is a
+// signed one, so it is only used while the raw values stay under 2^31.
+static void DequantizeFloats(const uint32 *pRaw, float *pOut, int nCount,
+                             const FloatQuantization &quant) {
+    int i = 0;
+#ifdef PROPDECODE_X86_SIMD
+    const __m128 low = _mm_set1_ps(quant.flLow);
+    const __m128 range = _mm_set1_ps(quant.flRange);
+    const __m128 steps = _mm_set1_ps(quant.flSteps);
+    for (; quant.flSteps < 2147483648.0f && i + 4 <= nCount; i += 4) {
+        __m128 f = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(pRaw + i)));
+        f = _mm_add_ps(low, _mm_mul_ps(range, _mm_div_ps(f, steps)));
+        _mm_storeu_ps(pOut + i, f);
+    }
+#endif
+    for (; i < nCount; i++)
+        pOut[i] = Dequantize(pRaw[i], quant);
+}
+
 float Float_Decode(CBitRead &entityBitBuffer, const CSVCMsg_SendTable::sendprop_t *pSendProp) {
     float fVal = 0.0f;
-    unsigned long dwInterp;
 
     // Check for special flags..
     if (DecodeSpecialFloat(entityBitBuffer, pSendProp, fVal)) {
         return fVal;
     }
 
-    dwInterp = entityBitBuffer.ReadUBitLong(pSendProp->num_bits());
-    fVal = (float)dwInterp / ((1 << pSendProp->num_bits()) - 1);
-    fVal = pSendProp->low_value() + (pSendProp->high_value() - pSendProp->low_value()) * fVal;
-    return fVal;
+    return Dequantize(entityBitBuffer.ReadUBitLong(pSendProp->num_bits()),
+                      FloatQuantization(pSendProp));
 }
 
 void Vector_Decode(CBitRead &entityBitBuffer,
                    const CSVCMsg_SendTable::sendprop_t *pSendProp,
                    Vector &v) {
+    // plain quantized components are read first and dequantized together
+    if ((pSendProp->flags() & SPROP_SPECIAL_FLOAT) == 0) {
+        uint32 raw[4];
+        float out[4];
+        int nBits = pSendProp->num_bits();
+        raw[0] = entityBitBuffer.ReadUBitLong(nBits);
+        raw[1] = entityBitBuffer.ReadUBitLong(nBits);
+        raw[2] = entityBitBuffer.ReadUBitLong(nBits);
+        raw[3] = 0;
+        DequantizeFloats(raw, out, 4, FloatQuantization(pSendProp));
+        v.x = out[0];
+        v.y = out[1];
+        v.z = out[2];
+        return;
+    }
+
     v.x = Float_Decode(entityBitBuffer, pSendProp);
     v.y = Float_Decode(entityBitBuffer, pSendProp);
 
@@ -144,17 +211,18 @@ const char *String_Decode(CBitRead &entityBitBuffer,
     // Read it in.
     int len = entityBitBuffer.ReadUBitLong(DT_MAX_STRING_BITS);
 
-    char *tempStr = new char[len + 1];
+    char tempStr[DT_MAX_STRING_BUFFERSIZE];
 
     if (len >= DT_MAX_STRING_BUFFERSIZE) {
-        printf("String_Decode( %s ) invalid length (%d)\n", pSendProp->var_name().c_str(), len);
+        fprintf(OutputStream(kOutput_PacketEntities), "String_Decode( %s ) invalid length (%d)\n",
+                pSendProp->var_name().c_str(), len);
         len = DT_MAX_STRING_BUFFERSIZE - 1;
     }
 
     entityBitBuffer.ReadBits(tempStr, len * 8);
-    tempStr[len] = 0;
 
-    return tempStr;
+    // the same few place and clan names over and over, stored once
+    return g_StringInterner.Intern(tempStr, len);
 }
 
 int64 Int64_Decode(CBitRead &entityBitBuffer, const CSVCMsg_SendTable::sendprop_t *pSendProp) {
@@ -191,6 +259,59 @@ int64 Int64_Decode(CBitRead &entityBitBuffer, const CSVCMsg_SendTable::sendprop_
     }
 }
 
+// Arrays of quantized floats, vectors and vectorxys: reads the raw components of up to
+// DEQUANTIZE_BATCH of them and dequantizes those in one go. False, with nothing read, for any
+// other element type.
+static bool DequantizeArray(CBitRead &entityBitBuffer,
+                            const CSVCMsg_SendTable::sendprop_t *pElementProp,
+                            Prop_t *pResult,
+                            int nElements) {
+    int nComponents;
+    switch (pElementProp->type()) {
+    case DPT_Float:
+        nComponents = 1;
+        break;
+    case DPT_Vector:
+        nComponents = 3;
+        break;
+    case DPT_VectorXY:
+        nComponents = 2;
+        break;
+    default:
+        return false;
+    }
+    if (pElementProp->flags() & SPROP_SPECIAL_FLOAT)
+        return false;
+
+    FloatQuantization quant(pElementProp);
+    int nBits = pElementProp->num_bits();
+    uint32 raw[DEQUANTIZE_BATCH * 3];
+    float out[DEQUANTIZE_BATCH * 3];
+    for (int nFirst = 0; nFirst < nElements; nFirst += DEQUANTIZE_BATCH) {
+        int nBatch = std::min(nElements - nFirst, DEQUANTIZE_BATCH);
+        int nValues = nBatch * nComponents;
+        for (int i = 0; i < nValues; i++)
+            raw[i] = entityBitBuffer.ReadUBitLong(nBits);
+        DequantizeFloats(raw, out, nValues, quant);
+
+        const float *pValue = out;
+        for (int i = nFirst; i < nFirst + nBatch; i++, pValue += nComponents) {
+            Prop_t &element = pResult[i];
+            element = Prop_t((SendPropType_t)pElementProp->type());
+            if (nComponents == 1) {
+                element.m_value.m_float = pValue[0];
+            } else {
+                element.m_value.m_vector.x = pValue[0];
+                element.m_value.m_vector.y = pValue[1];
+                if (nComponents == 3)
+                    element.m_value.m_vector.z = pValue[2];
+            }
+            element.m_nNumElements = nElements - i;
+        }
+    }
+    return true;
+}
+
 Prop_t *Array_Decode(CBitRead &entityBitBuffer,
                      FlattenedPropEntry *pFlattenedProp,
                      int nNumElements,
@@ -206,10 +327,18 @@ Prop_t *Array_Decode(CBitRead &entityBitBuffer,
     int nElements = entityBitBuffer.ReadUBitLong(numBits);
 
     Prop_t *pResult = NULL;
-    pResult = new Prop_t[nElements];
+    pResult = new Prop_t[nElements > 0 ? nElements : 1];
+    if (nElements == 0) {
+        // keep the result readable, the placeholder prints as nothing
+        pResult[0] = Prop_t(DPT_Array);
+    }
 
     if (!bQuiet) {
-        printf("array with %d elements of %d max\n", nElements, nNumElements);
+        fprintf(OutputStream(kOutput_PacketEntities), "array with %d elements of %d max\n",
+                nElements, nNumElements);
+    } else if (DequantizeArray(entityBitBuffer, pFlattenedProp->m_arrayElementProp, pResult,
+                               nElements)) {
+        return pResult;
     }
 
     for (int i = 0; i < nElements; i++) {
@@ -223,6 +352,80 @@ Prop_t *Array_Decode(CBitRead &entityBitBuffer,
     return pResult;
 }
 
+void Prop_t::Print(FILE *fp, int nMaxElements) {
+    // the longest line is a vector's, its element prefix and three floats
+    char line[3 * TEXTFORMAT_FIXED_CHARS + 64];
+    for (Prop_t *pProp = this;; pProp++) {
+        char *p = line;
+        if (pProp->m_nNumElements > 0) {
+            p = FormatText(p, " Element: ");
+            p = FormatInt(p, (nMaxElements ? nMaxElements : pProp->m_nNumElements) -
+                                 pProp->m_nNumElements);
+            p = FormatText(p, "  ");
+        }
+
+        const auto &value = pProp->m_value;
+        switch (pProp->m_type) {
+        case DPT_Int:
+            p = FormatInt(p, value.m_int);
+            *p++ = '\n';
+            break;
+        case DPT_Float:
+            p = FormatFixed(p, value.m_float);
+            *p++ = '\n';
+            break;
+        case DPT_Vector:
+            p = FormatFixed(p, value.m_vector.x);
+            p = FormatText(p, ", ");
+            p = FormatFixed(p, value.m_vector.y);
+            p = FormatText(p, ", ");
+            p = FormatFixed(p, value.m_vector.z);
+            *p++ = '\n';
+            break;
+        case DPT_VectorXY:
+            p = FormatFixed(p, value.m_vector.x);
+            p = FormatText(p, ", ");
+            p = FormatFixed(p, value.m_vector.y);
+            *p++ = '\n';
+            break;
+        case DPT_String:
+            fwrite(line, 1, p - line, fp);
+            fputs(value.m_pString, fp);
+            p = line;
+            *p++ = '\n';
+            break;
+        case DPT_Int64:
+            p = FormatUInt64(p, (uint64)value.m_int64);
+            *p++ = '\n';
+            break;
+        default:
+            break;
+        }
+        fwrite(line, 1, p - line, fp);
+
+        if (pProp->m_nNumElements <= 1)
+            break;
+        if (!nMaxElements)
+            nMaxElements = pProp->m_nNumElements;
+    }
+}
+
+// "Field: index, name = ", what comes before the value of a prop -packetentities shows.
+static void PrintField(int nFieldIndex, const std::string &name) {
+    FILE *fp = OutputStream(kOutput_PacketEntities);
+    char line[256];
+    if (name.size() > sizeof(line) - 32) {
+        fprintf(fp, "Field: %d, %s = ", nFieldIndex, name.c_str());
+        return;
+    }
+    char *p = FormatText(line, "Field: ");
+    p = FormatInt(p, nFieldIndex);
+    p = FormatText(p, ", ");
+    memcpy(p, name.data(), name.size());
+    p = FormatText(p + name.size(), " = ");
+    fwrite(line, 1, p - line, fp);
+}
+
 Prop_t *DecodeProp(CBitRead &entityBitBuffer,
                    FlattenedPropEntry *pFlattenedProp,
                    uint32 uClass,
@@ -236,7 +439,7 @@ Prop_t *DecodeProp(CBitRead &entityBitBuffer,
     }
 
     if (!bQuiet) {
-        printf("Field: %d, %s = ", nFieldIndex, pSendProp->var_name().c_str());
+        PrintField(nFieldIndex, pSendProp->var_name());
     }
     switch (pSendProp->type()) {
     case DPT_Int:
@@ -265,7 +468,7 @@ Prop_t *DecodeProp(CBitRead &entityBitBuffer,
         break;
     }
     if (!bQuiet) {
-        pResult->Print();
+        pResult->Print(OutputStream(kOutput_PacketEntities));
     }
 
     return pResult;
@@ -280,7 +483,7 @@ void DecodePropFake(CBitRead &entityBitBuffer,
     static Vector tmpvec;
 
     if (!bQuiet) {
-        printf("Field: %d, %s = ", nFieldIndex, pSendProp->var_name().c_str());
+        PrintField(nFieldIndex, pSendProp->var_name());
     }
     switch (pSendProp->type()) {
     case DPT_Int:
@@ -296,7 +499,8 @@ void DecodePropFake(CBitRead &entityBitBuffer,
         VectorXY_Decode(entityBitBuffer, pSendProp, tmpvec);
         break;
     case DPT_String:
-        String_Decode(entityBitBuffer, pSendProp);
+        // nothing to intern, just the length
+        entityBitBuffer.SeekRelative(entityBitBuffer.ReadUBitLong(DT_MAX_STRING_BITS) * 8);
         break;
     case DPT_Array:
         Array_Decode(entityBitBuffer, pFlattenedProp, pSendProp->num_elements(), uClass,
@@ -79,56 +79,22 @@ struct Prop_t
 		m_value.m_vector.Init();
 	}
 
-	void Print( int nMaxElements = 0 )
-	{
-		if ( m_nNumElements > 0 )
-		{
-			printf( " Element: %d  ", ( nMaxElements ? nMaxElements : m_nNumElements ) - m_nNumElements );
-		}
+	// One line per element, as -packetentities shows it.
+	void Print( FILE *fp, int nMaxElements = 0 );
 
-		switch ( m_type )
-		{
-			case DPT_Int:
-				{
-					printf( "%d\n", m_value.m_int );
-				}
-				break;
-			case DPT_Float:
-				{
-					printf( "%f\n", m_value.m_float );
-				}
-				break;
-			case DPT_Vector:
-				{
-					printf( "%f, %f, %f\n", m_value.m_vector.x, m_value.m_vector.y, m_value.m_vector.z );
-				}
-				break;
-			case DPT_VectorXY:
-				{
-					printf( "%f, %f\n", m_value.m_vector.x, m_value.m_vector.y );
-				}
-				break;
-			case DPT_String:
-				{
-					printf( "%s\n", m_value.m_pString );
-				}
-				break;
-			case DPT_Array:
-                        case DPT_NUMSendPropTypes:
-			case DPT_DataTable:
-				break;
-			case DPT_Int64:
-				{
-					printf( "%" PRIu64 "\n", m_value.m_int64 );
-				}
-				break;
-		}
+	// DecodeProp results: a scalar is one Prop_t, an array one per element, the first with
+	// m_nNumElements set, and an empty array a single DPT_Array placeholder.
 
-		if ( m_nNumElements > 1 )
-		{
-			Prop_t *pProp = this;
-			pProp[ 1 ].Print( nMaxElements ? nMaxElements : m_nNumElements );
-		}
+	// Prop_t the result spans, the placeholder included.
+	int NumProps() const
+	{
+		return m_nNumElements > 1 ? m_nNumElements : 1;
+	}
+
+	// Values the result holds, 0 for an empty array.
+	int NumValues() const
+	{
+		return m_type == DPT_Array ? 0 : NumProps();
 	}
 
 	SendPropType_t m_type;
@@ -22,7 +22,18 @@
 // THE POSSIBILITY OF SUCH DAMAGE.
 //===========================================================================//
 
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "democatalog.h"
 #include "demofiledump.h"
+#include "demoserve.h"
+#include "memstats.h"
+#include "outputstreams.h"
+#include "resultcache.h"
+#include "trace.h"
 #include "win_stuff.h"
 
 // these settings cause it to output nothing
@@ -38,6 +49,207 @@ bool g_bDumpStringTables = false;
 bool g_bDumpDataTables = false;
 bool g_bDumpPacketEntities = false;
 bool g_bDumpNetMessages = false;
+float g_flSampleHz = 0.0f;
+const char *g_pSampleProps = NULL;
+const char *g_pWhere = NULL;
+int g_nKeyframeInterval = 1024;
+const char *g_pStateAtTicks = NULL;
+const char *g_pEntityLog = NULL;
+bool g_bMatchStats = false;
+bool g_bFollow = false;
+const char *g_pOutputFile = NULL;
+const char *g_pOutputPaths[kOutput_Count] = {};
+const char *g_pCacheDir = NULL;
+int g_nCacheMegabytes = RESULTCACHE_DEFAULT_MB;
+bool g_bCacheFull = false;
+bool g_bCatalog = false;
+int g_nCatalogThreads = 0;
+bool g_bServe = false;
+const char *g_pServeSocket = NULL;
+const char *g_pTraceFile = NULL;
+bool g_bMemStats = false;
+
+static void ResetOptions() {
+    g_bDumpJson = false;
+    g_bPrettyJson = false;
+    g_bDumpGameEvents = false;
+    g_bOnlyHsBoxEvents = false;
+    g_bSupressFootstepEvents = true;
+    g_bShowExtraPlayerInfoInGameEvents = false;
+    g_bDumpDeaths = false;
+    g_bSupressWarmupDeaths = true;
+    g_bDumpStringTables = false;
+    g_bDumpDataTables = false;
+    g_bDumpPacketEntities = false;
+    g_bDumpNetMessages = false;
+    g_flSampleHz = 0.0f;
+    g_pSampleProps = NULL;
+    g_pWhere = NULL;
+    g_nKeyframeInterval = 1024;
+    g_pStateAtTicks = NULL;
+    g_pEntityLog = NULL;
+    g_bMatchStats = false;
+}
+
+static void DumpEverything() {
+    g_bDumpGameEvents = true;
+    g_bSupressFootstepEvents = false;
+    g_bShowExtraPlayerInfoInGameEvents = true;
+    g_bDumpDeaths = true;
+    g_bSupressWarmupDeaths = false;
+    g_bDumpStringTables = true;
+    g_bDumpDataTables = true;
+    g_bDumpPacketEntities = true;
+    g_bDumpNetMessages = true;
+}
+
+// -out:kind=path, pArg is what follows the colon.
+static bool ParseOutputPath(const char *pArg, std::string &error) {
+    const char *pPath = strchr(pArg, '=');
+    int kind = pPath ? OutputKindByName(pArg, pPath - pArg) : -1;
+    if (kind < 0 || !pPath[1]) {
+        error = std::string("-out:") + pArg + ": expected -out:kind=path, kind one of " +
+                OutputKindNames();
+        return false;
+    }
+    g_pOutputPaths[kind] = pPath + 1;
+    return true;
+}
+
+static bool HasOutputPaths() {
+    for (int i = 0; i < kOutput_Count; i++) {
+        if (g_pOutputPaths[i])
+            return true;
+    }
+    return false;
+}
+
+// Applies the option argv[i], moving i past its value. False if it isn't one, or, with error
+// set, if its value is wrong.
+static bool ParseOption(int argc, char *argv[], int &i, std::string &error) {
+    if (strcasecmp(&argv[i][1], "gameevents") == 0) {
+        g_bDumpGameEvents = true;
+        g_bSupressFootstepEvents = false;
+        g_bShowExtraPlayerInfoInGameEvents = false;
+    } else if (strcasecmp(&argv[i][1], "nofootsteps") == 0) {
+        g_bSupressFootstepEvents = true;
+    } else if (strcasecmp(&argv[i][1], "extrainfo") == 0) {
+        g_bShowExtraPlayerInfoInGameEvents = true;
+    } else if (strcasecmp(&argv[i][1], "deathscsv") == 0) {
+        g_bDumpDeaths = true;
+        g_bSupressWarmupDeaths = false;
+    } else if (strcasecmp(&argv[i][1], "nowarmup") == 0) {
+        g_bSupressWarmupDeaths = true;
+    } else if (strcasecmp(&argv[i][1], "stringtables") == 0) {
+        g_bDumpStringTables = true;
+    } else if (strcasecmp(&argv[i][1], "datatables") == 0) {
+        g_bDumpDataTables = true;
+    } else if (strcasecmp(&argv[i][1], "packetentities") == 0) {
+        g_bDumpPacketEntities = true;
+    } else if (strcasecmp(&argv[i][1], "netmessages") == 0) {
+        g_bDumpNetMessages = true;
+    } else if (strcasecmp(&argv[i][1], "json") == 0) {
+        g_bDumpJson = true;
+    } else if (strcasecmp(&argv[i][1], "pretty") == 0) {
+        g_bPrettyJson = true;
+    } else if (strcasecmp(&argv[i][1], "hsbox") == 0) {
+        g_bDumpJson = g_bDumpGameEvents = g_bOnlyHsBoxEvents = true;
+    } else if (strcasecmp(&argv[i][1], "sample-hz") == 0 && i + 1 < argc) {
+        char *pEnd;
+        g_flSampleHz = (float)strtod(argv[++i], &pEnd);
+        if (*pEnd || !std::isfinite(g_flSampleHz) || g_flSampleHz <= 0) {
+            error = std::string("-sample-hz: expected a positive rate, got '") + argv[i] + "'";
+            return false;
+        }
+    } else if (strcasecmp(&argv[i][1], "props") == 0 && i + 1 < argc) {
+        g_pSampleProps = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "where") == 0 && i + 1 < argc) {
+        g_pWhere = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "stateat") == 0 && i + 1 < argc) {
+        g_pStateAtTicks = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "keyframe") == 0 && i + 1 < argc) {
+        g_nKeyframeInterval = atoi(argv[++i]);
+    } else if (strcasecmp(&argv[i][1], "entitylog") == 0 && i + 1 < argc) {
+        g_pEntityLog = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "stats") == 0) {
+        g_bMatchStats = true;
+    } else if (strcasecmp(&argv[i][1], "follow") == 0) {
+        g_bFollow = true;
+    } else if (strcasecmp(&argv[i][1], "o") == 0 && i + 1 < argc) {
+        g_pOutputFile = argv[++i];
+    } else if (strncasecmp(&argv[i][1], "out:", 4) == 0) {
+        return ParseOutputPath(&argv[i][5], error);
+    } else if (strcasecmp(&argv[i][1], "cache") == 0 && i + 1 < argc) {
+        g_pCacheDir = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "cachesize") == 0 && i + 1 < argc) {
+        g_nCacheMegabytes = atoi(argv[++i]);
+    } else if (strcasecmp(&argv[i][1], "cachefull") == 0) {
+        g_bCacheFull = true;
+    } else if (strcasecmp(&argv[i][1], "catalog") == 0) {
+        g_bCatalog = true;
+    } else if (strcasecmp(&argv[i][1], "threads") == 0 && i + 1 < argc) {
+        g_nCatalogThreads = atoi(argv[++i]);
+    } else if (strcasecmp(&argv[i][1], "serve") == 0) {
+        g_bServe = true;
+    } else if (strcasecmp(&argv[i][1], "socket") == 0 && i + 1 < argc) {
+        g_pServeSocket = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "trace") == 0 && i + 1 < argc) {
+        g_pTraceFile = argv[++i];
+    } else if (strcasecmp(&argv[i][1], "memstats") == 0) {
+        g_bMemStats = true;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Options that don't change what's written to the output, left out of the -cache key.
+static bool IsOutputNeutral(const char *pOption) {
+    static const char *const s_options[] = {"-o",     "-cache",    "-cachesize", "-cachefull",
+                                            "-trace", "-memstats", "-threads"};
+    for (size_t i = 0; i < sizeof(s_options) / sizeof(s_options[0]); i++) {
+        if (strcasecmp(pOption, s_options[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// -serve: the options of one request. They point into args, which has to outlive the request.
+static bool ApplyRequestOptions(const std::vector<std::string> &args, std::string &error) {
+    ResetOptions();
+    if (args.empty()) {
+        DumpEverything();
+        return true;
+    }
+
+    std::vector<char *> argv;
+    for (const std::string &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    for (int i = 0; i < (int)argv.size(); i++) {
+        bool bServerOption = strcasecmp(argv[i], "-catalog") == 0 ||
+                             strcasecmp(argv[i], "-threads") == 0 ||
+                             strcasecmp(argv[i], "-serve") == 0 ||
+                             strcasecmp(argv[i], "-socket") == 0 ||
+                             strcasecmp(argv[i], "-trace") == 0 ||
+                             strcasecmp(argv[i], "-memstats") == 0 ||
+                             strcasecmp(argv[i], "-follow") == 0 ||
+                             strcasecmp(argv[i], "-o") == 0 ||
+                             strncasecmp(argv[i], "-out:", 5) == 0 ||
+                             strcasecmp(argv[i], "-cache") == 0 ||
+                             strcasecmp(argv[i], "-cachesize") == 0 ||
+                             strcasecmp(argv[i], "-cachefull") == 0;
+        if (argv[i][0] != '-' || bServerOption) {
+            error = std::string("unsupported flag ") + argv[i];
+            return false;
+        }
+        if (!ParseOption((int)argv.size(), &argv[0], i, error)) {
+            if (error.empty())
+                error = std::string("unsupported flag ") + argv[i];
+            return false;
+        }
+    }
+    return true;
+}
 
 int main(int argc, char *argv[]) {
     CDemoFileDump DemoFileDump;
@@ -60,63 +272,143 @@ int main(int argc, char *argv[]) {
                " -datatables    Dump data tables. (send tables)\n"
                " -packetentites Dump Packet Entities messages.\n"
                " -netmessages   Dump net messages that are not one of the above.\n"
+               " -sample-hz N   Print the props selected with -props for every entity of the\n"
+               "                classes that have them, N times per second of game time.\n"
+               " -props a,b,... Props for -sample-hz, either prop or DT_Table.prop.\n"
+               "                Default is DT_CSPlayer.m_vecOrigin,DT_CSPlayer.m_vecOrigin[2].\n"
+               " -where expr    Only dump the game events (and deaths) expr holds for, e.g.\n"
+               "                'player_death and weapon in (awp, ssg08) and headshot'.\n"
+               "                See eventfilter.h for the syntax.\n"
+               " -stateat t,... Once the demo is parsed, print every entity as it was at each\n"
+               "                of the ticks. Honors -props.\n"
+               " -keyframe N    Ticks between full copies of the entity state kept for\n"
+               "                -stateat. Default is 1024.\n"
+               " -entitylog f   Write every entity change to f in a compact binary format,\n"
+               "                schema first. See entitylog.h for the format.\n"
+               " -stats         Print kills, deaths, assists, headshots, damage and trades per\n"
+               "                player, and damage per attacker and victim, for every round\n"
+               "                and the match. With -json they go in round_stats and stats.\n"
+               " -follow        The demo is still being recorded: at its end, wait for more\n"
+               "                instead of stopping, until dem_stop.\n"
+               " -o file        Write the output to file, gzip compressed if it ends in .gz and\n"
+               "                zstd compressed if it ends in .zst.\n"
+               " -out:kind=file Write one kind of output to file instead, so a single parse can\n"
+               "                write several: gameevents, deaths, stringtables, datatables,\n"
+               "                packetentities, netmessages, samples, stateat, stats or json.\n"
+               "                The kind still has to be asked for, e.g.\n"
+               "                -deathscsv -out:deaths=deaths.csv.\n"
+               " -cache dir     Keep the output of every demo and flags in dir, and print it\n"
+               "                from there when the same demo comes with the same flags again.\n"
+               " -cachesize MB  Size the -cache directory is trimmed to, least recently used\n"
+               "                first. Default is 1024.\n"
+               " -cachefull     Tell demos apart for -cache by all of their bytes instead of\n"
+               "                the header, the signon data and samples of the rest.\n"
+               " -catalog       Print one row per demo (map, server, duration, tick rate, players)\n"
+               "                from the header and signon data only. Takes any number of\n"
+               "                demos, or reads their names from stdin, one per line.\n"
+               " -threads N     Demos cataloged or served in parallel. Default is one per core.\n"
+               " -serve         Parse demos for JSON requests read from stdin, one per line:\n"
+               "                {\"id\": 1, \"demo\": \"a.dem\", \"output\": \"a.json\",\n"
+               "                \"flags\": [\"-hsbox\"]}, and reply on stdout, one line each.\n"
+               " -socket path   With -serve, take requests on connections to this AF_UNIX\n"
+               "                socket instead.\n"
+               " -trace file    Write a timeline of the parse to file, in the Chrome trace\n"
+               "                format. Needs a build with -DTRACE=ON.\n"
+               " -memstats      Print memory use and allocation counts per subsystem and net\n"
+               "                message type to stderr at exit, and on SIGUSR1. Needs a build\n"
+               "                with -DMEMSTATS=ON.\n"
                "Note: by default everything is dumped out.\n");
         exit(1);
     }
 
     int nFileArgument = 1;
-    if (argc > 2) {
-        for (int i = 1; i < argc; i++) {
-            // arguments start with - or /
-            if (argv[i][0] == '-') {
-                if (strcasecmp(&argv[i][1], "gameevents") == 0) {
-                    g_bDumpGameEvents = true;
-                    g_bSupressFootstepEvents = false;
-                    g_bShowExtraPlayerInfoInGameEvents = false;
-                } else if (strcasecmp(&argv[i][1], "nofootsteps") == 0) {
-                    g_bSupressFootstepEvents = true;
-                } else if (strcasecmp(&argv[i][1], "extrainfo") == 0) {
-                    g_bShowExtraPlayerInfoInGameEvents = true;
-                } else if (strcasecmp(&argv[i][1], "deathscsv") == 0) {
-                    g_bDumpDeaths = true;
-                    g_bSupressWarmupDeaths = false;
-                } else if (strcasecmp(&argv[i][1], "nowarmup") == 0) {
-                    g_bSupressWarmupDeaths = true;
-                } else if (strcasecmp(&argv[i][1], "stringtables") == 0) {
-                    g_bDumpStringTables = true;
-                } else if (strcasecmp(&argv[i][1], "datatables") == 0) {
-                    g_bDumpDataTables = true;
-                } else if (strcasecmp(&argv[i][1], "packetentities") == 0) {
-                    g_bDumpPacketEntities = true;
-                } else if (strcasecmp(&argv[i][1], "netmessages") == 0) {
-                    g_bDumpNetMessages = true;
-                } else if (strcasecmp(&argv[i][1], "json") == 0) {
-                    g_bDumpJson = true;
-                } else if (strcasecmp(&argv[i][1], "pretty") == 0) {
-                    g_bPrettyJson = true;
-                } else if (strcasecmp(&argv[i][1], "hsbox") == 0) {
-                    g_bDumpJson = g_bDumpGameEvents = g_bOnlyHsBoxEvents = true;
+    std::vector<std::string> files;
+    // options that change the output, for the -cache key
+    std::string cacheFlags;
+    // whether any option chose what to dump
+    bool bOutputChosen = false;
+    bool bBadOption = false;
+    for (int i = 1; i < argc; i++) {
+        // arguments start with - or /
+        if (argv[i][0] == '-') {
+            int nOption = i;
+            std::string error;
+            if (!ParseOption(argc, argv, i, error) && !error.empty()) {
+                fprintf(stderr, "%s\n", error.c_str());
+                bBadOption = true;
+            }
+            if (!IsOutputNeutral(argv[nOption])) {
+                for (int j = nOption; j <= i; j++) {
+                    cacheFlags.append(argv[j]);
+                    cacheFlags.push_back('\n');
                 }
-            } else {
-                nFileArgument = i;
+                // -follow and -out: change how, not what
+                if (strcasecmp(argv[nOption], "-follow") != 0 &&
+                    strncasecmp(argv[nOption], "-out:", 5) != 0)
+                    bOutputChosen = true;
             }
+        } else {
+            nFileArgument = i;
+            files.push_back(argv[i]);
         }
-    } else {
+    }
+    if (bBadOption) {
+        return 1;
+    }
+    if (!bOutputChosen) {
         // default is to dump out everything
-        g_bDumpGameEvents = true;
-        g_bSupressFootstepEvents = false;
-        g_bShowExtraPlayerInfoInGameEvents = true;
-        g_bDumpDeaths = true;
-        g_bSupressWarmupDeaths = false;
-        g_bDumpStringTables = true;
-        g_bDumpDataTables = true;
-        g_bDumpPacketEntities = true;
-        g_bDumpNetMessages = true;
+        DumpEverything();
+    }
+
+    if (g_pTraceFile) {
+        TraceStart(g_pTraceFile);
+    }
+    if (g_bMemStats) {
+        MemStatsStart();
+    }
+
+    if (g_bServe) {
+        return ServeDemos(g_pServeSocket, g_nCatalogThreads, ApplyRequestOptions);
+    }
+
+    if (g_bCatalog) {
+        if (files.empty()) {
+            std::string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty() && line[line.size() - 1] == '\r')
+                    line.erase(line.size() - 1);
+                if (!line.empty())
+                    files.push_back(line);
+            }
+        }
+        CatalogDemos(files, g_nCatalogThreads);
+        TraceStop();
+        return 0;
+    }
+
+    // a followed demo isn't done yet, and -entitylog and -out write more than the output
+    CResultCache cache(g_pCacheDir, (uint64)std::max(g_nCacheMegabytes, 0) * 1024 * 1024);
+    bool bCaching = false;
+    if (g_pCacheDir && !g_bFollow && !g_pEntityLog && !HasOutputPaths()) {
+        std::string error;
+        if (!cache.Key(argv[nFileArgument], cacheFlags, g_bCacheFull, error)) {
+            fprintf(stderr, "-cache: %s\n", error.c_str());
+        } else if (cache.Replay(g_pOutputFile)) {
+            TraceStop();
+            return 0;
+        } else {
+            bCaching = cache.Begin(g_pOutputFile);
+        }
     }
 
     if (DemoFileDump.Open(argv[nFileArgument])) {
         DemoFileDump.DoDump();
+        if (bCaching)
+            cache.Store();
+        // the reader thread records a span too
+        DemoFileDump.Close();
     }
+    TraceStop();
 
     return 0;
 }
@@ -0,0 +1,292 @@
+// Throughput microbenchmarks for CBitRead primitives, the DecodeProp paths and the number
+// formatting of the text output.
+//
+// Every benchmark reads a deterministic synthetic bitstream. The "warm" variant
+// loops over a small buffer that stays resident in L1/L2, the "cold" variant
+// streams a larger buffer after evicting the caches with an even larger one, so
+// the numbers bracket what a real demo sees.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "demofilebitbuf.h"
+#include "demofiledump.h"
+#include "demofilepropdecode.h"
+#include "stringinterner.h"
+#include "textformat.h"
+#include "win_stuff.h"
+
+#define BENCH_WARM_BYTES (32 * 1024)
+#define BENCH_COLD_BYTES (16 * 1024 * 1024)
+#define BENCH_EVICT_BYTES (64 * 1024 * 1024)
+#define BENCH_MIN_SECONDS 0.25
+#define BENCH_COLD_PASSES 2
+// no single operation consumes more than this, so we stop before running off the end
+#define BENCH_TAIL_BITS (16 * 1024)
+#define BENCH_OPS_PER_CHECK 64
+
+enum BenchFill { kFill_Random, kFill_Text };
+
+static uint32 s_nRandState;
+
+static uint32 NextRandom() {
+    // xorshift32, good enough for reproducible bit patterns
+    uint32 x = s_nRandState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return s_nRandState = x;
+}
+
+static void FillBuffer(std::vector<uint32> &buffer, size_t nBytes, BenchFill fill) {
+    s_nRandState = 0x9E3779B9;
+    buffer.resize(nBytes / sizeof(uint32));
+    if (fill == kFill_Random) {
+        for (size_t i = 0; i < buffer.size(); i++) {
+            buffer[i] = NextRandom();
+        }
+    } else {
+        // short lowercase words separated by terminators, like entity string props
+        unsigned char *pBytes = (unsigned char *)&buffer[0];
+        int nLeft = 0;
+        for (size_t i = 0; i < nBytes; i++) {
+            if (nLeft == 0) {
+                pBytes[i] = 0;
+                nLeft = 1 + NextRandom() % 24;
+            } else {
+                pBytes[i] = 'a' + NextRandom() % 26;
+                nLeft--;
+            }
+        }
+    }
+}
+
+static volatile uint32 s_nSink;
+static std::vector<uint32> s_evictBuffer;
+
+static void EvictCaches() {
+    if (s_evictBuffer.empty()) {
+        s_evictBuffer.resize(BENCH_EVICT_BYTES / sizeof(uint32));
+    }
+    for (size_t i = 0; i < s_evictBuffer.size(); i += 16) {
+        s_evictBuffer[i]++;
+    }
+}
+
+struct BenchStats {
+    BenchStats() : nBits(0), nOps(0), flSeconds(0.0) {}
+
+    uint64 nBits;
+    uint64 nOps;
+    double flSeconds;
+};
+
+// Consume the whole buffer with fn, stopping BENCH_TAIL_BITS before its end.
+template <typename Fn>
+static void RunPass(const std::vector<uint32> &buffer, Fn &fn, BenchStats &stats) {
+    int nBytes = (int)(buffer.size() * sizeof(uint32));
+    CBitRead buf(&buffer[0], nBytes);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64 nOps = 0;
+    while (buf.GetNumBitsLeft() > BENCH_TAIL_BITS) {
+        for (int i = 0; i < BENCH_OPS_PER_CHECK; i++) {
+            fn(buf);
+        }
+        nOps += BENCH_OPS_PER_CHECK;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    stats.nBits += buf.GetNumBitsRead();
+    stats.nOps += nOps;
+    stats.flSeconds += std::chrono::duration<double>(end - start).count();
+}
+
+static const char *s_pFilter = NULL;
+
+template <typename Fn>
+static void RunBench(const char *pName, BenchFill fill, Fn fn) {
+    if (s_pFilter && !strstr(pName, s_pFilter)) {
+        return;
+    }
+
+    std::vector<uint32> buffer;
+
+    BenchStats warm;
+    FillBuffer(buffer, BENCH_WARM_BYTES, fill);
+    RunPass(buffer, fn, warm); // prime caches and branch predictors
+    warm = BenchStats();
+    while (warm.flSeconds < BENCH_MIN_SECONDS) {
+        RunPass(buffer, fn, warm);
+    }
+
+    BenchStats cold;
+    FillBuffer(buffer, BENCH_COLD_BYTES, fill);
+    for (int i = 0; i < BENCH_COLD_PASSES; i++) {
+        EvictCaches();
+        RunPass(buffer, fn, cold);
+    }
+
+    printf("%-36s %10.3f %10.2f %10.3f %10.2f\n", pName,
+           warm.nBits / (warm.flSeconds * 1e9), warm.flSeconds * 1e9 / warm.nOps,
+           cold.nBits / (cold.flSeconds * 1e9), cold.flSeconds * 1e9 / cold.nOps);
+    fflush(stdout);
+}
+
+// strings are interned, g_StringInterner owns them
+static void FreeProp(const CSVCMsg_SendTable::sendprop_t &sendProp, Prop_t *pProp) {
+    if (sendProp.type() == DPT_Array) {
+        delete[] pProp;
+        return;
+    }
+    delete pProp;
+}
+
+struct DecodePropBench {
+    DecodePropBench(FlattenedPropEntry *pFlattenedProp) : m_pFlattenedProp(pFlattenedProp) {}
+
+    void operator()(CBitRead &buf) {
+        Prop_t *pProp = DecodeProp(buf, m_pFlattenedProp, 0, 0, true);
+        s_nSink++;
+        FreeProp(*m_pFlattenedProp->m_prop, pProp);
+    }
+
+    FlattenedPropEntry *m_pFlattenedProp;
+};
+
+static CSVCMsg_SendTable::sendprop_t MakeSendProp(
+    int type, int flags, int nBits, float flLow = 0.0f, float flHigh = 0.0f) {
+    CSVCMsg_SendTable::sendprop_t sendProp;
+    sendProp.set_type(type);
+    sendProp.set_var_name("m_bench");
+    sendProp.set_flags(flags);
+    sendProp.set_num_bits(nBits);
+    sendProp.set_low_value(flLow);
+    sendProp.set_high_value(flHigh);
+    return sendProp;
+}
+
+static void BenchDecodeProp(const char *pName, const CSVCMsg_SendTable::sendprop_t &sendProp) {
+    FlattenedPropEntry flattenedProp(&sendProp, NULL);
+    RunBench(pName, kFill_Random, DecodePropBench(&flattenedProp));
+}
+
+static void BenchBitRead() {
+    static const int s_widths[] = {1, 3, 7, 11, 16, 20, 32};
+    for (size_t i = 0; i < sizeof(s_widths) / sizeof(s_widths[0]); i++) {
+        char name[64];
+        int nBits = s_widths[i];
+        snprintf(name, sizeof(name), "ReadUBitLong(%d)", nBits);
+        RunBench(name, kFill_Random,
+                 [nBits](CBitRead &buf) { s_nSink += buf.ReadUBitLong(nBits); });
+    }
+
+    RunBench("ReadOneBit", kFill_Random, [](CBitRead &buf) { s_nSink += buf.ReadOneBit(); });
+    RunBench("ReadVarInt32", kFill_Random, [](CBitRead &buf) { s_nSink += buf.ReadVarInt32(); });
+    RunBench("ReadUBitVar", kFill_Random, [](CBitRead &buf) { s_nSink += buf.ReadUBitVar(); });
+    RunBench("ReadString", kFill_Text, [](CBitRead &buf) {
+        char str[DT_MAX_STRING_BUFFERSIZE];
+        buf.ReadString(str, sizeof(str));
+        s_nSink += str[0];
+    });
+    RunBench("ReadBitCoord", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCoord(); });
+    RunBench("ReadBitCoordMP(None)", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCoordMP(kCW_None); });
+    RunBench("ReadBitCoordMP(LowPrecision)", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCoordMP(kCW_LowPrecision); });
+    RunBench("ReadBitCoordMP(Integral)", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCoordMP(kCW_Integral); });
+    RunBench("ReadBitCellCoord(None)", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCellCoord(15, kCW_None); });
+    RunBench("ReadBitCellCoord(LowPrecision)", kFill_Random, [](CBitRead &buf) {
+        s_nSink += (uint32)buf.ReadBitCellCoord(15, kCW_LowPrecision);
+    });
+    RunBench("ReadBitCellCoord(Integral)", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)buf.ReadBitCellCoord(15, kCW_Integral); });
+    RunBench("ReadBitNormal", kFill_Random,
+             [](CBitRead &buf) { s_nSink += (uint32)(buf.ReadBitNormal() * 1000.0f); });
+}
+
+static void BenchProps() {
+    BenchDecodeProp("DecodeProp(int:unsigned:11)", MakeSendProp(DPT_Int, SPROP_UNSIGNED, 11));
+    BenchDecodeProp("DecodeProp(int:signed:32)", MakeSendProp(DPT_Int, 0, 32));
+    BenchDecodeProp("DecodeProp(int:varint)",
+                    MakeSendProp(DPT_Int, SPROP_VARINT | SPROP_UNSIGNED, 32));
+    BenchDecodeProp("DecodeProp(int:signed varint)", MakeSendProp(DPT_Int, SPROP_VARINT, 32));
+    BenchDecodeProp("DecodeProp(float:quantized:16)",
+                    MakeSendProp(DPT_Float, 0, 16, -1024.0f, 1024.0f));
+    BenchDecodeProp("DecodeProp(float:noscale)", MakeSendProp(DPT_Float, SPROP_NOSCALE, 32));
+    BenchDecodeProp("DecodeProp(float:coord)", MakeSendProp(DPT_Float, SPROP_COORD, 32));
+    BenchDecodeProp("DecodeProp(float:coord_mp)", MakeSendProp(DPT_Float, SPROP_COORD_MP, 32));
+    BenchDecodeProp("DecodeProp(float:coord_mp_lowprec)",
+                    MakeSendProp(DPT_Float, SPROP_COORD_MP_LOWPRECISION, 32));
+    BenchDecodeProp("DecodeProp(float:coord_mp_integral)",
+                    MakeSendProp(DPT_Float, SPROP_COORD_MP_INTEGRAL, 32));
+    BenchDecodeProp("DecodeProp(float:cell_coord)",
+                    MakeSendProp(DPT_Float, SPROP_CELL_COORD, 15));
+    BenchDecodeProp("DecodeProp(float:normal)", MakeSendProp(DPT_Float, SPROP_NORMAL, 11));
+    BenchDecodeProp("DecodeProp(vector:coord)", MakeSendProp(DPT_Vector, SPROP_COORD, 32));
+    BenchDecodeProp("DecodeProp(vector:normal)", MakeSendProp(DPT_Vector, SPROP_NORMAL, 11));
+    BenchDecodeProp("DecodeProp(vector:quantized:12)",
+                    MakeSendProp(DPT_Vector, 0, 12, -4096.0f, 4096.0f));
+    BenchDecodeProp("DecodeProp(vectorxy:coord)", MakeSendProp(DPT_VectorXY, SPROP_COORD, 32));
+    BenchDecodeProp("DecodeProp(string)", MakeSendProp(DPT_String, 0, 0));
+    g_StringInterner.Clear();
+    BenchDecodeProp("DecodeProp(int64:unsigned:64)", MakeSendProp(DPT_Int64, SPROP_UNSIGNED, 64));
+    BenchDecodeProp("DecodeProp(int64:signed:64)", MakeSendProp(DPT_Int64, 0, 64));
+    BenchDecodeProp("DecodeProp(int64:varint)",
+                    MakeSendProp(DPT_Int64, SPROP_VARINT | SPROP_UNSIGNED, 64));
+
+    CSVCMsg_SendTable::sendprop_t elementProp = MakeSendProp(DPT_Int, SPROP_UNSIGNED, 8);
+    CSVCMsg_SendTable::sendprop_t arrayProp = MakeSendProp(DPT_Array, 0, 0);
+    arrayProp.set_num_elements(32);
+    FlattenedPropEntry flattenedArray(&arrayProp, &elementProp);
+    RunBench("DecodeProp(array:int:32)", kFill_Random, DecodePropBench(&flattenedArray));
+}
+
+// Coordinates with 16 fraction bits and integers of random widths, against printf's formats.
+static void BenchFormat() {
+    RunBench("FormatFixed", kFill_Random, [](CBitRead &buf) {
+        char text[TEXTFORMAT_FIXED_CHARS];
+        float value = (int32)buf.ReadUBitLong(32) / 65536.0f;
+        s_nSink += (uint32)(FormatFixed(text, value) - text);
+    });
+    RunBench("snprintf(%f)", kFill_Random, [](CBitRead &buf) {
+        char text[TEXTFORMAT_FIXED_CHARS];
+        float value = (int32)buf.ReadUBitLong(32) / 65536.0f;
+        s_nSink += snprintf(text, sizeof(text), "%f", value);
+    });
+    RunBench("FormatInt", kFill_Random, [](CBitRead &buf) {
+        char text[16];
+        int value = (int32)buf.ReadUBitLong(32) >> buf.ReadUBitLong(5);
+        s_nSink += (uint32)(FormatInt(text, value) - text);
+    });
+    RunBench("snprintf(%d)", kFill_Random, [](CBitRead &buf) {
+        char text[16];
+        int value = (int32)buf.ReadUBitLong(32) >> buf.ReadUBitLong(5);
+        s_nSink += snprintf(text, sizeof(text), "%d", value);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        printf("demoinfogo_bench [filter]\n"
+               "  Runs every benchmark whose name contains filter (all if omitted).\n");
+        exit(1);
+    }
+    if (argc == 2) {
+        s_pFilter = argv[1];
+    }
+
+    printf("%-36s %10s %10s %10s %10s\n", "benchmark", "warm b/ns", "warm ns/op", "cold b/ns",
+           "cold ns/op");
+    BenchBitRead();
+    BenchProps();
+    BenchFormat();
+
+    return 0;
+}
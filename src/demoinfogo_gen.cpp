@@ -0,0 +1,1697 @@
+// Synthetic demo generator.
+//
+// Emits .dem files that go through the same demoheader_t / dem_* framing and
+// protobuf net messages as a real GOTV recording, so demoinfogo parses them
+// end to end. The schema (server classes, prop counts and encodings), entity
+// count, tick count and rate, and the game event and string table traffic are
+// all configurable, and every byte is derived from the seed, which makes the
+// output reproducible from 1 MB to several GB.
+
+#include <algorithm>
+#include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "demofile.h"
+#include "demofilebitbuf.h"
+#include "demofiledump.h"
+#include "demofilepropdecode.h"
+#include "win_stuff.h"
+#include "netmessages.pb.h"
+
+#define GEN_OUTPUT_BUFFER_SIZE (4 * 1024 * 1024)
+// flush a dem_packet once its payload grows past this, well below NET_MAX_PAYLOAD
+#define GEN_MAX_PACKET_BYTES (128 * 1024)
+// entities per svc_PacketEntities in the initial full update
+#define GEN_FULL_UPDATE_CHUNK 128
+#define GEN_USERINFO_MAX_ENTRIES 256
+#define GEN_FIRST_SYNTHETIC_ENTITY 80
+#define GEN_SMOKE_DURATION 18.0f // seconds
+#define GEN_FIELD_INDEX_END 0xFFF
+
+struct GenOptions {
+    GenOptions()
+        : nSeed(1), nTicks(128 * 60), nTickRate(128), nSizeMB(0), nPlayers(10), nClasses(16),
+          nProps(24), nEntities(200), nChangesPerTick(4), flEventsPerSecond(20.0f),
+          nStringTables(4), nStringsPerTable(64), flStringUpdatesPerSecond(1.0f),
+          nRoundSeconds(115), pMapName("de_synthetic") {}
+
+    uint32 nSeed;
+    int nTicks;
+    int nTickRate;
+    int nSizeMB;
+    int nPlayers;
+    int nClasses;
+    int nProps;
+    int nEntities;
+    int nChangesPerTick;
+    float flEventsPerSecond;
+    int nStringTables;
+    int nStringsPerTable;
+    float flStringUpdatesPerSecond;
+    int nRoundSeconds;
+    const char *pMapName;
+    std::vector<int> encodings;
+};
+
+//-----------------------------------------------------------------------------
+// deterministic random numbers (xorshift64*), identical on every platform
+//-----------------------------------------------------------------------------
+class CGenRandom {
+public:
+    void Seed(uint64 nSeed) { m_nState = nSeed * 0x9E3779B97F4A7C15ULL + 1; }
+
+    uint64 Next64() {
+        m_nState ^= m_nState >> 12;
+        m_nState ^= m_nState << 25;
+        m_nState ^= m_nState >> 27;
+        return m_nState * 0x2545F4914F6CDD1DULL;
+    }
+
+    uint32 Next() { return (uint32)(Next64() >> 32); }
+
+    // uniform in [0, n)
+    int Range(int n) { return n > 0 ? (int)(Next() % (uint32)n) : 0; }
+
+    // uniform in [flLow, flHigh]
+    float Float(float flLow, float flHigh) {
+        return flLow + (flHigh - flLow) * (float)(Next() >> 8) / (float)(1 << 24);
+    }
+
+private:
+    uint64 m_nState;
+};
+
+static CGenRandom s_random;
+
+//-----------------------------------------------------------------------------
+// schema
+//-----------------------------------------------------------------------------
+enum GenEncoding {
+    kEnc_Int,
+    kEnc_SignedInt,
+    kEnc_VarInt,
+    kEnc_Float,
+    kEnc_Coord,
+    kEnc_CoordMP,
+    kEnc_CellCoord,
+    kEnc_Normal,
+    kEnc_NoScale,
+    kEnc_Vector,
+    kEnc_VectorNormal,
+    kEnc_VectorXY,
+    kEnc_String,
+    kEnc_Array,
+    kEnc_Int64,
+    kEnc_Count
+};
+
+static const char *s_encodingNames[kEnc_Count] = {
+    "int",    "sint",   "varint", "float",        "coord",    "coordmp", "cellcoord", "normal",
+    "noscale", "vector", "vectornormal", "vectorxy", "string", "array",  "int64",
+};
+
+// Flattened prop as the reader will see it after FlattenDataTable.
+struct GenFlatProp {
+    GenFlatProp(const CSVCMsg_SendTable::sendprop_t *pProp,
+                const CSVCMsg_SendTable::sendprop_t *pElementProp)
+        : m_pProp(pProp), m_pElementProp(pElementProp) {}
+
+    const CSVCMsg_SendTable::sendprop_t *m_pProp;
+    const CSVCMsg_SendTable::sendprop_t *m_pElementProp;
+};
+
+struct GenServerClass {
+    std::string strName;
+    std::string strDTName;
+    int nDataTable;
+    std::vector<GenFlatProp> flattenedProps;
+};
+
+enum { GEN_CLASS_GAMERULES = 0, GEN_CLASS_PLAYER, GEN_CLASS_TEAM, GEN_CLASS_SMOKE, GEN_CLASS_FIRST };
+
+static std::vector<CSVCMsg_SendTable> s_tables;
+static std::vector<GenServerClass> s_classes;
+static int s_nClassBits;
+
+static CSVCMsg_SendTable::sendprop_t *AddProp(CSVCMsg_SendTable &table,
+                                              const char *pName,
+                                              int type,
+                                              int flags,
+                                              int nBits,
+                                              float flLow = 0.0f,
+                                              float flHigh = 0.0f) {
+    CSVCMsg_SendTable::sendprop_t *pProp = table.add_props();
+    pProp->set_type(type);
+    pProp->set_var_name(pName);
+    pProp->set_flags(flags);
+    // everything the reader puts first must come first here, so FlattenDataTable's priority
+    // sort leaves our declaration order untouched
+    pProp->set_priority((flags & SPROP_CHANGES_OFTEN) ? 64 : 128);
+    pProp->set_num_bits(nBits);
+    pProp->set_low_value(flLow);
+    pProp->set_high_value(flHigh);
+    return pProp;
+}
+
+static void AddEncodedProp(CSVCMsg_SendTable &table, const char *pName, int encoding) {
+    switch (encoding) {
+    case kEnc_Int:
+        AddProp(table, pName, DPT_Int, SPROP_UNSIGNED, 10);
+        break;
+    case kEnc_SignedInt:
+        AddProp(table, pName, DPT_Int, 0, 16);
+        break;
+    case kEnc_VarInt:
+        AddProp(table, pName, DPT_Int, SPROP_VARINT | SPROP_UNSIGNED, 32);
+        break;
+    case kEnc_Float:
+        AddProp(table, pName, DPT_Float, 0, 12, 0.0f, 1024.0f);
+        break;
+    case kEnc_Coord:
+        AddProp(table, pName, DPT_Float, SPROP_COORD, 32);
+        break;
+    case kEnc_CoordMP:
+        AddProp(table, pName, DPT_Float, SPROP_COORD_MP, 32);
+        break;
+    case kEnc_CellCoord:
+        AddProp(table, pName, DPT_Float, SPROP_CELL_COORD, 10);
+        break;
+    case kEnc_Normal:
+        AddProp(table, pName, DPT_Float, SPROP_NORMAL, NORMAL_FRACTIONAL_BITS);
+        break;
+    case kEnc_NoScale:
+        AddProp(table, pName, DPT_Float, SPROP_NOSCALE, 32);
+        break;
+    case kEnc_Vector:
+        AddProp(table, pName, DPT_Vector, SPROP_COORD, 32);
+        break;
+    case kEnc_VectorNormal:
+        AddProp(table, pName, DPT_Vector, SPROP_NORMAL, NORMAL_FRACTIONAL_BITS);
+        break;
+    case kEnc_VectorXY:
+        AddProp(table, pName, DPT_VectorXY, SPROP_COORD_MP, 32);
+        break;
+    case kEnc_String:
+        AddProp(table, pName, DPT_String, 0, 0);
+        break;
+    case kEnc_Array: {
+        std::string elementName = std::string(pName) + "_element";
+        AddProp(table, elementName.c_str(), DPT_Int, SPROP_UNSIGNED | SPROP_INSIDEARRAY, 8);
+        AddProp(table, pName, DPT_Array, 0, 0)->set_num_elements(8);
+    } break;
+    case kEnc_Int64:
+        AddProp(table, pName, DPT_Int64, SPROP_UNSIGNED, 64);
+        break;
+    }
+}
+
+static CSVCMsg_SendTable &AddTable(const char *pName) {
+    s_tables.push_back(CSVCMsg_SendTable());
+    CSVCMsg_SendTable &table = s_tables.back();
+    table.set_net_table_name(pName);
+    table.set_needs_decoder(true);
+    return table;
+}
+
+static void AddBaseClass(CSVCMsg_SendTable &table, const char *pBaseTable) {
+    CSVCMsg_SendTable::sendprop_t *pProp = table.add_props();
+    pProp->set_type(DPT_DataTable);
+    pProp->set_var_name("baseclass");
+    pProp->set_flags(SPROP_COLLAPSIBLE);
+    pProp->set_priority(128);
+    pProp->set_dt_name(pBaseTable);
+}
+
+static void AddExclude(CSVCMsg_SendTable &table, const char *pBaseTable, const char *pVarName) {
+    CSVCMsg_SendTable::sendprop_t *pProp = table.add_props();
+    pProp->set_type(DPT_Int);
+    pProp->set_var_name(pVarName);
+    pProp->set_flags(SPROP_EXCLUDE);
+    pProp->set_priority(128);
+    pProp->set_dt_name(pBaseTable);
+}
+
+static int FindTable(const std::string &name) {
+    for (size_t i = 0; i < s_tables.size(); i++) {
+        if (s_tables[i].net_table_name() == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Same walk as GatherExcludes/GatherProps_IterateProps, restricted to what BuildSchema emits
+// (collapsible base classes only).
+static void GatherGenProps(const CSVCMsg_SendTable &table,
+                           const std::vector<std::string> &excludes,
+                           std::vector<GenFlatProp> &flattenedProps) {
+    for (int iProp = 0; iProp < table.props_size(); iProp++) {
+        const CSVCMsg_SendTable::sendprop_t &sendProp = table.props(iProp);
+        if ((sendProp.flags() & (SPROP_INSIDEARRAY | SPROP_EXCLUDE))) {
+            continue;
+        }
+        std::string key = table.net_table_name() + "." + sendProp.var_name();
+        if (std::find(excludes.begin(), excludes.end(), key) != excludes.end()) {
+            continue;
+        }
+
+        if (sendProp.type() == DPT_DataTable) {
+            GatherGenProps(s_tables[FindTable(sendProp.dt_name())], excludes, flattenedProps);
+        } else if (sendProp.type() == DPT_Array) {
+            flattenedProps.push_back(GenFlatProp(&sendProp, &table.props(iProp - 1)));
+        } else {
+            flattenedProps.push_back(GenFlatProp(&sendProp, NULL));
+        }
+    }
+}
+
+static void AddServerClass(const char *pName, const char *pDTName) {
+    GenServerClass serverClass;
+    serverClass.strName = pName;
+    serverClass.strDTName = pDTName;
+    serverClass.nDataTable = FindTable(pDTName);
+    s_classes.push_back(serverClass);
+}
+
+static void FlattenGenClass(GenServerClass &serverClass) {
+    const CSVCMsg_SendTable &table = s_tables[serverClass.nDataTable];
+
+    std::vector<std::string> excludes;
+    for (int iProp = 0; iProp < table.props_size(); iProp++) {
+        const CSVCMsg_SendTable::sendprop_t &sendProp = table.props(iProp);
+        if (sendProp.flags() & SPROP_EXCLUDE) {
+            excludes.push_back(sendProp.dt_name() + "." + sendProp.var_name());
+        }
+    }
+    GatherGenProps(table, excludes, serverClass.flattenedProps);
+
+    for (size_t i = 1; i < serverClass.flattenedProps.size(); i++) {
+        assert(serverClass.flattenedProps[i - 1].m_pProp->priority() <=
+               serverClass.flattenedProps[i].m_pProp->priority());
+    }
+}
+
+static int FindFlatProp(int nClass, const char *pName) {
+    const std::vector<GenFlatProp> &flattenedProps = s_classes[nClass].flattenedProps;
+    for (size_t i = 0; i < flattenedProps.size(); i++) {
+        if (flattenedProps[i].m_pProp->var_name() == pName) {
+            return (int)i;
+        }
+    }
+    fprintf(stderr, "FindFlatProp: no %s in class %d\n", pName, nClass);
+    exit(1);
+}
+
+static void BuildSchema(const GenOptions &options) {
+    // protobuf messages hold pointers into this vector, never let it reallocate
+    s_tables.reserve(6 + options.nClasses);
+
+    CSVCMsg_SendTable &base = AddTable("DT_GenBaseEntity");
+    AddProp(base, "m_flSimulationTime", DPT_Int, SPROP_UNSIGNED | SPROP_CHANGES_OFTEN, 8);
+    AddProp(base, "m_vecOrigin", DPT_VectorXY, SPROP_COORD_MP | SPROP_CHANGES_OFTEN, 32);
+    AddProp(base, "m_vecOrigin[2]", DPT_Float, SPROP_COORD_MP | SPROP_CHANGES_OFTEN, 32);
+    AddProp(base, "m_nModelIndex", DPT_Int, SPROP_UNSIGNED, 13);
+    AddProp(base, "m_fEffects", DPT_Int, SPROP_UNSIGNED, 10);
+
+    CSVCMsg_SendTable &gamerules = AddTable("DT_CSGameRulesProxy");
+    AddProp(gamerules, "m_bGameRestart", DPT_Int, SPROP_UNSIGNED, 1);
+    AddProp(gamerules, "m_bWarmupPeriod", DPT_Int, SPROP_UNSIGNED, 1);
+    AddProp(gamerules, "m_fRoundStartTime", DPT_Float, SPROP_NOSCALE, 32);
+    AddProp(gamerules, "m_totalRoundsPlayed", DPT_Int, SPROP_UNSIGNED, 16);
+
+    CSVCMsg_SendTable &player = AddTable("DT_CSPlayer");
+    AddProp(player, "m_vecOrigin", DPT_VectorXY, SPROP_COORD_MP | SPROP_CHANGES_OFTEN, 32);
+    AddProp(player, "m_vecOrigin[2]", DPT_Float, SPROP_COORD_MP | SPROP_CHANGES_OFTEN, 32);
+    AddProp(player, "m_angEyeAngles[0]", DPT_Float, SPROP_NOSCALE | SPROP_CHANGES_OFTEN, 32);
+    AddProp(player, "m_angEyeAngles[1]", DPT_Float, SPROP_NOSCALE | SPROP_CHANGES_OFTEN, 32);
+    AddProp(player, "m_vecVelocity[2]", DPT_Float, SPROP_NOSCALE | SPROP_CHANGES_OFTEN, 32);
+    AddProp(player, "m_iTeamNum", DPT_Int, SPROP_UNSIGNED, 6);
+    AddProp(player, "m_iHealth", DPT_Int, SPROP_UNSIGNED, 10);
+    AddProp(player, "m_ArmorValue", DPT_Int, SPROP_UNSIGNED, 8);
+    AddProp(player, "m_iAccount", DPT_Int, SPROP_UNSIGNED, 16);
+    AddProp(player, "m_bIsScoped", DPT_Int, SPROP_UNSIGNED, 1);
+    AddProp(player, "m_szLastPlaceName", DPT_String, 0, 0);
+    AddProp(player, "m_flFlashDuration", DPT_Float, 0, 8, 0.0f, 10.0f);
+
+    CSVCMsg_SendTable &team = AddTable("DT_CSTeam");
+    AddProp(team, "m_iTeamNum", DPT_Int, SPROP_UNSIGNED, 6);
+    AddProp(team, "m_scoreTotal", DPT_Int, SPROP_UNSIGNED, 16);
+    AddProp(team, "m_szTeamname", DPT_String, 0, 0);
+
+    CSVCMsg_SendTable &smoke = AddTable("DT_SmokeGrenadeProjectile");
+    AddBaseClass(smoke, "DT_GenBaseEntity");
+    AddExclude(smoke, "DT_GenBaseEntity", "m_fEffects");
+    AddProp(smoke, "m_bDidSmokeEffect", DPT_Int, SPROP_UNSIGNED, 1);
+    AddProp(smoke, "m_nSmokeEffectTickBegin", DPT_Int, SPROP_UNSIGNED, 32);
+
+    int nProp = 0;
+    for (int i = 0; i < options.nClasses; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "DT_Gen%d", i);
+        CSVCMsg_SendTable &table = AddTable(name);
+        AddBaseClass(table, "DT_GenBaseEntity");
+        AddExclude(table, "DT_GenBaseEntity", "m_fEffects");
+        for (int j = 0; j < options.nProps; j++) {
+            snprintf(name, sizeof(name), "m_gen%d", j);
+            AddEncodedProp(table, name, options.encodings[nProp++ % options.encodings.size()]);
+        }
+    }
+
+    AddServerClass("CCSGameRulesProxy", "DT_CSGameRulesProxy");
+    AddServerClass("CCSPlayer", "DT_CSPlayer");
+    AddServerClass("CCSTeam", "DT_CSTeam");
+    AddServerClass("CSmokeGrenadeProjectile", "DT_SmokeGrenadeProjectile");
+    for (int i = 0; i < options.nClasses; i++) {
+        char name[64], dtName[64];
+        snprintf(name, sizeof(name), "CGen%d", i);
+        snprintf(dtName, sizeof(dtName), "DT_Gen%d", i);
+        AddServerClass(name, dtName);
+    }
+    for (size_t i = 0; i < s_classes.size(); i++) {
+        FlattenGenClass(s_classes[i]);
+    }
+
+    // same integer log2() + 1 as ParseDataTable
+    int nTemp = (int)s_classes.size();
+    s_nClassBits = 0;
+    while (nTemp >>= 1)
+        ++s_nClassBits;
+    s_nClassBits++;
+}
+
+//-----------------------------------------------------------------------------
+// prop encoders, the inverse of demofilepropdecode.cpp
+//-----------------------------------------------------------------------------
+static void Int_Encode(CBitWrite &buf, const CSVCMsg_SendTable::sendprop_t &prop, int val) {
+    int flags = prop.flags();
+    if (flags & SPROP_VARINT) {
+        if (flags & SPROP_UNSIGNED) {
+            buf.WriteVarInt32((uint32)val);
+        } else {
+            buf.WriteSignedVarInt32(val);
+        }
+    } else {
+        if (flags & SPROP_UNSIGNED) {
+            buf.WriteUBitLong((unsigned int)val, prop.num_bits());
+        } else {
+            buf.WriteSBitLong(val, prop.num_bits());
+        }
+    }
+}
+
+static void Float_Encode(CBitWrite &buf, const CSVCMsg_SendTable::sendprop_t &prop, float val) {
+    int flags = prop.flags();
+    if (flags & SPROP_COORD) {
+        buf.WriteBitCoord(val);
+    } else if (flags & SPROP_COORD_MP) {
+        buf.WriteBitCoordMP(val, kCW_None);
+    } else if (flags & SPROP_COORD_MP_LOWPRECISION) {
+        buf.WriteBitCoordMP(val, kCW_LowPrecision);
+    } else if (flags & SPROP_COORD_MP_INTEGRAL) {
+        buf.WriteBitCoordMP(val, kCW_Integral);
+    } else if (flags & SPROP_NOSCALE) {
+        buf.WriteBitFloat(val);
+    } else if (flags & SPROP_NORMAL) {
+        buf.WriteBitNormal(val);
+    } else if (flags & SPROP_CELL_COORD) {
+        buf.WriteBitCellCoord(val, prop.num_bits(), kCW_None);
+    } else if (flags & SPROP_CELL_COORD_LOWPRECISION) {
+        buf.WriteBitCellCoord(val, prop.num_bits(), kCW_LowPrecision);
+    } else if (flags & SPROP_CELL_COORD_INTEGRAL) {
+        buf.WriteBitCellCoord(val, prop.num_bits(), kCW_Integral);
+    } else {
+        float flRange = prop.high_value() - prop.low_value();
+        float flFraction = flRange != 0.0f ? (val - prop.low_value()) / flRange : 0.0f;
+        flFraction = flFraction < 0.0f ? 0.0f : (flFraction > 1.0f ? 1.0f : flFraction);
+        uint32 nMax = (1u << prop.num_bits()) - 1;
+        buf.WriteUBitLong((uint32)(flFraction * nMax + 0.5f), prop.num_bits());
+    }
+}
+
+static void Vector_Encode(CBitWrite &buf,
+                          const CSVCMsg_SendTable::sendprop_t &prop,
+                          const Vector &v) {
+    Float_Encode(buf, prop, v.x);
+    Float_Encode(buf, prop, v.y);
+    if ((prop.flags() & SPROP_NORMAL) == 0) {
+        Float_Encode(buf, prop, v.z);
+    } else {
+        buf.WriteOneBit(v.z <= -NORMAL_RESOLUTION);
+    }
+}
+
+static void VectorXY_Encode(CBitWrite &buf,
+                            const CSVCMsg_SendTable::sendprop_t &prop,
+                            const Vector &v) {
+    Float_Encode(buf, prop, v.x);
+    Float_Encode(buf, prop, v.y);
+}
+
+static void String_Encode(CBitWrite &buf, const char *pStr) {
+    int len = (int)strlen(pStr);
+    if (len >= DT_MAX_STRING_BUFFERSIZE) {
+        len = DT_MAX_STRING_BUFFERSIZE - 1;
+    }
+    buf.WriteUBitLong(len, DT_MAX_STRING_BITS);
+    buf.WriteBytes(pStr, len);
+}
+
+static void Int64_Encode(CBitWrite &buf, const CSVCMsg_SendTable::sendprop_t &prop, int64 val) {
+    int flags = prop.flags();
+    if (flags & SPROP_VARINT) {
+        if (flags & SPROP_UNSIGNED) {
+            buf.WriteVarInt64((uint64)val);
+        } else {
+            buf.WriteSignedVarInt64(val);
+        }
+    } else if (flags & SPROP_UNSIGNED) {
+        buf.WriteUBitLong((uint32)val, 32);
+        buf.WriteUBitLong((uint32)((uint64)val >> 32), prop.num_bits() - 32);
+    } else {
+        bool bNeg = val < 0;
+        uint64 magnitude = bNeg ? (uint64)(-val) : (uint64)val;
+        buf.WriteOneBit(bNeg);
+        buf.WriteUBitLong((uint32)magnitude, 32);
+        buf.WriteUBitLong((uint32)(magnitude >> 32), prop.num_bits() - 32 - 1);
+    }
+}
+
+static void RandomWord(char *pOut, int nMaxLen) {
+    int len = 1 + s_random.Range(nMaxLen - 1);
+    for (int i = 0; i < len; i++) {
+        pOut[i] = 'a' + s_random.Range(26);
+    }
+    pOut[len] = 0;
+}
+
+static void RandomProp_Encode(CBitWrite &buf, const CSVCMsg_SendTable::sendprop_t &prop);
+
+static void RandomArray_Encode(CBitWrite &buf, const GenFlatProp &flatProp) {
+    int maxElements = flatProp.m_pProp->num_elements();
+    int numBits = 1;
+    while ((maxElements >>= 1) != 0) {
+        numBits++;
+    }
+
+    int nElements = s_random.Range(flatProp.m_pProp->num_elements() + 1);
+    buf.WriteUBitLong(nElements, numBits);
+    for (int i = 0; i < nElements; i++) {
+        RandomProp_Encode(buf, *flatProp.m_pElementProp);
+    }
+}
+
+static float RandomFloatFor(const CSVCMsg_SendTable::sendprop_t &prop) {
+    int flags = prop.flags();
+    if (flags & (SPROP_COORD | SPROP_COORD_MP | SPROP_COORD_MP_LOWPRECISION |
+                 SPROP_COORD_MP_INTEGRAL)) {
+        return s_random.Float(-4096.0f, 4096.0f);
+    } else if (flags & SPROP_NORMAL) {
+        return s_random.Float(-1.0f, 1.0f);
+    } else if (flags &
+               (SPROP_CELL_COORD | SPROP_CELL_COORD_LOWPRECISION | SPROP_CELL_COORD_INTEGRAL)) {
+        return s_random.Float(0.0f, (float)((1 << prop.num_bits()) - 1));
+    } else if (flags & SPROP_NOSCALE) {
+        return s_random.Float(-1000.0f, 1000.0f);
+    }
+    return s_random.Float(prop.low_value(), prop.high_value());
+}
+
+static void RandomProp_Encode(CBitWrite &buf, const CSVCMsg_SendTable::sendprop_t &prop) {
+    switch (prop.type()) {
+    case DPT_Int:
+        Int_Encode(buf, prop, (prop.flags() & SPROP_VARINT) ? s_random.Range(5000) : s_random.Next());
+        break;
+    case DPT_Float:
+        Float_Encode(buf, prop, RandomFloatFor(prop));
+        break;
+    case DPT_Vector: {
+        Vector v;
+        v.Init(RandomFloatFor(prop), RandomFloatFor(prop), RandomFloatFor(prop));
+        if (prop.flags() & SPROP_NORMAL) {
+            v.x *= 0.7f;
+            v.y *= 0.7f;
+        }
+        Vector_Encode(buf, prop, v);
+    } break;
+    case DPT_VectorXY: {
+        Vector v;
+        v.Init(RandomFloatFor(prop), RandomFloatFor(prop), 0.0f);
+        VectorXY_Encode(buf, prop, v);
+    } break;
+    case DPT_String: {
+        char str[32];
+        RandomWord(str, sizeof(str) - 1);
+        String_Encode(buf, str);
+    } break;
+    case DPT_Int64:
+        Int64_Encode(buf, prop, (int64)(s_random.Next64() >> 1));
+        break;
+    default:
+        assert(0);
+        break;
+    }
+}
+
+static void RandomFlatProp_Encode(CBitWrite &buf, const GenFlatProp &flatProp) {
+    if (flatProp.m_pProp->type() == DPT_Array) {
+        RandomArray_Encode(buf, flatProp);
+    } else {
+        RandomProp_Encode(buf, *flatProp.m_pProp);
+    }
+}
+
+// inverse of ReadFieldIndex(..., bNewWay = true)
+static void WriteFieldIndex(CBitWrite &buf, int lastIndex, int index) {
+    int delta = (index == GEN_FIELD_INDEX_END) ? GEN_FIELD_INDEX_END : index - lastIndex - 1;
+    if (index != GEN_FIELD_INDEX_END && delta == 0) {
+        buf.WriteOneBit(1);
+        return;
+    }
+    buf.WriteOneBit(0);
+
+    if (delta < 8) {
+        buf.WriteOneBit(1);
+        buf.WriteUBitLong(delta, 3);
+        return;
+    }
+    buf.WriteOneBit(0);
+
+    if (delta < 32) {
+        buf.WriteUBitLong(delta, 7);
+    } else if (delta < 128) {
+        buf.WriteUBitLong((delta & 31) | 32, 7);
+        buf.WriteUBitLong(delta >> 5, 2);
+    } else if (delta < 512) {
+        buf.WriteUBitLong((delta & 31) | 64, 7);
+        buf.WriteUBitLong(delta >> 5, 4);
+    } else {
+        buf.WriteUBitLong((delta & 31) | 96, 7);
+        buf.WriteUBitLong(delta >> 5, 7);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// entities
+//-----------------------------------------------------------------------------
+struct GenPlayer {
+    int nUserID;
+    uint64 xuid;
+    int nTeam;
+    Vector origin;
+    float flPitch, flYaw, flVelocityZ;
+    int nHealth, nArmor, nMoney;
+    bool bScoped;
+};
+
+struct GenEntity {
+    int nEntity;
+    int nClass;
+    uint32 uSerialNum;
+    bool bEnterPVS; // not sent yet, goes out with all its props on the next update
+    bool bDelete;
+};
+
+static std::vector<GenPlayer> s_players;
+static std::vector<GenEntity> s_entities; // sorted by nEntity
+static int s_teamScores[2];
+static int s_nRoundsPlayed;
+
+// Field indices of the props the generator drives directly.
+static int s_nPlayerOrigin, s_nPlayerOriginZ, s_nPlayerPitch, s_nPlayerYaw, s_nPlayerVelocityZ;
+static int s_nPlayerTeam, s_nPlayerHealth, s_nPlayerArmor, s_nPlayerMoney, s_nPlayerScoped;
+static int s_nPlayerPlace;
+static int s_nTeamNum, s_nTeamScore;
+static int s_nGameRulesRoundStartTime, s_nGameRulesRoundsPlayed;
+
+static void WritePlayerProp(CBitWrite &buf, const GenPlayer &player, int nField) {
+    const CSVCMsg_SendTable::sendprop_t &prop =
+        *s_classes[GEN_CLASS_PLAYER].flattenedProps[nField].m_pProp;
+    if (nField == s_nPlayerOrigin) {
+        VectorXY_Encode(buf, prop, player.origin);
+    } else if (nField == s_nPlayerOriginZ) {
+        Float_Encode(buf, prop, player.origin.z);
+    } else if (nField == s_nPlayerPitch) {
+        Float_Encode(buf, prop, player.flPitch);
+    } else if (nField == s_nPlayerYaw) {
+        Float_Encode(buf, prop, player.flYaw);
+    } else if (nField == s_nPlayerVelocityZ) {
+        Float_Encode(buf, prop, player.flVelocityZ);
+    } else if (nField == s_nPlayerTeam) {
+        Int_Encode(buf, prop, player.nTeam);
+    } else if (nField == s_nPlayerHealth) {
+        Int_Encode(buf, prop, player.nHealth);
+    } else if (nField == s_nPlayerArmor) {
+        Int_Encode(buf, prop, player.nArmor);
+    } else if (nField == s_nPlayerMoney) {
+        Int_Encode(buf, prop, player.nMoney);
+    } else if (nField == s_nPlayerScoped) {
+        Int_Encode(buf, prop, player.bScoped ? 1 : 0);
+    } else if (nField == s_nPlayerPlace) {
+        static const char *s_places[] = {"BombsiteA", "BombsiteB", "Middle", "TSpawn", "CTSpawn"};
+        String_Encode(buf, s_places[s_random.Range(5)]);
+    } else {
+        RandomFlatProp_Encode(buf, s_classes[GEN_CLASS_PLAYER].flattenedProps[nField]);
+    }
+}
+
+static void WriteTeamProp(CBitWrite &buf, int nTeamNum, int nField) {
+    const CSVCMsg_SendTable::sendprop_t &prop =
+        *s_classes[GEN_CLASS_TEAM].flattenedProps[nField].m_pProp;
+    if (nField == s_nTeamNum) {
+        Int_Encode(buf, prop, nTeamNum);
+    } else if (nField == s_nTeamScore) {
+        Int_Encode(buf, prop, nTeamNum >= 2 ? s_teamScores[nTeamNum - 2] : 0);
+    } else {
+        static const char *s_teamNames[] = {"Unassigned", "Spectator", "TERRORIST", "CT"};
+        String_Encode(buf, s_teamNames[nTeamNum & 3]);
+    }
+}
+
+static float s_flRoundStartTime;
+
+static void WriteGameRulesProp(CBitWrite &buf, int nField) {
+    const CSVCMsg_SendTable::sendprop_t &prop =
+        *s_classes[GEN_CLASS_GAMERULES].flattenedProps[nField].m_pProp;
+    if (nField == s_nGameRulesRoundStartTime) {
+        Float_Encode(buf, prop, s_flRoundStartTime);
+    } else if (nField == s_nGameRulesRoundsPlayed) {
+        Int_Encode(buf, prop, s_nRoundsPlayed);
+    } else {
+        // m_bGameRestart, m_bWarmupPeriod
+        Int_Encode(buf, prop, 0);
+    }
+}
+
+// Writes the field index list followed by the values, as ReadNewEntity expects.
+static void WriteEntityProps(CBitWrite &buf, const GenEntity &entity, std::vector<int> &fields) {
+    buf.WriteOneBit(1); // new way
+    int lastIndex = -1;
+    for (size_t i = 0; i < fields.size(); i++) {
+        WriteFieldIndex(buf, lastIndex, fields[i]);
+        lastIndex = fields[i];
+    }
+    WriteFieldIndex(buf, lastIndex, GEN_FIELD_INDEX_END);
+
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (entity.nClass == GEN_CLASS_PLAYER) {
+            WritePlayerProp(buf, s_players[entity.nEntity - 1], fields[i]);
+        } else if (entity.nClass == GEN_CLASS_TEAM) {
+            WriteTeamProp(buf, entity.nEntity - s_players.size() - 1, fields[i]);
+        } else if (entity.nClass == GEN_CLASS_GAMERULES) {
+            WriteGameRulesProp(buf, fields[i]);
+        } else {
+            RandomFlatProp_Encode(buf, s_classes[entity.nClass].flattenedProps[fields[i]]);
+        }
+    }
+}
+
+static void AllFields(int nClass, std::vector<int> &fields) {
+    fields.clear();
+    for (size_t i = 0; i < s_classes[nClass].flattenedProps.size(); i++) {
+        fields.push_back((int)i);
+    }
+}
+
+static void RandomFields(int nClass, int nCount, std::vector<int> &fields) {
+    int nProps = (int)s_classes[nClass].flattenedProps.size();
+    std::vector<bool> chosen(nProps, false);
+    for (int i = 0; i < nCount && i < nProps; i++) {
+        int nField = s_random.Range(nProps);
+        while (chosen[nField]) {
+            nField = (nField + 1) % nProps;
+        }
+        chosen[nField] = true;
+    }
+    fields.clear();
+    for (int i = 0; i < nProps; i++) {
+        if (chosen[i]) {
+            fields.push_back(i);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// demo file framing
+//-----------------------------------------------------------------------------
+class CDemoFileWriter {
+public:
+    CDemoFileWriter() : m_fp(NULL), m_nBytesWritten(0), m_nSequence(0) {}
+
+    bool Open(const char *pName) {
+        m_fp = fopen(pName, "wb");
+        if (!m_fp) {
+            fprintf(stderr, "CDemoFileWriter::Open: couldn't open %s.\n", pName);
+            return false;
+        }
+        setvbuf(m_fp, NULL, _IOFBF, GEN_OUTPUT_BUFFER_SIZE);
+        return true;
+    }
+
+    void WriteDemoHeader(const demoheader_t &header) {
+        fseek(m_fp, 0, SEEK_SET);
+        fwrite(&header, 1, sizeof(header), m_fp);
+        if (m_nBytesWritten < sizeof(header)) {
+            m_nBytesWritten = sizeof(header);
+        }
+    }
+
+    void WriteCmdHeader(unsigned char cmd, int32 tick) {
+        unsigned char playerSlot = 0;
+        Write(&cmd, sizeof(cmd));
+        Write(&tick, sizeof(tick));
+        Write(&playerSlot, sizeof(playerSlot));
+    }
+
+    void WriteRawData(const void *pData, int32 length) {
+        Write(&length, sizeof(length));
+        Write(pData, length);
+    }
+
+    // dem_signon / dem_packet body: cmd info, sequence info, then the net messages
+    void WritePacket(unsigned char cmd, int32 tick, const std::string &data) {
+        WriteCmdHeader(cmd, tick);
+        char info[sizeof(democmdinfo_t)];
+        memset(info, 0, sizeof(info));
+        Write(info, sizeof(info));
+        int32 nSeqNrIn = ++m_nSequence, nSeqNrOut = m_nSequence;
+        Write(&nSeqNrIn, sizeof(nSeqNrIn));
+        Write(&nSeqNrOut, sizeof(nSeqNrOut));
+        WriteRawData(data.data(), (int32)data.size());
+    }
+
+    void Close() {
+        if (m_fp) {
+            fclose(m_fp);
+            m_fp = NULL;
+        }
+    }
+
+    uint64 BytesWritten() const { return m_nBytesWritten; }
+
+private:
+    void Write(const void *pData, size_t nBytes) {
+        fwrite(pData, 1, nBytes, m_fp);
+        m_nBytesWritten += nBytes;
+    }
+
+    FILE *m_fp;
+    uint64 m_nBytesWritten;
+    int32 m_nSequence;
+};
+
+static void AppendVarInt32(std::string &out, uint32 val) {
+    while (val > 0x7F) {
+        out.push_back((char)((val & 0x7F) | 0x80));
+        val >>= 7;
+    }
+    out.push_back((char)val);
+}
+
+// Collects net messages for one tick and splits them over several dem_packet frames
+// when they would not fit in the reader's NET_MAX_PAYLOAD buffer.
+class CPacketBuilder {
+public:
+    CPacketBuilder(CDemoFileWriter &writer) : m_writer(writer), m_cmd(dem_packet), m_tick(0) {}
+
+    void Begin(unsigned char cmd, int32 tick) {
+        m_cmd = cmd;
+        m_tick = tick;
+        m_data.clear();
+    }
+
+    void AddMessage(int nMsgType, const ::google::protobuf::Message &msg) {
+        std::string body;
+        msg.SerializeToString(&body);
+        if (!m_data.empty() && m_data.size() + body.size() + 10 > GEN_MAX_PACKET_BYTES) {
+            Flush();
+        }
+        AppendVarInt32(m_data, nMsgType);
+        AppendVarInt32(m_data, (uint32)body.size());
+        m_data += body;
+    }
+
+    void Flush() {
+        if (!m_data.empty()) {
+            m_writer.WritePacket(m_cmd, m_tick, m_data);
+            m_data.clear();
+        }
+    }
+
+private:
+    CDemoFileWriter &m_writer;
+    unsigned char m_cmd;
+    int32 m_tick;
+    std::string m_data;
+};
+
+//-----------------------------------------------------------------------------
+// signon: server info, game events, string tables, data tables
+//-----------------------------------------------------------------------------
+enum GenKeyType { kKey_String = 1, kKey_Float, kKey_Long, kKey_Short, kKey_Byte, kKey_Bool };
+
+enum GenEvent {
+    kEvent_PlayerDeath,
+    kEvent_PlayerHurt,
+    kEvent_WeaponFire,
+    kEvent_PlayerFootstep,
+    kEvent_PlayerJump,
+    kEvent_RoundStart,
+    kEvent_RoundEnd,
+    kEvent_RoundAnnounceMatchStart,
+    kEvent_SmokeDetonate,
+    kEvent_SmokeExpired,
+    kEvent_PlayerSpawn,
+    kEvent_RoundOfficiallyEnded,
+    kEvent_Count
+};
+
+static CSVCMsg_GameEventList s_eventList;
+
+static void AddEventDescriptor(int nEventID, const char *pName, const char *pKeys) {
+    // pKeys is a list of "<type char><name>" separated by spaces, s=string f=float l=long
+    // h=short b=byte o=bool
+    CSVCMsg_GameEventList::descriptor_t *pDescriptor = s_eventList.add_descriptors();
+    pDescriptor->set_eventid(nEventID);
+    pDescriptor->set_name(pName);
+
+    std::string keys(pKeys);
+    size_t pos = 0;
+    while (pos < keys.size()) {
+        size_t end = keys.find(' ', pos);
+        if (end == std::string::npos) {
+            end = keys.size();
+        }
+        static const char s_typeChars[] = " sflhbo";
+        CSVCMsg_GameEventList::key_t *pKey = pDescriptor->add_keys();
+        pKey->set_type((int)(strchr(s_typeChars, keys[pos]) - s_typeChars));
+        pKey->set_name(keys.substr(pos + 1, end - pos - 1));
+        pos = end + 1;
+    }
+}
+
+static void BuildEventList() {
+    AddEventDescriptor(kEvent_PlayerDeath, "player_death",
+                       "huserid hattacker hassister sweapon oheadshot hpenetrated");
+    AddEventDescriptor(kEvent_PlayerHurt, "player_hurt",
+                       "huserid hattacker bhealth barmor sweapon hdmg_health bdmg_armor bhitgroup");
+    AddEventDescriptor(kEvent_WeaponFire, "weapon_fire", "huserid sweapon osilenced");
+    AddEventDescriptor(kEvent_PlayerFootstep, "player_footstep", "huserid");
+    AddEventDescriptor(kEvent_PlayerJump, "player_jump", "huserid");
+    AddEventDescriptor(kEvent_RoundStart, "round_start", "ltimelimit lfraglimit sobjective");
+    AddEventDescriptor(kEvent_RoundEnd, "round_end", "bwinner breason smessage");
+    AddEventDescriptor(kEvent_RoundAnnounceMatchStart, "round_announce_match_start", "");
+    AddEventDescriptor(kEvent_SmokeDetonate, "smokegrenade_detonate", "huserid hentityid fx fy fz");
+    AddEventDescriptor(kEvent_SmokeExpired, "smokegrenade_expired", "huserid hentityid fx fy fz");
+    AddEventDescriptor(kEvent_PlayerSpawn, "player_spawn", "huserid hteamnum");
+    AddEventDescriptor(kEvent_RoundOfficiallyEnded, "round_officially_ended", "");
+}
+
+static void PlayerInfoFor(int nSlot, player_info_t &info) {
+    // userinfo user data is a raw player_info_t with a few big endian fields
+    memset(&info, 0, sizeof(info));
+    const GenPlayer &player = s_players[nSlot];
+    snprintf(info.name, sizeof(info.name), "Player%d", nSlot);
+    snprintf(info.guid, sizeof(info.guid), "STEAM_1:%d:%d", (int)(player.xuid & 1),
+             (int)((player.xuid - 76561197960265728ULL) >> 1));
+    info.entityID = nSlot;
+    uint64 xuid = player.xuid;
+    int32 userID = player.nUserID;
+    uint32 friendsID = (uint32)(player.xuid - 76561197960265728ULL);
+    for (size_t i = 0; i < sizeof(xuid); i++) {
+        ((unsigned char *)&info.xuid)[i] = ((unsigned char *)&xuid)[sizeof(xuid) - 1 - i];
+    }
+    for (size_t i = 0; i < sizeof(userID); i++) {
+        ((unsigned char *)&info.userID)[i] = ((unsigned char *)&userID)[sizeof(userID) - 1 - i];
+        ((unsigned char *)&info.friendsID)[i] =
+            ((unsigned char *)&friendsID)[sizeof(friendsID) - 1 - i];
+    }
+}
+
+struct GenStringTable {
+    std::string name;
+    int nMaxEntries;
+    int nEntries;
+};
+
+static std::vector<GenStringTable> s_stringTables; // [0] is userinfo
+
+static int EntryBits(int nMaxEntries) {
+    int nEntryBits = 0;
+    while (nMaxEntries >>= 1)
+        ++nEntryBits;
+    return nEntryBits;
+}
+
+static void StringTableEntryName(int nTable, int nEntry, char *pOut, int nMaxLen) {
+    if (nTable == 0) {
+        snprintf(pOut, nMaxLen, "%d", s_players[nEntry].nUserID);
+    } else {
+        snprintf(pOut, nMaxLen, "%s/entry_%d", s_stringTables[nTable].name.c_str(), nEntry);
+    }
+}
+
+// One entry of the svc_CreateStringTable / svc_UpdateStringTable payload.
+static void WriteStringTableEntry(CBitWrite &buf, int nTable, int nEntry) {
+    const GenStringTable &table = s_stringTables[nTable];
+    buf.WriteOneBit(0); // explicit index
+    buf.WriteUBitLong(nEntry, EntryBits(table.nMaxEntries));
+    buf.WriteOneBit(1); // has string
+    buf.WriteOneBit(0); // no substring
+    char entry[64];
+    StringTableEntryName(nTable, nEntry, entry, sizeof(entry));
+    buf.WriteString(entry);
+
+    if (nTable == 0) {
+        player_info_t info;
+        PlayerInfoFor(nEntry, info);
+        buf.WriteOneBit(1);
+        buf.WriteUBitLong(sizeof(info), MAX_USERDATA_BITS);
+        buf.WriteBytes(&info, sizeof(info));
+    } else {
+        buf.WriteOneBit(0);
+    }
+}
+
+static std::string BitsToString(const CBitWrite &buf) {
+    return std::string((const char *)buf.GetData(), buf.GetNumBytesWritten());
+}
+
+static void WriteCreateStringTables(CPacketBuilder &packet) {
+    for (size_t i = 0; i < s_stringTables.size(); i++) {
+        const GenStringTable &table = s_stringTables[i];
+        CBitWrite buf;
+        buf.WriteOneBit(0); // no dictionaries
+        for (int j = 0; j < table.nEntries; j++) {
+            WriteStringTableEntry(buf, (int)i, j);
+        }
+
+        CSVCMsg_CreateStringTable msg;
+        msg.set_name(table.name);
+        msg.set_max_entries(table.nMaxEntries);
+        msg.set_num_entries(table.nEntries);
+        msg.set_user_data_fixed_size(false);
+        msg.set_user_data_size(0);
+        msg.set_user_data_size_bits(0);
+        msg.set_flags(0);
+        msg.set_string_data(BitsToString(buf));
+        packet.AddMessage(svc_CreateStringTable, msg);
+    }
+}
+
+// dem_stringtables snapshot, as read by DumpStringTables
+static void WriteStringTablesFrame(CDemoFileWriter &writer, int32 tick) {
+    CBitWrite buf;
+    buf.WriteByte((int)s_stringTables.size());
+    for (size_t i = 0; i < s_stringTables.size(); i++) {
+        const GenStringTable &table = s_stringTables[i];
+        buf.WriteString(table.name.c_str());
+        buf.WriteWord(table.nEntries);
+        for (int j = 0; j < table.nEntries; j++) {
+            char entry[64];
+            StringTableEntryName((int)i, j, entry, sizeof(entry));
+            buf.WriteString(entry);
+            if (i == 0) {
+                player_info_t info;
+                PlayerInfoFor(j, info);
+                buf.WriteOneBit(1);
+                buf.WriteWord(sizeof(info));
+                buf.WriteBytes(&info, sizeof(info));
+            } else {
+                buf.WriteOneBit(0);
+            }
+        }
+        buf.WriteOneBit(0); // no client side entries
+    }
+
+    writer.WriteCmdHeader(dem_stringtables, tick);
+    writer.WriteRawData(buf.GetData(), buf.GetNumBytesWritten());
+}
+
+// dem_datatables, as read by ParseDataTable
+static void WriteDataTablesFrame(CDemoFileWriter &writer, int32 tick) {
+    CBitWrite buf;
+    for (size_t i = 0; i <= s_tables.size(); i++) {
+        CSVCMsg_SendTable endTable;
+        endTable.set_is_end(true);
+        const CSVCMsg_SendTable &table = (i < s_tables.size()) ? s_tables[i] : endTable;
+
+        std::string body;
+        table.SerializeToString(&body);
+        buf.WriteVarInt32(svc_SendTable);
+        buf.WriteVarInt32((uint32)body.size());
+        buf.WriteBytes(body.data(), (int)body.size());
+    }
+
+    buf.WriteShort((int)s_classes.size());
+    for (size_t i = 0; i < s_classes.size(); i++) {
+        buf.WriteShort((int)i);
+        buf.WriteString(s_classes[i].strName.c_str());
+        buf.WriteString(s_classes[i].strDTName.c_str());
+    }
+
+    writer.WriteCmdHeader(dem_datatables, tick);
+    writer.WriteRawData(buf.GetData(), buf.GetNumBytesWritten());
+}
+
+//-----------------------------------------------------------------------------
+// per tick traffic
+//-----------------------------------------------------------------------------
+struct GenSmoke {
+    int nEntity;
+    int nUserID;
+    Vector pos;
+    int nExpireTick;
+};
+
+static std::vector<GenSmoke> s_smokes;
+
+static void AddEventKey(CSVCMsg_GameEvent &msg, int type, int val) {
+    CSVCMsg_GameEvent::key_t *pKey = msg.add_keys();
+    pKey->set_type(type);
+    switch (type) {
+    case kKey_Long:
+        pKey->set_val_long(val);
+        break;
+    case kKey_Short:
+        pKey->set_val_short(val);
+        break;
+    case kKey_Byte:
+        pKey->set_val_byte(val);
+        break;
+    case kKey_Bool:
+        pKey->set_val_bool(val != 0);
+        break;
+    }
+}
+
+static void AddEventString(CSVCMsg_GameEvent &msg, const char *pVal) {
+    CSVCMsg_GameEvent::key_t *pKey = msg.add_keys();
+    pKey->set_type(kKey_String);
+    pKey->set_val_string(pVal);
+}
+
+static void AddEventFloat(CSVCMsg_GameEvent &msg, float val) {
+    CSVCMsg_GameEvent::key_t *pKey = msg.add_keys();
+    pKey->set_type(kKey_Float);
+    pKey->set_val_float(val);
+}
+
+static const char *RandomWeapon() {
+    static const char *s_weapons[] = {"ak47", "m4a1", "awp", "deagle", "glock", "usp_silencer",
+                                      "ssg08", "mp9", "famas", "galilar"};
+    return s_weapons[s_random.Range(sizeof(s_weapons) / sizeof(s_weapons[0]))];
+}
+
+static int RandomUserID() {
+    return s_players.empty() ? 0 : s_players[s_random.Range((int)s_players.size())].nUserID;
+}
+
+static void AddSmokeEvent(CPacketBuilder &packet, int nEvent, const GenSmoke &smoke) {
+    CSVCMsg_GameEvent msg;
+    msg.set_eventid(nEvent);
+    AddEventKey(msg, kKey_Short, smoke.nUserID);
+    AddEventKey(msg, kKey_Short, smoke.nEntity);
+    AddEventFloat(msg, smoke.pos.x);
+    AddEventFloat(msg, smoke.pos.y);
+    AddEventFloat(msg, smoke.pos.z);
+    packet.AddMessage(svc_GameEvent, msg);
+}
+
+static void AddSimpleEvent(CPacketBuilder &packet, int nEvent) {
+    CSVCMsg_GameEvent msg;
+    msg.set_eventid(nEvent);
+    packet.AddMessage(svc_GameEvent, msg);
+}
+
+static int s_nFirstSmokeEntity;
+
+// Smoke projectiles get the lowest free entity number above the static entities and are
+// inserted into s_entities in order.
+static int AllocSmokeEntity() {
+    std::vector<GenEntity>::iterator it = s_entities.begin();
+    int nEntity = s_nFirstSmokeEntity;
+    for (; it != s_entities.end() && it->nEntity <= nEntity; ++it) {
+        if (it->nEntity == nEntity) {
+            nEntity++;
+        }
+    }
+    if (nEntity >= MAX_EDICTS) {
+        return -1;
+    }
+    GenEntity entity = {nEntity, GEN_CLASS_SMOKE, (uint32)s_random.Range(1024), true, false};
+    s_entities.insert(it, entity);
+    return nEntity;
+}
+
+static GenEntity *FindGenEntity(int nEntity) {
+    for (size_t i = 0; i < s_entities.size(); i++) {
+        if (s_entities[i].nEntity == nEntity) {
+            return &s_entities[i];
+        }
+    }
+    return NULL;
+}
+
+static void AddRandomEvent(CPacketBuilder &packet, int tick, const GenOptions &options) {
+    if (s_players.empty()) {
+        return;
+    }
+
+    CSVCMsg_GameEvent msg;
+    int roll = s_random.Range(100);
+    if (roll < 45) {
+        msg.set_eventid(kEvent_WeaponFire);
+        AddEventKey(msg, kKey_Short, RandomUserID());
+        AddEventString(msg, RandomWeapon());
+        AddEventKey(msg, kKey_Bool, s_random.Range(2));
+    } else if (roll < 70) {
+        msg.set_eventid(kEvent_PlayerFootstep);
+        AddEventKey(msg, kKey_Short, RandomUserID());
+    } else if (roll < 85) {
+        msg.set_eventid(kEvent_PlayerHurt);
+        AddEventKey(msg, kKey_Short, RandomUserID());
+        AddEventKey(msg, kKey_Short, RandomUserID());
+        AddEventKey(msg, kKey_Byte, s_random.Range(100));
+        AddEventKey(msg, kKey_Byte, s_random.Range(100));
+        AddEventString(msg, RandomWeapon());
+        AddEventKey(msg, kKey_Short, 1 + s_random.Range(100));
+        AddEventKey(msg, kKey_Byte, s_random.Range(20));
+        AddEventKey(msg, kKey_Byte, s_random.Range(8));
+    } else if (roll < 93) {
+        msg.set_eventid(kEvent_PlayerJump);
+        AddEventKey(msg, kKey_Short, RandomUserID());
+    } else if (roll < 97) {
+        msg.set_eventid(kEvent_PlayerDeath);
+        AddEventKey(msg, kKey_Short, RandomUserID());
+        AddEventKey(msg, kKey_Short, RandomUserID());
+        AddEventKey(msg, kKey_Short, s_random.Range(4) ? 0 : RandomUserID());
+        AddEventString(msg, RandomWeapon());
+        AddEventKey(msg, kKey_Bool, s_random.Range(2));
+        AddEventKey(msg, kKey_Short, 0);
+    } else {
+        int nEntity = AllocSmokeEntity();
+        if (nEntity < 0) {
+            return;
+        }
+        GenSmoke smoke;
+        smoke.nEntity = nEntity;
+        smoke.nUserID = RandomUserID();
+        smoke.pos.Init(s_random.Float(-2048.0f, 2048.0f), s_random.Float(-2048.0f, 2048.0f),
+                       s_random.Float(-64.0f, 256.0f));
+        smoke.nExpireTick = tick + (int)(GEN_SMOKE_DURATION * options.nTickRate);
+        s_smokes.push_back(smoke);
+        AddSmokeEvent(packet, kEvent_SmokeDetonate, smoke);
+        return;
+    }
+    packet.AddMessage(svc_GameEvent, msg);
+}
+
+static void AddStringTableUpdate(CPacketBuilder &packet) {
+    int nTable = s_random.Range(4) == 0 ? 0 : s_random.Range((int)s_stringTables.size());
+    if (s_stringTables[nTable].nEntries == 0) {
+        return;
+    }
+    CBitWrite buf;
+    buf.WriteOneBit(0); // no dictionaries
+    WriteStringTableEntry(buf, nTable, s_random.Range(s_stringTables[nTable].nEntries));
+
+    CSVCMsg_UpdateStringTable msg;
+    msg.set_table_id(nTable);
+    msg.set_num_changed_entries(1);
+    msg.set_string_data(BitsToString(buf));
+    packet.AddMessage(svc_UpdateStringTable, msg);
+}
+
+static void WriteEntityHeader(CBitWrite &buf, int &nLastEntity, int nEntity) {
+    buf.WriteUBitVar(nEntity - nLastEntity - 1);
+    nLastEntity = nEntity;
+}
+
+static void AddPacketEntities(CPacketBuilder &packet,
+                              const CBitWrite &buf,
+                              int nUpdated,
+                              bool bDelta) {
+    CSVCMsg_PacketEntities msg;
+    msg.set_max_entries(MAX_EDICTS);
+    msg.set_updated_entries(nUpdated);
+    msg.set_is_delta(bDelta);
+    msg.set_update_baseline(false);
+    msg.set_baseline(0);
+    msg.set_delta_from(bDelta ? 1 : -1);
+    msg.set_entity_data(BitsToString(buf));
+    packet.AddMessage(svc_PacketEntities, msg);
+}
+
+static void WriteFullUpdate(CPacketBuilder &packet) {
+    std::vector<int> fields;
+    for (size_t start = 0; start < s_entities.size(); start += GEN_FULL_UPDATE_CHUNK) {
+        CBitWrite buf;
+        int nLastEntity = -1;
+        size_t end = std::min(start + GEN_FULL_UPDATE_CHUNK, s_entities.size());
+        for (size_t i = start; i < end; i++) {
+            const GenEntity &entity = s_entities[i];
+            WriteEntityHeader(buf, nLastEntity, entity.nEntity);
+            buf.WriteOneBit(0); // no leave pvs
+            buf.WriteOneBit(1); // enter pvs
+            buf.WriteUBitLong(entity.nClass, s_nClassBits);
+            buf.WriteUBitLong(entity.uSerialNum, NUM_NETWORKED_EHANDLE_SERIAL_NUMBER_BITS);
+            AllFields(entity.nClass, fields);
+            WriteEntityProps(buf, entity, fields);
+        }
+        AddPacketEntities(packet, buf, (int)(end - start), false);
+    }
+}
+
+static void MovePlayers(const GenOptions &options) {
+    float flStep = 250.0f / options.nTickRate;
+    for (size_t i = 0; i < s_players.size(); i++) {
+        GenPlayer &player = s_players[i];
+        player.origin.x += s_random.Float(-flStep, flStep);
+        player.origin.y += s_random.Float(-flStep, flStep);
+        player.flYaw = fmodf(player.flYaw + s_random.Float(-2.0f, 2.0f) + 360.0f, 360.0f);
+        player.flPitch = s_random.Float(-10.0f, 10.0f);
+        player.flVelocityZ = s_random.Range(64) == 0 ? 250.0f : 0.0f;
+        player.origin.z += player.flVelocityZ / options.nTickRate;
+    }
+}
+
+
+// Team scores and round start time the next update has to carry.
+static bool s_bTeamsChanged;
+static bool s_bGameRulesChanged;
+
+static void WriteDeltaUpdate(CPacketBuilder &packet, const GenOptions &options) {
+    CBitWrite buf;
+    std::vector<int> fields;
+    int nLastEntity = -1;
+    int nUpdated = 0;
+
+    std::vector<GenEntity> remaining;
+    remaining.reserve(s_entities.size());
+    for (size_t i = 0; i < s_entities.size(); i++) {
+        GenEntity &entity = s_entities[i];
+        if (entity.bDelete) {
+            WriteEntityHeader(buf, nLastEntity, entity.nEntity);
+            buf.WriteOneBit(1); // leave pvs
+            buf.WriteOneBit(1); // and delete
+            nUpdated++;
+            continue;
+        }
+        remaining.push_back(entity);
+
+        if (entity.bEnterPVS) {
+            remaining.back().bEnterPVS = false;
+            WriteEntityHeader(buf, nLastEntity, entity.nEntity);
+            buf.WriteOneBit(0); // no leave pvs
+            buf.WriteOneBit(1); // enter pvs
+            buf.WriteUBitLong(entity.nClass, s_nClassBits);
+            buf.WriteUBitLong(entity.uSerialNum, NUM_NETWORKED_EHANDLE_SERIAL_NUMBER_BITS);
+            AllFields(entity.nClass, fields);
+            WriteEntityProps(buf, entity, fields);
+            nUpdated++;
+            continue;
+        }
+
+        fields.clear();
+        if (entity.nClass == GEN_CLASS_PLAYER) {
+            fields.push_back(s_nPlayerOrigin);
+            fields.push_back(s_nPlayerOriginZ);
+            fields.push_back(s_nPlayerPitch);
+            fields.push_back(s_nPlayerYaw);
+            fields.push_back(s_nPlayerVelocityZ);
+            if (s_random.Range(options.nTickRate) == 0) {
+                fields.push_back(s_nPlayerMoney);
+                fields.push_back(s_nPlayerScoped);
+                fields.push_back(s_nPlayerPlace);
+            }
+        } else if (entity.nClass == GEN_CLASS_TEAM) {
+            if (s_bTeamsChanged) {
+                fields.push_back(s_nTeamScore);
+            }
+        } else if (entity.nClass == GEN_CLASS_GAMERULES) {
+            if (s_bGameRulesChanged) {
+                fields.push_back(s_nGameRulesRoundStartTime);
+                fields.push_back(s_nGameRulesRoundsPlayed);
+            }
+        } else if (entity.nClass != GEN_CLASS_SMOKE) {
+            RandomFields(entity.nClass, options.nChangesPerTick, fields);
+        }
+        if (fields.empty()) {
+            continue;
+        }
+        WriteEntityHeader(buf, nLastEntity, entity.nEntity);
+        buf.WriteOneBit(0); // no leave pvs
+        buf.WriteOneBit(0); // no enter pvs -> delta
+        WriteEntityProps(buf, entity, fields);
+        nUpdated++;
+    }
+    s_entities.swap(remaining);
+    s_bTeamsChanged = s_bGameRulesChanged = false;
+
+    if (nUpdated) {
+        AddPacketEntities(packet, buf, nUpdated, true);
+    }
+}
+
+static void ExpireSmokes(CPacketBuilder &packet, int tick) {
+    for (size_t i = 0; i < s_smokes.size();) {
+        if (s_smokes[i].nExpireTick > tick) {
+            i++;
+            continue;
+        }
+        AddSmokeEvent(packet, kEvent_SmokeExpired, s_smokes[i]);
+        GenEntity *pEntity = FindGenEntity(s_smokes[i].nEntity);
+        if (pEntity) {
+            pEntity->bDelete = true;
+        }
+        s_smokes[i] = s_smokes.back();
+        s_smokes.pop_back();
+    }
+}
+
+static void UpdateRound(CPacketBuilder &packet, int tick, const GenOptions &options) {
+    int nRoundTicks = options.nRoundSeconds * options.nTickRate;
+    if (nRoundTicks <= 0) {
+        return;
+    }
+    int nOffset = tick % nRoundTicks;
+    if (nOffset == 0) {
+        if (tick == 0) {
+            AddSimpleEvent(packet, kEvent_RoundAnnounceMatchStart);
+        }
+        CSVCMsg_GameEvent msg;
+        msg.set_eventid(kEvent_RoundStart);
+        AddEventKey(msg, kKey_Long, options.nRoundSeconds);
+        AddEventKey(msg, kKey_Long, 0);
+        AddEventString(msg, "BOMB TARGET");
+        packet.AddMessage(svc_GameEvent, msg);
+
+        for (size_t i = 0; i < s_players.size(); i++) {
+            GenPlayer &player = s_players[i];
+            player.nHealth = 100;
+            CSVCMsg_GameEvent spawn;
+            spawn.set_eventid(kEvent_PlayerSpawn);
+            AddEventKey(spawn, kKey_Short, player.nUserID);
+            AddEventKey(spawn, kKey_Short, player.nTeam);
+            packet.AddMessage(svc_GameEvent, spawn);
+        }
+
+        s_flRoundStartTime = (float)tick / options.nTickRate;
+        s_bGameRulesChanged = true;
+    } else if (nOffset == nRoundTicks - 7 * options.nTickRate) {
+        int nWinner = 2 + s_random.Range(2);
+        s_teamScores[nWinner - 2]++;
+        s_nRoundsPlayed++;
+        s_bTeamsChanged = s_bGameRulesChanged = true;
+
+        CSVCMsg_GameEvent msg;
+        msg.set_eventid(kEvent_RoundEnd);
+        AddEventKey(msg, kKey_Byte, nWinner);
+        AddEventKey(msg, kKey_Byte, nWinner == 2 ? 9 : 8);
+        AddEventString(msg, nWinner == 2 ? "#SFUI_Notice_Terrorists_Win" : "#SFUI_Notice_CTs_Win");
+        packet.AddMessage(svc_GameEvent, msg);
+    } else if (nOffset == nRoundTicks - 1) {
+        AddSimpleEvent(packet, kEvent_RoundOfficiallyEnded);
+    }
+}
+
+static void InitEntities(const GenOptions &options) {
+    for (int i = 0; i < options.nPlayers; i++) {
+        GenPlayer player;
+        player.nUserID = i + 2;
+        player.xuid = 76561197960265728ULL + 2 * (10000 + i) + (i & 1);
+        player.nTeam = (i & 1) ? 3 : 2;
+        player.origin.Init(s_random.Float(-1024.0f, 1024.0f), s_random.Float(-1024.0f, 1024.0f),
+                           0.0f);
+        player.flPitch = 0.0f;
+        player.flYaw = s_random.Float(0.0f, 360.0f);
+        player.flVelocityZ = 0.0f;
+        player.nHealth = 100;
+        player.nArmor = 100;
+        player.nMoney = 800;
+        player.bScoped = false;
+        s_players.push_back(player);
+    }
+
+    int nEntity = 1;
+    for (int i = 0; i < options.nPlayers; i++) {
+        GenEntity entity = {nEntity++, GEN_CLASS_PLAYER, (uint32)s_random.Range(1024), false, false};
+        s_entities.push_back(entity);
+    }
+    for (int team = 0; team < 4; team++) {
+        GenEntity entity = {nEntity++, GEN_CLASS_TEAM, (uint32)s_random.Range(1024), false, false};
+        s_entities.push_back(entity);
+    }
+    GenEntity gamerules = {nEntity++, GEN_CLASS_GAMERULES, (uint32)s_random.Range(1024), false,
+                           false};
+    s_entities.push_back(gamerules);
+
+    int nSyntheticClasses = (int)s_classes.size() - GEN_CLASS_FIRST;
+    nEntity = std::max(nEntity, GEN_FIRST_SYNTHETIC_ENTITY);
+    for (int i = 0; i < options.nEntities && nSyntheticClasses > 0 && nEntity < MAX_EDICTS; i++) {
+        GenEntity entity = {nEntity++, GEN_CLASS_FIRST + i % nSyntheticClasses,
+                            (uint32)s_random.Range(1024), false, false};
+        s_entities.push_back(entity);
+    }
+    s_nFirstSmokeEntity = nEntity;
+
+    s_nPlayerOrigin = FindFlatProp(GEN_CLASS_PLAYER, "m_vecOrigin");
+    s_nPlayerOriginZ = FindFlatProp(GEN_CLASS_PLAYER, "m_vecOrigin[2]");
+    s_nPlayerPitch = FindFlatProp(GEN_CLASS_PLAYER, "m_angEyeAngles[0]");
+    s_nPlayerYaw = FindFlatProp(GEN_CLASS_PLAYER, "m_angEyeAngles[1]");
+    s_nPlayerVelocityZ = FindFlatProp(GEN_CLASS_PLAYER, "m_vecVelocity[2]");
+    s_nPlayerTeam = FindFlatProp(GEN_CLASS_PLAYER, "m_iTeamNum");
+    s_nPlayerHealth = FindFlatProp(GEN_CLASS_PLAYER, "m_iHealth");
+    s_nPlayerArmor = FindFlatProp(GEN_CLASS_PLAYER, "m_ArmorValue");
+    s_nPlayerMoney = FindFlatProp(GEN_CLASS_PLAYER, "m_iAccount");
+    s_nPlayerScoped = FindFlatProp(GEN_CLASS_PLAYER, "m_bIsScoped");
+    s_nPlayerPlace = FindFlatProp(GEN_CLASS_PLAYER, "m_szLastPlaceName");
+    s_nTeamNum = FindFlatProp(GEN_CLASS_TEAM, "m_iTeamNum");
+    s_nTeamScore = FindFlatProp(GEN_CLASS_TEAM, "m_scoreTotal");
+    s_nGameRulesRoundStartTime = FindFlatProp(GEN_CLASS_GAMERULES, "m_fRoundStartTime");
+    s_nGameRulesRoundsPlayed = FindFlatProp(GEN_CLASS_GAMERULES, "m_totalRoundsPlayed");
+}
+
+static void InitStringTables(const GenOptions &options) {
+    GenStringTable userinfo = {"userinfo", GEN_USERINFO_MAX_ENTRIES, (int)s_players.size()};
+    s_stringTables.push_back(userinfo);
+
+    int nMaxEntries = 1;
+    while (nMaxEntries < options.nStringsPerTable) {
+        nMaxEntries <<= 1;
+    }
+    for (int i = 0; i < options.nStringTables; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "gentable%d", i);
+        GenStringTable table = {name, nMaxEntries, options.nStringsPerTable};
+        s_stringTables.push_back(table);
+    }
+}
+
+static bool Generate(const char *pFileName, const GenOptions &options) {
+    CDemoFileWriter writer;
+    if (!writer.Open(pFileName)) {
+        return false;
+    }
+
+    demoheader_t header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.demofilestamp, DEMO_HEADER_ID);
+    header.demoprotocol = DEMO_PROTOCOL;
+    header.networkprotocol = 13500;
+    strcpy(header.servername, "demoinfogo_gen");
+    strcpy(header.clientname, "GOTV Demo");
+    snprintf(header.mapname, sizeof(header.mapname), "%s", options.pMapName);
+    strcpy(header.gamedirectory, "csgo");
+    writer.WriteDemoHeader(header);
+
+    CPacketBuilder packet(writer);
+
+    // signon
+    packet.Begin(dem_signon, 0);
+    CSVCMsg_ServerInfo serverInfo;
+    serverInfo.set_protocol(header.networkprotocol);
+    serverInfo.set_max_clients(std::max(options.nPlayers, 1));
+    serverInfo.set_max_classes((int)s_classes.size());
+    serverInfo.set_tick_interval(1.0f / options.nTickRate);
+    serverInfo.set_game_dir("csgo");
+    serverInfo.set_map_name(options.pMapName);
+    serverInfo.set_host_name("demoinfogo_gen");
+    packet.AddMessage(svc_ServerInfo, serverInfo);
+    packet.AddMessage(svc_GameEventList, s_eventList);
+    packet.Flush();
+
+    WriteDataTablesFrame(writer, 0);
+
+    packet.Begin(dem_signon, 0);
+    WriteCreateStringTables(packet);
+    packet.Flush();
+
+    WriteStringTablesFrame(writer, 0);
+    writer.WriteCmdHeader(dem_synctick, 0);
+    header.signonlength = (int32)(writer.BytesWritten() - sizeof(header));
+
+    // game
+    uint64 nTargetBytes = (uint64)options.nSizeMB * 1024 * 1024;
+    float flEvents = 0.0f, flStringUpdates = 0.0f;
+    int tick = 0;
+    int nFrames = 0;
+    for (;; tick++) {
+        if (nTargetBytes ? writer.BytesWritten() >= nTargetBytes : tick >= options.nTicks) {
+            break;
+        }
+
+        packet.Begin(dem_packet, tick);
+        if (tick == 0) {
+            WriteFullUpdate(packet);
+        } else {
+            MovePlayers(options);
+        }
+
+        UpdateRound(packet, tick, options);
+        ExpireSmokes(packet, tick);
+        for (flEvents += options.flEventsPerSecond / options.nTickRate; flEvents >= 1.0f;
+             flEvents -= 1.0f) {
+            AddRandomEvent(packet, tick, options);
+        }
+        for (flStringUpdates += options.flStringUpdatesPerSecond / options.nTickRate;
+             flStringUpdates >= 1.0f; flStringUpdates -= 1.0f) {
+            AddStringTableUpdate(packet);
+        }
+        if (tick != 0) {
+            WriteDeltaUpdate(packet, options);
+        }
+        packet.Flush();
+        nFrames++;
+    }
+
+    writer.WriteCmdHeader(dem_stop, tick);
+
+    header.playback_ticks = tick;
+    header.playback_frames = nFrames;
+    header.playback_time = (float)tick / options.nTickRate;
+    writer.WriteDemoHeader(header);
+    writer.Close();
+
+    fprintf(stderr, "%s: %d ticks, %d entities, %d classes, %llu bytes\n", pFileName, tick,
+            (int)s_entities.size(), (int)s_classes.size(),
+            (unsigned long long)writer.BytesWritten());
+    return true;
+}
+
+static bool ParseEncodings(const char *pList, std::vector<int> &encodings) {
+    encodings.clear();
+    std::string list(pList);
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string name = list.substr(pos, end - pos);
+        int encoding = 0;
+        while (encoding < kEnc_Count && strcasecmp(s_encodingNames[encoding], name.c_str()) != 0) {
+            encoding++;
+        }
+        if (encoding == kEnc_Count) {
+            fprintf(stderr, "unknown encoding %s\n", name.c_str());
+            return false;
+        }
+        encodings.push_back(encoding);
+        pos = end + 1;
+    }
+    return !encodings.empty();
+}
+
+int main(int argc, char *argv[]) {
+    GenOptions options;
+
+    if (argc <= 1) {
+        printf("demoinfogo_gen out.dem\n");
+        printf("optional arguments:\n"
+               " -seed N            Random seed. (1)\n"
+               " -ticks N           Number of ticks to generate. (7680)\n"
+               " -size MB           Generate ticks until the file is this big, overrides -ticks.\n"
+               " -tickrate N        Ticks per second. (128)\n"
+               " -players N         Number of players. (10)\n"
+               " -classes N         Number of synthetic server classes. (16)\n"
+               " -props N           Props per synthetic server class. (24)\n"
+               " -encodings a,b,... Prop encodings the synthetic classes cycle through, any of\n"
+               "                    int sint varint float coord coordmp cellcoord normal\n"
+               "                    noscale vector vectornormal vectorxy string array int64.\n"
+               "                    (all of them)\n"
+               " -entities N        Number of synthetic entities. (200)\n"
+               " -changes N         Props changed per synthetic entity per tick. (4)\n"
+               " -events N          Game events per second. (20)\n"
+               " -stringtables N    String tables besides userinfo. (4)\n"
+               " -strings N         Entries per string table. (64)\n"
+               " -stringupdates N   String table updates per second. (1)\n"
+               " -round N           Round length in seconds, 0 for no rounds. (115)\n"
+               " -map name          Map name. (de_synthetic)\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < kEnc_Count; i++) {
+        options.encodings.push_back(i);
+    }
+
+    int nFileArgument = 1;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && i + 1 < argc) {
+            const char *pName = &argv[i][1];
+            const char *pValue = argv[++i];
+            if (strcasecmp(pName, "seed") == 0) {
+                options.nSeed = strtoul(pValue, NULL, 10);
+            } else if (strcasecmp(pName, "ticks") == 0) {
+                options.nTicks = atoi(pValue);
+            } else if (strcasecmp(pName, "size") == 0) {
+                options.nSizeMB = atoi(pValue);
+            } else if (strcasecmp(pName, "tickrate") == 0) {
+                options.nTickRate = std::max(atoi(pValue), 1);
+            } else if (strcasecmp(pName, "players") == 0) {
+                options.nPlayers = std::min(std::max(atoi(pValue), 0), 64);
+            } else if (strcasecmp(pName, "classes") == 0) {
+                options.nClasses = std::min(std::max(atoi(pValue), 0), 4000);
+            } else if (strcasecmp(pName, "props") == 0) {
+                options.nProps = std::min(std::max(atoi(pValue), 0), 2000);
+            } else if (strcasecmp(pName, "encodings") == 0) {
+                if (!ParseEncodings(pValue, options.encodings)) {
+                    exit(1);
+                }
+            } else if (strcasecmp(pName, "entities") == 0) {
+                options.nEntities = std::max(atoi(pValue), 0);
+            } else if (strcasecmp(pName, "changes") == 0) {
+                options.nChangesPerTick = std::max(atoi(pValue), 0);
+            } else if (strcasecmp(pName, "events") == 0) {
+                options.flEventsPerSecond = atof(pValue);
+            } else if (strcasecmp(pName, "stringtables") == 0) {
+                options.nStringTables = std::min(std::max(atoi(pValue), 0), MAX_STRING_TABLES - 1);
+            } else if (strcasecmp(pName, "strings") == 0) {
+                options.nStringsPerTable = std::min(std::max(atoi(pValue), 1), 65535);
+            } else if (strcasecmp(pName, "stringupdates") == 0) {
+                options.flStringUpdatesPerSecond = atof(pValue);
+            } else if (strcasecmp(pName, "round") == 0) {
+                options.nRoundSeconds = std::max(atoi(pValue), 0);
+            } else if (strcasecmp(pName, "map") == 0) {
+                options.pMapName = pValue;
+            } else {
+                fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+                exit(1);
+            }
+        } else {
+            nFileArgument = i;
+        }
+    }
+
+    s_random.Seed(options.nSeed);
+    BuildSchema(options);
+    BuildEventList();
+    InitEntities(options);
+    InitStringTables(options);
+
+    return Generate(argv[nFileArgument], options) ? 0 : 1;
+}
@@ -0,0 +1,629 @@
+// -serve: one long lived process parsing demos on request.
+//
+// The parser keeps its state in file globals, so requests run in worker processes rather than
+// threads: the dispatcher reads requests from stdin or socket connections, queues them and hands
+// each to an idle worker over a pipe, and the worker parses the demo, writes the output file and
+// sends back the reply line. Workers are forked after startup, so protobuf and libc setup are
+// paid once, and they live for many requests, so their allocations and data tables are reused.
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <thread>
+#include <json_spirit_reader.h>
+#include <json_spirit_writer.h>
+#include "demofiledump.h"
+#include "demoserve.h"
+#if defined(_WIN32) || defined(_WIN64)
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+
+int ServeDemos(const char *pSocketPath, int nWorkers, ApplyOptionsFn applyOptions) {
+    fprintf(stderr, "-serve isn't supported on Windows.\n");
+    return 1;
+}
+
+#else
+
+// replies queued for a client that isn't reading them, past which it's dropped
+#define SERVE_MAX_QUEUED_REPLY_BYTES (1 << 20)
+
+struct ServeRequest {
+    json_spirit::mValue id;
+    std::string demo;
+    std::string output;
+    std::vector<std::string> flags;
+};
+
+static bool ParseRequest(const std::string &line, ServeRequest &request, std::string &error) {
+    json_spirit::mValue value;
+    if (!json_spirit::read(line, value) || value.type() != json_spirit::obj_type) {
+        error = "request isn't a JSON object";
+        return false;
+    }
+
+    const json_spirit::mObject &object = value.get_obj();
+    json_spirit::mObject::const_iterator it = object.find("id");
+    if (it != object.end())
+        request.id = it->second;
+
+    it = object.find("demo");
+    if (it == object.end() || it->second.type() != json_spirit::str_type) {
+        error = "request has no demo";
+        return false;
+    }
+    request.demo = it->second.get_str();
+
+    it = object.find("output");
+    if (it == object.end() || it->second.type() != json_spirit::str_type) {
+        error = "request has no output";
+        return false;
+    }
+    request.output = it->second.get_str();
+
+    it = object.find("flags");
+    if (it != object.end()) {
+        if (it->second.type() != json_spirit::array_type) {
+            error = "flags isn't an array";
+            return false;
+        }
+        for (const json_spirit::mValue &flag : it->second.get_array()) {
+            if (flag.type() != json_spirit::str_type) {
+                error = "flags has a value that isn't a string";
+                return false;
+            }
+            request.flags.push_back(flag.get_str());
+        }
+    }
+    return true;
+}
+
+// nMicroseconds < 0 when the request didn't run
+static std::string ReplyLine(const ServeRequest &request, const std::string &error,
+                             int64 nMicroseconds) {
+    json_spirit::mObject reply;
+    reply["id"] = request.id;
+    reply["status"] = error.empty() ? "ok" : "error";
+    if (!error.empty())
+        reply["error"] = error;
+    if (!request.demo.empty())
+        reply["demo"] = request.demo;
+    if (!request.output.empty())
+        reply["output"] = request.output;
+    if (nMicroseconds >= 0)
+        reply["us"] = nMicroseconds;
+    return json_spirit::write(json_spirit::mValue(reply)) + "\n";
+}
+
+static bool WriteAll(int fd, const std::string &data) {
+    for (size_t nWritten = 0; nWritten < data.size();) {
+        ssize_t n = write(fd, data.data() + nWritten, data.size() - nWritten);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        nWritten += n;
+    }
+    return true;
+}
+
+// Appends what's readable on fd to buffer. False on end of file or error.
+static bool ReadSome(int fd, std::string &buffer) {
+    char chunk[16384];
+    ssize_t n;
+    do {
+        n = read(fd, chunk, sizeof(chunk));
+    } while (n < 0 && errno == EINTR);
+    // nothing after all on a non-blocking connection
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return true;
+    if (n <= 0)
+        return false;
+    buffer.append(chunk, n);
+    return true;
+}
+
+// Removes the first complete line from buffer, without its line break.
+static bool PopLine(std::string &buffer, std::string &line) {
+    size_t end = buffer.find('\n');
+    if (end == std::string::npos)
+        return false;
+    line.assign(buffer, 0, end);
+    buffer.erase(0, end + 1);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// worker
+//-----------------------------------------------------------------------------
+static std::string RunRequest(CDemoFileDump &dump, const std::string &line,
+                              ApplyOptionsFn applyOptions) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    ServeRequest request;
+    std::string error;
+    if (!ParseRequest(line, request, error) || !applyOptions(request.flags, error))
+        return ReplyLine(request, error, -1);
+    if (!dump.Open(request.demo.c_str()))
+        return ReplyLine(request, "couldn't open demo", -1);
+    // the dump goes wherever stdout goes
+    if (!freopen(request.output.c_str(), "wb", stdout))
+        return ReplyLine(request, "couldn't open output", -1);
+
+    std::wcout.clear();
+    dump.Reset();
+    dump.DoDump();
+    std::wcout.flush();
+    if (fflush(stdout) != 0 || ferror(stdout))
+        error = "couldn't write output";
+    freopen("/dev/null", "w", stdout);
+
+    int64 nMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+    return ReplyLine(request, error, nMicroseconds);
+}
+
+static void RunWorker(int requestFd, int replyFd, ApplyOptionsFn applyOptions) {
+    freopen("/dev/null", "w", stdout);
+
+    CDemoFileDump dump;
+    std::string buffer, line;
+    for (;;) {
+        while (PopLine(buffer, line)) {
+            if (!WriteAll(replyFd, RunRequest(dump, line, applyOptions)))
+                return;
+        }
+        if (!ReadSome(requestFd, buffer))
+            return;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// dispatcher
+//-----------------------------------------------------------------------------
+struct ServeWorker {
+    ServeWorker() : pid(-1), requestFd(-1), replyFd(-1), nClient(-1) {}
+
+    pid_t pid;
+    int requestFd;
+    int replyFd;
+    std::string replies;
+    // client of the request it's running, -1 when idle
+    int nClient;
+    std::string request;
+};
+
+struct ServeClient {
+    ServeClient() : readFd(-1), writeFd(-1), bEof(false), nPending(0) {}
+
+    int readFd;
+    // -1 once it's dropped. Connections are non-blocking, stdout isn't: its file description is
+    // shared with whoever started the server.
+    int writeFd;
+    std::string requests;
+    // replies not written yet, flushed when writeFd takes more
+    std::string replies;
+    bool bEof;
+    // requests read but not replied to
+    int nPending;
+};
+
+struct ServeJob {
+    int nClient;
+    std::string request;
+};
+
+class CServer {
+public:
+    CServer(ApplyOptionsFn applyOptions)
+        : m_applyOptions(applyOptions), m_listenFd(-1), m_nNextClient(0) {}
+
+    int Run(const char *pSocketPath, int nWorkers);
+
+private:
+    bool Listen(const char *pSocketPath);
+    bool StartWorker(ServeWorker &worker);
+    void StopWorkers();
+    void AddClient(int readFd, int writeFd);
+    void ReadClient(int nClient);
+    void ReadWorker(ServeWorker &worker);
+    void WorkerDied(ServeWorker &worker);
+    void Dispatch();
+    void Reply(int nClient, const std::string &line);
+    void FlushClient(int nClient);
+    void DropClient(int nClient);
+    void DropFinishedClients();
+
+    ApplyOptionsFn m_applyOptions;
+    int m_listenFd;
+    int m_nNextClient;
+    std::vector<ServeWorker> m_workers;
+    std::map<int, ServeClient> m_clients;
+    std::deque<ServeJob> m_jobs;
+};
+
+bool CServer::Listen(const char *pSocketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(pSocketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "-serve: socket path too long: %s\n", pSocketPath);
+        return false;
+    }
+    strcpy(address.sun_path, pSocketPath);
+
+    m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        perror("-serve: socket");
+        return false;
+    }
+    // a socket file left behind by a previous run
+    unlink(pSocketPath);
+    if (bind(m_listenFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(m_listenFd, SOMAXCONN) != 0) {
+        fprintf(stderr, "-serve: can't listen on %s: %s\n", pSocketPath, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool CServer::StartWorker(ServeWorker &worker) {
+    int requestPipe[2], replyPipe[2];
+    if (pipe(requestPipe) != 0)
+        return false;
+    if (pipe(replyPipe) != 0) {
+        close(requestPipe[0]);
+        close(requestPipe[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(requestPipe[0]);
+        close(requestPipe[1]);
+        close(replyPipe[0]);
+        close(replyPipe[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // only the dispatcher talks to clients and other workers, and a client only sees the
+        // end of its connection once every copy of it is closed
+        close(requestPipe[1]);
+        close(replyPipe[0]);
+        if (m_listenFd >= 0)
+            close(m_listenFd);
+        for (std::map<int, ServeClient>::iterator it = m_clients.begin(); it != m_clients.end();
+             ++it) {
+            if (it->second.readFd > 2)
+                close(it->second.readFd);
+        }
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            if (m_workers[i].requestFd >= 0)
+                close(m_workers[i].requestFd);
+            if (m_workers[i].replyFd >= 0)
+                close(m_workers[i].replyFd);
+        }
+        RunWorker(requestPipe[0], replyPipe[1], m_applyOptions);
+        fflush(NULL);
+        _exit(0);
+    }
+
+    close(requestPipe[0]);
+    close(replyPipe[1]);
+    worker.pid = pid;
+    worker.requestFd = requestPipe[1];
+    worker.replyFd = replyPipe[0];
+    worker.replies.clear();
+    worker.nClient = -1;
+    return true;
+}
+
+void CServer::StopWorkers() {
+    // workers exit when their request pipe closes
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        close(m_workers[i].requestFd);
+        close(m_workers[i].replyFd);
+    }
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        int status;
+        while (waitpid(m_workers[i].pid, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+    m_workers.clear();
+}
+
+void CServer::AddClient(int readFd, int writeFd) {
+    ServeClient &client = m_clients[m_nNextClient++];
+    client.readFd = readFd;
+    client.writeFd = writeFd;
+}
+
+void CServer::ReadClient(int nClient) {
+    ServeClient &client = m_clients[nClient];
+    if (client.bEof)
+        return;
+    if (!ReadSome(client.readFd, client.requests)) {
+        client.bEof = true;
+        // a last request without a line break
+        if (!client.requests.empty())
+            client.requests += '\n';
+    }
+
+    std::string line;
+    while (PopLine(client.requests, line)) {
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        // turn away what a worker would anyway, without a round trip
+        ServeRequest request;
+        std::string error;
+        client.nPending++;
+        if (!ParseRequest(line, request, error)) {
+            Reply(nClient, ReplyLine(request, error, -1));
+            continue;
+        }
+        ServeJob job;
+        job.nClient = nClient;
+        job.request = line;
+        m_jobs.push_back(job);
+    }
+}
+
+void CServer::Reply(int nClient, const std::string &line) {
+    std::map<int, ServeClient>::iterator it = m_clients.find(nClient);
+    if (it == m_clients.end())
+        return;
+    ServeClient &client = it->second;
+    client.nPending--;
+    if (client.writeFd < 0)
+        return;
+    if (client.replies.size() + line.size() > SERVE_MAX_QUEUED_REPLY_BYTES) {
+        fprintf(stderr, "-serve: dropping a client that doesn't read its replies\n");
+        DropClient(nClient);
+        return;
+    }
+    client.replies += line;
+    FlushClient(nClient);
+}
+
+void CServer::FlushClient(int nClient) {
+    ServeClient &client = m_clients[nClient];
+    size_t nWritten = 0;
+    while (client.writeFd >= 0 && nWritten < client.replies.size()) {
+        ssize_t n = write(client.writeFd, client.replies.data() + nWritten,
+                          client.replies.size() - nWritten);
+        if (n < 0 && errno == EINTR)
+            continue;
+        // the rest goes once poll says the client takes more
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0) {
+            DropClient(nClient);
+            return;
+        }
+        nWritten += n;
+    }
+    client.replies.erase(0, nWritten);
+}
+
+// Stops reading from and writing to the client, and forgets its queued requests. Its fds are
+// closed by DropFinishedClients() once the requests it has running are done.
+void CServer::DropClient(int nClient) {
+    ServeClient &client = m_clients[nClient];
+    client.writeFd = -1;
+    client.replies.clear();
+    client.requests.clear();
+    client.bEof = true;
+    for (std::deque<ServeJob>::iterator it = m_jobs.begin(); it != m_jobs.end();) {
+        if (it->nClient == nClient) {
+            client.nPending--;
+            it = m_jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CServer::ReadWorker(ServeWorker &worker) {
+    if (!ReadSome(worker.replyFd, worker.replies)) {
+        WorkerDied(worker);
+        return;
+    }
+
+    std::string line;
+    while (PopLine(worker.replies, line)) {
+        if (worker.nClient < 0)
+            continue;
+        Reply(worker.nClient, line + "\n");
+        worker.nClient = -1;
+        worker.request.clear();
+    }
+}
+
+void CServer::WorkerDied(ServeWorker &worker) {
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    close(worker.requestFd);
+    close(worker.replyFd);
+    worker.requestFd = worker.replyFd = -1;
+
+    if (worker.nClient >= 0) {
+        char error[64];
+        if (WIFSIGNALED(status))
+            snprintf(error, sizeof(error), "worker killed by signal %d", WTERMSIG(status));
+        else
+            snprintf(error, sizeof(error), "worker exited with status %d", WEXITSTATUS(status));
+        ServeRequest request;
+        std::string unused;
+        ParseRequest(worker.request, request, unused);
+        Reply(worker.nClient, ReplyLine(request, error, -1));
+    }
+
+    if (!StartWorker(worker))
+        fprintf(stderr, "-serve: couldn't replace worker %d: %s\n", (int)worker.pid,
+                strerror(errno));
+}
+
+void CServer::Dispatch() {
+    for (size_t i = 0; i < m_workers.size() && !m_jobs.empty(); i++) {
+        ServeWorker &worker = m_workers[i];
+        if (worker.nClient >= 0 || worker.requestFd < 0)
+            continue;
+        worker.nClient = m_jobs.front().nClient;
+        worker.request = m_jobs.front().request;
+        m_jobs.pop_front();
+        // a worker that can't take it died, which ReadWorker finds out
+        WriteAll(worker.requestFd, worker.request + "\n");
+    }
+}
+
+void CServer::DropFinishedClients() {
+    for (std::map<int, ServeClient>::iterator it = m_clients.begin(); it != m_clients.end();) {
+        ServeClient &client = it->second;
+        // stdin stays, it's how Run() knows to return
+        if (client.bEof && client.nPending == 0 && client.replies.empty() &&
+            client.readFd > 2) {
+            close(client.readFd);
+            m_clients.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int CServer::Run(const char *pSocketPath, int nWorkers) {
+    // a client that hangs up early only fails the writes to it
+    signal(SIGPIPE, SIG_IGN);
+
+    if (pSocketPath) {
+        if (!Listen(pSocketPath))
+            return 1;
+    } else {
+        AddClient(STDIN_FILENO, STDOUT_FILENO);
+    }
+
+    if (nWorkers <= 0)
+        nWorkers = std::max(1u, std::thread::hardware_concurrency());
+    m_workers.resize(nWorkers);
+    for (int i = 0; i < nWorkers; i++) {
+        if (!StartWorker(m_workers[i])) {
+            perror("-serve: couldn't start worker");
+            return 1;
+        }
+    }
+
+    std::vector<struct pollfd> fds;
+    std::vector<int> owners;
+    for (;;) {
+        DropFinishedClients();
+        Dispatch();
+
+        if (!pSocketPath) {
+            bool bBusy = false;
+            for (size_t i = 0; i < m_workers.size(); i++)
+                bBusy = bBusy || m_workers[i].nClient >= 0;
+            if (m_clients[0].bEof && m_jobs.empty() && !bBusy)
+                break;
+        }
+
+        // owners: -1 the socket, >= 0 a client, < -1 worker -2 - index
+        fds.clear();
+        owners.clear();
+        struct pollfd entry;
+        entry.events = POLLIN;
+        entry.revents = 0;
+        if (m_listenFd >= 0) {
+            entry.fd = m_listenFd;
+            fds.push_back(entry);
+            owners.push_back(-1);
+        }
+        for (std::map<int, ServeClient>::iterator it = m_clients.begin(); it != m_clients.end();
+             ++it) {
+            const ServeClient &client = it->second;
+            bool bWrite = client.writeFd >= 0 && !client.replies.empty();
+            if (!client.bEof) {
+                entry.fd = client.readFd;
+                entry.events = POLLIN;
+                // a connection reads and writes on the same fd
+                if (bWrite && client.writeFd == client.readFd) {
+                    entry.events |= POLLOUT;
+                    bWrite = false;
+                }
+                fds.push_back(entry);
+                owners.push_back(it->first);
+            }
+            if (bWrite) {
+                entry.fd = client.writeFd;
+                entry.events = POLLOUT;
+                fds.push_back(entry);
+                owners.push_back(it->first);
+            }
+        }
+        entry.events = POLLIN;
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            if (m_workers[i].replyFd >= 0) {
+                entry.fd = m_workers[i].replyFd;
+                fds.push_back(entry);
+                owners.push_back(-2 - (int)i);
+            }
+        }
+
+        if (poll(&fds[0], fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("-serve: poll");
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (!fds[i].revents)
+                continue;
+            if (owners[i] == -1) {
+                int fd = accept(m_listenFd, NULL, NULL);
+                if (fd >= 0) {
+                    // a client that stops reading its replies mustn't hold up the others
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                    AddClient(fd, fd);
+                }
+            } else if (owners[i] >= 0) {
+                if (fds[i].events & POLLOUT)
+                    FlushClient(owners[i]);
+                if ((fds[i].events & POLLIN) && (fds[i].revents & ~POLLOUT))
+                    ReadClient(owners[i]);
+            } else {
+                ReadWorker(m_workers[-2 - owners[i]]);
+            }
+        }
+    }
+
+    StopWorkers();
+    if (m_listenFd >= 0) {
+        close(m_listenFd);
+        unlink(pSocketPath);
+    }
+    return 0;
+}
+
+int ServeDemos(const char *pSocketPath, int nWorkers, ApplyOptionsFn applyOptions) {
+    CServer server(applyOptions);
+    return server.Run(pSocketPath, nWorkers);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef DEMOSERVE_H
+#define DEMOSERVE_H
+
+#include <string>
+#include <vector>
+
+// Sets the g_ options from the flags of a request, starting from the defaults. False and the
+// reason in error for flags a request can't have. The options may point into args.
+typedef bool (*ApplyOptionsFn)(const std::vector<std::string> &args, std::string &error);
+
+// -serve: parses demos for newline delimited JSON requests
+//
+//   {"id": 7, "demo": "/demos/a.dem", "output": "/out/a.json", "flags": ["-hsbox"]}
+//
+// read from stdin, or from any number of connections to the AF_UNIX socket pSocketPath. Every
+// request gets one reply line, on stdout or on its connection, once its output is written:
+//
+//   {"id": 7, "status": "ok", "demo": "/demos/a.dem", "output": "/out/a.json", "us": 412500}
+//   {"id": 8, "status": "error", "error": "couldn't open demo", ...}
+//
+// id is echoed back as is, us is how long the request took in microseconds, and replies come in
+// the order requests finish. Without flags a request dumps everything, like demoinfogo demo.dem.
+// Replies to a connection are queued until it reads them; one that lets 1 MB pile up is dropped.
+//
+// Requests run on nWorkers (one per core if 0) long lived worker processes, forked once the
+// process is initialized. A worker keeps its buffers and the flattened data tables between
+// requests and flattens them again only when a demo has different ones. A worker that dies (the
+// parser exits on corrupt demos) fails its request and is replaced.
+//
+// Returns once stdin is closed and every request has its reply, or never with a socket.
+int ServeDemos(const char *pSocketPath, int nWorkers, ApplyOptionsFn applyOptions);
+
+#endif // DEMOSERVE_H
@@ -0,0 +1,126 @@
+#include <string.h>
+#include "entityhistory.h"
+
+CEntityHistory::CEntityHistory() : m_nKeyframeInterval(1024) {}
+
+void CEntityHistory::Clear() {
+    m_current.clear();
+    m_keyframes.clear();
+    m_changes.clear();
+    m_values.clear();
+}
+
+// Takes a keyframe of the state before tick's changes when the last one is old enough.
+void CEntityHistory::BeginChange(int tick) {
+    if (m_keyframes.empty() || tick >= m_keyframes.back().tick + m_nKeyframeInterval) {
+        Keyframe keyframe;
+        keyframe.tick = tick;
+        keyframe.nFirstChange = m_changes.size();
+        m_keyframes.push_back(keyframe);
+        m_keyframes.back().state = m_current;
+    }
+}
+
+static bool SameValue(const Prop_t &a, const Prop_t &b) {
+    if (a.m_type != b.m_type || a.m_nNumElements != b.m_nNumElements)
+        return false;
+    switch (a.m_type) {
+    case DPT_Int:
+        return a.m_value.m_int == b.m_value.m_int;
+    case DPT_Float:
+        return memcmp(&a.m_value.m_float, &b.m_value.m_float, sizeof(float)) == 0;
+    case DPT_Vector:
+    case DPT_VectorXY:
+        return memcmp(&a.m_value.m_vector, &b.m_value.m_vector, sizeof(Vector)) == 0;
+    case DPT_String:
+        return strcmp(a.m_value.m_pString, b.m_value.m_pString) == 0;
+    case DPT_Int64:
+        return a.m_value.m_int64 == b.m_value.m_int64;
+    default:
+        return true;
+    }
+}
+
+void CEntityHistory::EntityEnter(int tick, int nEntity, uint32 uClass, uint32 uSerialNum) {
+    BeginChange(tick);
+    Change change = {tick, nEntity, kChange_Enter, uClass, uSerialNum, 0};
+    m_changes.push_back(change);
+    Apply(change, m_current);
+}
+
+void CEntityHistory::EntityLeave(int tick, int nEntity) {
+    if (!m_current.count(nEntity))
+        return;
+    BeginChange(tick);
+    Change change = {tick, nEntity, kChange_Leave, 0, 0, 0};
+    m_changes.push_back(change);
+    Apply(change, m_current);
+}
+
+void CEntityHistory::PropChanged(int tick, int nEntity, int nPropIndex, const Prop_t *pValue) {
+    HistoryState::iterator entity = m_current.find(nEntity);
+    if (entity == m_current.end())
+        return;
+
+    int nElements = pValue->NumValues();
+    std::map<int, HistoryValue>::const_iterator old = entity->second.props.find(nPropIndex);
+    if (old != entity->second.props.end() && (int)old->second.size() == nElements) {
+        bool bSame = true;
+        for (int i = 0; i < nElements && bSame; i++)
+            bSame = SameValue(old->second[i], pValue[i]);
+        if (bSame)
+            return;
+    }
+
+    BeginChange(tick);
+    Change change = {tick, nEntity, kChange_Prop, (uint32)nPropIndex, (uint32)m_values.size(),
+                     (uint32)nElements};
+    // string values are interned, g_StringInterner keeps them until the next demo
+    for (int i = 0; i < nElements; i++)
+        m_values.push_back(pValue[i]);
+    m_changes.push_back(change);
+    Apply(change, m_current);
+}
+
+void CEntityHistory::Apply(const Change &change, HistoryState &state) const {
+    switch (change.kind) {
+    case kChange_Enter: {
+        // like AddEntity, an entity that already exists keeps its props
+        HistoryEntity &entity = state[change.nEntity];
+        entity.uClass = change.nProp;
+        entity.uSerialNum = change.nFirst;
+    } break;
+    case kChange_Leave:
+        state.erase(change.nEntity);
+        break;
+    case kChange_Prop: {
+        HistoryState::iterator entity = state.find(change.nEntity);
+        if (entity != state.end()) {
+            const Prop_t *pFirst = m_values.empty() ? NULL : &m_values[change.nFirst];
+            entity->second.props[change.nProp].assign(pFirst, pFirst + change.nElements);
+        }
+    } break;
+    }
+}
+
+bool CEntityHistory::StateAt(int tick, HistoryState &state) const {
+    state.clear();
+    if (m_keyframes.empty() || tick < m_keyframes[0].tick)
+        return false;
+
+    // last keyframe at or before tick
+    size_t lo = 0, hi = m_keyframes.size();
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (m_keyframes[mid].tick <= tick)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    const Keyframe &keyframe = m_keyframes[lo];
+    state = keyframe.state;
+    for (size_t i = keyframe.nFirstChange; i < m_changes.size() && m_changes[i].tick <= tick; i++)
+        Apply(m_changes[i], state);
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef ENTITYHISTORY_H
+#define ENTITYHISTORY_H
+
+#include <map>
+#include <vector>
+#include "demofile.h"
+#include "demofilebitbuf.h"
+#include "demofilepropdecode.h"
+
+// Value of one flattened prop, every element of it for arrays.
+typedef std::vector<Prop_t> HistoryValue;
+
+struct HistoryEntity {
+    HistoryEntity() : uClass(0), uSerialNum(0) {}
+
+    uint32 uClass;
+    uint32 uSerialNum;
+    // flattened prop index to value
+    std::map<int, HistoryValue> props;
+};
+
+// entity index to entity
+typedef std::map<int, HistoryEntity> HistoryState;
+
+// Entity state over the whole demo: a full copy of the state every m_nKeyframeInterval ticks and
+// the changes between them, so the state at any tick costs at most one keyframe interval worth of
+// changes to rebuild. Changes that don't change the value aren't recorded.
+class CEntityHistory {
+public:
+    CEntityHistory();
+
+    void SetKeyframeInterval(int nTicks) { m_nKeyframeInterval = nTicks > 0 ? nTicks : 1; }
+    void Clear();
+
+    // Same semantics as AddEntity / RemoveEntity / AddOrUpdateProp, ticks never go backwards.
+    void EntityEnter(int tick, int nEntity, uint32 uClass, uint32 uSerialNum);
+    void EntityLeave(int tick, int nEntity);
+    void PropChanged(int tick, int nEntity, int nPropIndex, const Prop_t *pValue);
+
+    // State after every change up to and including tick. False if tick is before the first
+    // recorded change.
+    bool StateAt(int tick, HistoryState &state) const;
+
+    size_t NumKeyframes() const { return m_keyframes.size(); }
+    size_t NumChanges() const { return m_changes.size(); }
+
+private:
+    enum ChangeKind { kChange_Prop, kChange_Enter, kChange_Leave };
+
+    struct Change {
+        int tick;
+        int nEntity;
+        ChangeKind kind;
+        // prop index for kChange_Prop, class for kChange_Enter
+        uint32 nProp;
+        // first element in m_values for kChange_Prop, serial number for kChange_Enter
+        uint32 nFirst;
+        uint32 nElements;
+    };
+
+    struct Keyframe {
+        int tick;
+        // first change after the keyframe
+        size_t nFirstChange;
+        HistoryState state;
+    };
+
+    void BeginChange(int tick);
+    void Apply(const Change &change, HistoryState &state) const;
+
+    int m_nKeyframeInterval;
+    HistoryState m_current;
+    std::vector<Keyframe> m_keyframes;
+    std::vector<Change> m_changes;
+    std::vector<Prop_t> m_values;
+};
+
+#endif // ENTITYHISTORY_H
@@ -0,0 +1,184 @@
+#include <string.h>
+#include "entitylog.h"
+
+#define ENTITYLOG_MAGIC "DEMOENTS"
+#define ENTITYLOG_VERSION 1
+// buffered records are written out past this
+#define ENTITYLOG_FLUSH_SIZE (1 << 20)
+
+enum EntityLogRecord {
+    kEntLog_End = 0,
+    kEntLog_Schema = 1,
+    kEntLog_Tick = 2,
+    kEntLog_Enter = 3,
+    kEntLog_Leave = 4,
+    kEntLog_Delete = 5,
+    kEntLog_Delta = 6,
+};
+
+static void PutVarInt(std::string &out, uint64 nValue) {
+    while (nValue >= 0x80) {
+        out.push_back((char)(nValue | 0x80));
+        nValue >>= 7;
+    }
+    out.push_back((char)nValue);
+}
+
+static void PutSignedVarInt(std::string &out, int64 nValue) {
+    PutVarInt(out, ((uint64)nValue << 1) ^ (uint64)(nValue >> 63));
+}
+
+static void PutFloat(std::string &out, float flValue) {
+    char bytes[sizeof(float)];
+    memcpy(bytes, &flValue, sizeof(float));
+    out.append(bytes, sizeof(float));
+}
+
+static void PutString(std::string &out, const char *pString) {
+    size_t nLength = pString ? strlen(pString) : 0;
+    PutVarInt(out, nLength);
+    out.append(pString ? pString : "", nLength);
+}
+
+// One value of type, which isn't DPT_Array.
+static void PutValue(std::string &out, int type, const Prop_t &value) {
+    switch (type) {
+    case DPT_Int:
+        PutSignedVarInt(out, value.m_value.m_int);
+        break;
+    case DPT_Float:
+        PutFloat(out, value.m_value.m_float);
+        break;
+    case DPT_Vector:
+        PutFloat(out, value.m_value.m_vector.x);
+        PutFloat(out, value.m_value.m_vector.y);
+        PutFloat(out, value.m_value.m_vector.z);
+        break;
+    case DPT_VectorXY:
+        PutFloat(out, value.m_value.m_vector.x);
+        PutFloat(out, value.m_value.m_vector.y);
+        break;
+    case DPT_String:
+        PutString(out, value.m_value.m_pString);
+        break;
+    case DPT_Int64:
+        PutSignedVarInt(out, value.m_value.m_int64);
+        break;
+    default:
+        break;
+    }
+}
+
+CEntityLog::CEntityLog()
+    : m_fp(NULL), m_nTick(0), m_bTickWritten(false), m_nProps(0), m_nLastProp(-1) {}
+
+CEntityLog::~CEntityLog() { Close(); }
+
+bool CEntityLog::Open(const char *filename) {
+    Close();
+    m_fp = fopen(filename, "wb");
+    if (!m_fp)
+        return false;
+
+    m_nTick = 0;
+    m_bTickWritten = false;
+    m_buffer.assign(ENTITYLOG_MAGIC);
+    PutVarInt(m_buffer, ENTITYLOG_VERSION);
+    return true;
+}
+
+void CEntityLog::Close() {
+    if (!m_fp)
+        return;
+
+    m_buffer.push_back(kEntLog_End);
+    Flush();
+    fclose(m_fp);
+    m_fp = NULL;
+}
+
+void CEntityLog::Flush() {
+    if (!m_buffer.empty())
+        fwrite(m_buffer.data(), 1, m_buffer.size(), m_fp);
+    m_buffer.clear();
+}
+
+void CEntityLog::Schema(const std::vector<ServerClass_t> &classes) {
+    m_buffer.push_back(kEntLog_Schema);
+    PutVarInt(m_buffer, classes.size());
+    for (const ServerClass_t &serverClass : classes) {
+        PutVarInt(m_buffer, serverClass.nClassID);
+        PutString(m_buffer, serverClass.strName);
+        PutString(m_buffer, serverClass.strDTName);
+        PutVarInt(m_buffer, serverClass.flattenedProps.size());
+        for (const FlattenedPropEntry &prop : serverClass.flattenedProps) {
+            PutString(m_buffer, prop.m_prop->var_name().c_str());
+            PutVarInt(m_buffer, prop.m_prop->type());
+            PutVarInt(m_buffer, (uint32)prop.m_prop->flags());
+            if (prop.m_prop->type() == DPT_Array) {
+                PutVarInt(m_buffer, prop.m_arrayElementProp ? prop.m_arrayElementProp->type() : 0);
+                PutVarInt(m_buffer, prop.m_prop->num_elements());
+            }
+        }
+    }
+}
+
+void CEntityLog::Tick(int tick) {
+    if (m_bTickWritten && tick == m_nTick)
+        return;
+
+    m_buffer.push_back(kEntLog_Tick);
+    PutSignedVarInt(m_buffer, (int64)tick - m_nTick);
+    m_nTick = tick;
+    m_bTickWritten = true;
+}
+
+void CEntityLog::BeginEnter(int tick, int nEntity, uint32 uClass, uint32 uSerialNum) {
+    Tick(tick);
+    m_buffer.push_back(kEntLog_Enter);
+    PutVarInt(m_buffer, nEntity);
+    PutVarInt(m_buffer, uClass);
+    PutVarInt(m_buffer, uSerialNum);
+    m_props.clear();
+    m_nProps = 0;
+    m_nLastProp = -1;
+}
+
+void CEntityLog::BeginDelta(int tick, int nEntity) {
+    Tick(tick);
+    m_buffer.push_back(kEntLog_Delta);
+    PutVarInt(m_buffer, nEntity);
+    m_props.clear();
+    m_nProps = 0;
+    m_nLastProp = -1;
+}
+
+void CEntityLog::Prop(int nIndex, const FlattenedPropEntry *pFlattenedProp, const Prop_t *pValue) {
+    PutVarInt(m_props, nIndex - m_nLastProp - 1);
+    m_nLastProp = nIndex;
+    m_nProps++;
+
+    if (pFlattenedProp->m_prop->type() != DPT_Array) {
+        PutValue(m_props, pFlattenedProp->m_prop->type(), *pValue);
+        return;
+    }
+
+    int nElements = pValue->NumValues();
+    int elementType = pFlattenedProp->m_arrayElementProp->type();
+    PutVarInt(m_props, nElements);
+    for (int i = 0; i < nElements; i++)
+        PutValue(m_props, elementType, pValue[i]);
+}
+
+void CEntityLog::EndEntity() {
+    PutVarInt(m_buffer, m_nProps);
+    m_buffer.append(m_props);
+    if (m_buffer.size() >= ENTITYLOG_FLUSH_SIZE)
+        Flush();
+}
+
+void CEntityLog::Leave(int tick, int nEntity, bool bDelete) {
+    Tick(tick);
+    m_buffer.push_back(bDelete ? kEntLog_Delete : kEntLog_Leave);
+    PutVarInt(m_buffer, nEntity);
+}
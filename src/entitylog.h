@@ -0,0 +1,67 @@
+#ifndef ENTITYLOG_H
+#define ENTITYLOG_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "demofiledump.h"
+
+// -entitylog out.bin: every entity change of the demo as a compact binary stream, for consumers
+// that replay entity state and don't want -packetentities text.
+//
+// Integers are LEB128 varints, zigzag encoded where they can be negative (marked s), floats are
+// 4 byte little endian IEEE, strings a varint length then the bytes. The file is the magic
+// "DEMOENTS", the format version (varint, 1), then records, each a type byte then:
+//
+//   1 schema   class count, then per class: class id, name, data table name, prop count, then
+//              per flattened prop: name, type (SendPropType_t), flags (SPROP_*), and for
+//              DPT_Array props the element type and the maximum element count. Before any
+//              entity record, again only if the data tables change.
+//   2 tick     s tick minus the previous tick record's (0 before the first). Before the first
+//              entity record of every tick that has one.
+//   3 enter    entity, class id, serial number, props. Entity enters the PVS (or is created).
+//   4 leave    entity. Entity leaves the PVS.
+//   5 delete   entity. Entity leaves the PVS and is deleted.
+//   6 delta    entity, props.
+//   0 end      end of the demo.
+//
+// props is a count, then per prop the flattened prop index minus one past the previous one's
+// (the index itself for the first) and its value, by type of the prop in the schema: s int, s
+// int64, float, vector as 3 floats, vectorxy as 2, string, array as an element count then the
+// elements. Props come in increasing index order. With -hsbox only the props it decodes are there.
+class CEntityLog {
+public:
+    CEntityLog();
+    ~CEntityLog();
+
+    // False if filename can't be written.
+    bool Open(const char *filename);
+    // Writes the end record and closes the file.
+    void Close();
+    bool IsOpen() const { return m_fp != NULL; }
+
+    void Schema(const std::vector<ServerClass_t> &classes);
+
+    // An enter or delta record, with the props given to Prop() until EndEntity().
+    void BeginEnter(int tick, int nEntity, uint32 uClass, uint32 uSerialNum);
+    void BeginDelta(int tick, int nEntity);
+    void Prop(int nIndex, const FlattenedPropEntry *pFlattenedProp, const Prop_t *pValue);
+    void EndEntity();
+
+    void Leave(int tick, int nEntity, bool bDelete);
+
+private:
+    void Tick(int tick);
+    void Flush();
+
+    FILE *m_fp;
+    int m_nTick;
+    bool m_bTickWritten;
+    std::string m_buffer;
+    // props of the record being written, and how many
+    std::string m_props;
+    int m_nProps;
+    int m_nLastProp;
+};
+
+#endif // ENTITYLOG_H
@@ -0,0 +1,562 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "eventfilter.h"
+#include "win_stuff.h"
+
+// leaves of the expression, which bounds the evaluation stack
+#define EVENTFILTER_MAX_TERMS 256
+
+// game event key types, as in CSVCMsg_GameEventList::key_t::type
+enum {
+    kKey_String = 1,
+    kKey_Float,
+    kKey_Long,
+    kKey_Short,
+    kKey_Byte,
+    kKey_Bool,
+    kKey_Uint64,
+    kKey_WString,
+};
+
+enum NodeKind { kNode_And, kNode_Or, kNode_Not, kNode_Name, kNode_Compare };
+
+struct CEventFilter::Node {
+    Node(NodeKind kind_) : kind(kind_), cmp(kCmp_Eq), pLeft(NULL), pRight(NULL) {}
+    ~Node() {
+        delete pLeft;
+        delete pRight;
+    }
+
+    NodeKind kind;
+    // kNode_Name and kNode_Compare
+    std::string key;
+    Cmp cmp;
+    std::vector<std::string> values;
+    Node *pLeft;
+    Node *pRight;
+};
+
+//-----------------------------------------------------------------------------
+// parsing
+//-----------------------------------------------------------------------------
+namespace {
+
+enum TokenKind { kTok_End, kTok_Word, kTok_String, kTok_Op, kTok_LParen, kTok_RParen, kTok_Comma };
+
+struct Token {
+    TokenKind kind;
+    std::string text;
+};
+
+class CFilterParser {
+public:
+    CFilterParser(const char *pExpression) : m_nTerms(0), m_p(pExpression) { Next(); }
+
+    std::string m_error;
+    int m_nTerms;
+
+    bool IsKeyword(const char *pWord) const {
+        return m_token.kind == kTok_Word && strcasecmp(m_token.text.c_str(), pWord) == 0;
+    }
+    bool IsOp(const char *pOp) const { return m_token.kind == kTok_Op && m_token.text == pOp; }
+    bool AtEnd() const { return m_token.kind == kTok_End; }
+
+    void Next() {
+        while (isspace((unsigned char)*m_p))
+            m_p++;
+        m_token.text.clear();
+        char c = *m_p;
+        if (!c) {
+            m_token.kind = kTok_End;
+        } else if (c == '(' || c == ')' || c == ',') {
+            m_token.kind = c == '(' ? kTok_LParen : c == ')' ? kTok_RParen : kTok_Comma;
+            m_p++;
+        } else if (c == '\'' || c == '"') {
+            m_token.kind = kTok_String;
+            m_p++;
+            while (*m_p && *m_p != c)
+                m_token.text += *m_p++;
+            if (*m_p)
+                m_p++;
+            else
+                Error("unterminated string");
+        } else if (strchr("=!<>&|", c)) {
+            m_token.kind = kTok_Op;
+            m_token.text += *m_p++;
+            if (*m_p == '=' || (c == '&' && *m_p == '&') || (c == '|' && *m_p == '|'))
+                m_token.text += *m_p++;
+        } else {
+            m_token.kind = kTok_Word;
+            while (*m_p && (isalnum((unsigned char)*m_p) || strchr("_.:-+", *m_p)))
+                m_token.text += *m_p++;
+            if (m_token.text.empty()) {
+                Error(std::string("unexpected '") + c + "'");
+                m_token.kind = kTok_End;
+            }
+        }
+    }
+
+    void Error(const std::string &error) {
+        if (m_error.empty())
+            m_error = error;
+    }
+
+    CEventFilter::Node *ParseOr() {
+        CEventFilter::Node *pLeft = ParseAnd();
+        while (m_error.empty() && (IsKeyword("or") || IsOp("||"))) {
+            Next();
+            CEventFilter::Node *pNode = new CEventFilter::Node(kNode_Or);
+            pNode->pLeft = pLeft;
+            pNode->pRight = ParseAnd();
+            pLeft = pNode;
+        }
+        return pLeft;
+    }
+
+    CEventFilter::Node *ParseAnd() {
+        CEventFilter::Node *pLeft = ParseNot();
+        while (m_error.empty() && (IsKeyword("and") || IsOp("&&"))) {
+            Next();
+            CEventFilter::Node *pNode = new CEventFilter::Node(kNode_And);
+            pNode->pLeft = pLeft;
+            pNode->pRight = ParseNot();
+            pLeft = pNode;
+        }
+        return pLeft;
+    }
+
+    CEventFilter::Node *ParseNot() {
+        if (IsKeyword("not") || IsOp("!")) {
+            Next();
+            CEventFilter::Node *pNode = new CEventFilter::Node(kNode_Not);
+            pNode->pLeft = ParseNot();
+            return pNode;
+        }
+        return ParseTerm();
+    }
+
+    CEventFilter::Node *ParseTerm() {
+        if (m_token.kind == kTok_LParen) {
+            Next();
+            CEventFilter::Node *pNode = ParseOr();
+            if (m_token.kind != kTok_RParen)
+                Error("missing ')'");
+            Next();
+            return pNode;
+        }
+        if (m_token.kind != kTok_Word) {
+            Error(m_token.kind == kTok_End ? "unexpected end of expression"
+                                           : "expected a key or event name near '" +
+                                                 m_token.text + "'");
+            return new CEventFilter::Node(kNode_Name);
+        }
+
+        if (++m_nTerms > EVENTFILTER_MAX_TERMS)
+            Error("expression too long");
+        std::string key = m_token.text;
+        Next();
+
+        CEventFilter::Node *pNode = new CEventFilter::Node(kNode_Compare);
+        pNode->key = key;
+        if (IsKeyword("in")) {
+            pNode->cmp = CEventFilter::kCmp_In;
+            Next();
+            if (m_token.kind != kTok_LParen) {
+                Error("expected '(' after in");
+                return pNode;
+            }
+            do {
+                Next();
+                if (m_token.kind != kTok_Word && m_token.kind != kTok_String) {
+                    Error("expected a value in the list of " + key);
+                    return pNode;
+                }
+                pNode->values.push_back(m_token.text);
+                Next();
+            } while (m_token.kind == kTok_Comma);
+            if (m_token.kind != kTok_RParen)
+                Error("missing ')' after the list of " + key);
+            Next();
+        } else if (m_token.kind == kTok_Op && m_token.text != "!" && m_token.text != "&&" &&
+                   m_token.text != "||") {
+            const std::string &op = m_token.text;
+            if (op == "==" || op == "=")
+                pNode->cmp = CEventFilter::kCmp_Eq;
+            else if (op == "!=")
+                pNode->cmp = CEventFilter::kCmp_Ne;
+            else if (op == "<")
+                pNode->cmp = CEventFilter::kCmp_Lt;
+            else if (op == "<=")
+                pNode->cmp = CEventFilter::kCmp_Le;
+            else if (op == ">")
+                pNode->cmp = CEventFilter::kCmp_Gt;
+            else if (op == ">=")
+                pNode->cmp = CEventFilter::kCmp_Ge;
+            else
+                Error("unknown operator '" + op + "'");
+            Next();
+            if (m_token.kind != kTok_Word && m_token.kind != kTok_String) {
+                Error("expected a value after " + key);
+                return pNode;
+            }
+            pNode->values.push_back(m_token.text);
+            Next();
+        } else {
+            // bare word: an event name or a key that has to be set
+            pNode->kind = kNode_Name;
+        }
+        return pNode;
+    }
+
+private:
+    const char *m_p;
+    Token m_token;
+};
+
+} // namespace
+
+CEventFilter::CEventFilter() : m_pRoot(NULL) {}
+
+CEventFilter::~CEventFilter() {
+    delete m_pRoot;
+}
+
+bool CEventFilter::Parse(const char *pExpression, std::string &error) {
+    delete m_pRoot;
+    m_pRoot = NULL;
+
+    CFilterParser parser(pExpression);
+    Node *pRoot = parser.ParseOr();
+    if (parser.m_error.empty() && !parser.AtEnd())
+        parser.Error("unexpected text after the expression");
+    if (!parser.m_error.empty()) {
+        delete pRoot;
+        error = parser.m_error;
+        return false;
+    }
+    m_pRoot = pRoot;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// compiling
+//-----------------------------------------------------------------------------
+static int FindKey(const CSVCMsg_GameEventList::descriptor_t &descriptor, const std::string &name) {
+    for (int i = 0; i < descriptor.keys_size(); i++) {
+        if (descriptor.keys(i).name() == name)
+            return i;
+    }
+    return -1;
+}
+
+static bool IsStringKey(int nKeyType) {
+    return nKeyType == kKey_String || nKeyType == kKey_WString;
+}
+
+// Appends the values of pNode converted for a key of type nKeyType and points instruction at
+// them. Values that can't be converted are left out.
+void CEventFilter::AddValues(const Node *pNode, int nKeyType, Instruction &instruction) {
+    instruction.nArg = (int)m_values.size();
+    instruction.nCount = 0;
+    for (size_t i = 0; i < pNode->values.size(); i++) {
+        const std::string &text = pNode->values[i];
+        Value value;
+        value.str = text;
+        value.num = 0;
+        value.u64 = 0;
+        value.bNumeric = false;
+        if (strcasecmp(text.c_str(), "true") == 0 || strcasecmp(text.c_str(), "false") == 0) {
+            value.num = value.u64 = (tolower(text[0]) == 't');
+            value.bNumeric = true;
+        } else if (!text.empty()) {
+            char *pEnd;
+            value.num = strtod(text.c_str(), &pEnd);
+            value.bNumeric = (*pEnd == 0);
+            value.u64 = strtoull(text.c_str(), &pEnd, 0);
+            if (*pEnd != 0)
+                value.u64 = (uint64)value.num;
+        }
+        if (IsStringKey(nKeyType) || value.bNumeric) {
+            m_values.push_back(value);
+            instruction.nCount++;
+        }
+    }
+}
+
+int CEventFilter::CompileNode(const Node *pNode,
+                              const CSVCMsg_GameEventList::descriptor_t &descriptor,
+                              Program &program) {
+    std::vector<Instruction> &code = program.code;
+    Instruction instruction;
+    memset(&instruction, 0, sizeof(instruction));
+
+    switch (pNode->kind) {
+    case kNode_And:
+    case kNode_Or: {
+        // a constant operand never emits code
+        int nShortCircuit = pNode->kind == kNode_And ? 0 : 1;
+        size_t nMark = code.size();
+        int left = CompileNode(pNode->pLeft, descriptor, program);
+        if (left == nShortCircuit)
+            return left;
+        int right = CompileNode(pNode->pRight, descriptor, program);
+        if (right == nShortCircuit) {
+            code.resize(nMark);
+            return right;
+        }
+        if (left >= 0 && right >= 0)
+            return left;
+        if (left >= 0 || right >= 0)
+            return -1;
+        instruction.op = pNode->kind == kNode_And ? kOp_And : kOp_Or;
+        code.push_back(instruction);
+        return -1;
+    }
+
+    case kNode_Not: {
+        int operand = CompileNode(pNode->pLeft, descriptor, program);
+        if (operand >= 0)
+            return !operand;
+        instruction.op = kOp_Not;
+        code.push_back(instruction);
+        return -1;
+    }
+
+    case kNode_Name: {
+        if (std::find(m_eventNames.begin(), m_eventNames.end(), pNode->key) != m_eventNames.end())
+            return descriptor.name() == pNode->key;
+        int nKey = FindKey(descriptor, pNode->key);
+        if (nKey < 0)
+            return 0;
+        instruction.op = kOp_Truthy;
+        instruction.nKey = nKey;
+        instruction.nKeyType = descriptor.keys(nKey).type();
+        code.push_back(instruction);
+        return -1;
+    }
+
+    case kNode_Compare: {
+        instruction.cmp = pNode->cmp;
+        if (pNode->key == "event" || pNode->key == "type") {
+            bool bFound = false;
+            bool bLess = false, bEqual = false;
+            for (size_t i = 0; i < pNode->values.size(); i++) {
+                bFound |= descriptor.name() == pNode->values[i];
+            }
+            if (!pNode->values.empty()) {
+                bEqual = descriptor.name() == pNode->values[0];
+                bLess = descriptor.name() < pNode->values[0];
+            }
+            switch (pNode->cmp) {
+            case kCmp_Eq:
+            case kCmp_In:
+                return bFound;
+            case kCmp_Ne:
+                return !bFound;
+            case kCmp_Lt:
+                return bLess;
+            case kCmp_Le:
+                return bLess || bEqual;
+            case kCmp_Gt:
+                return !bLess && !bEqual;
+            case kCmp_Ge:
+                return !bLess;
+            }
+            return 0;
+        }
+
+        if (pNode->key == "xuid") {
+            if (program.playerKeys.empty())
+                return pNode->cmp == kCmp_Ne;
+            instruction.op = kOp_Xuid;
+            AddValues(pNode, kKey_Uint64, instruction);
+        } else {
+            int nKey = FindKey(descriptor, pNode->key);
+            if (nKey < 0)
+                return 0;
+            instruction.op = pNode->cmp == kCmp_In ? kOp_In : kOp_Compare;
+            instruction.nKey = nKey;
+            instruction.nKeyType = descriptor.keys(nKey).type();
+            AddValues(pNode, instruction.nKeyType, instruction);
+        }
+        // nothing left to compare against, e.g. a word for a number key
+        if (instruction.nCount == 0)
+            return pNode->cmp == kCmp_Ne;
+        code.push_back(instruction);
+        return -1;
+    }
+    }
+    return 0;
+}
+
+void CEventFilter::Compile(const CSVCMsg_GameEventList &list) {
+    m_programs.clear();
+    m_values.clear();
+    m_eventNames.clear();
+    if (!m_pRoot)
+        return;
+
+    for (int i = 0; i < list.descriptors_size(); i++) {
+        m_eventNames.push_back(list.descriptors(i).name());
+    }
+
+    for (int i = 0; i < list.descriptors_size(); i++) {
+        const CSVCMsg_GameEventList::descriptor_t &descriptor = list.descriptors(i);
+        if (descriptor.eventid() < 0)
+            continue;
+        if ((size_t)descriptor.eventid() >= m_programs.size())
+            m_programs.resize(descriptor.eventid() + 1);
+
+        Program &program = m_programs[descriptor.eventid()];
+        program = Program();
+        program.bCompiled = true;
+        for (int key = 0; key < descriptor.keys_size(); key++) {
+            const std::string &name = descriptor.keys(key).name();
+            if (name == "userid" || name == "attacker" || name == "assister") {
+                program.playerKeys.push_back(key);
+                program.playerKeyTypes.push_back(descriptor.keys(key).type());
+            }
+        }
+        program.nConst = CompileNode(m_pRoot, descriptor, program);
+        if (program.nConst >= 0)
+            program.code.clear();
+    }
+}
+
+//-----------------------------------------------------------------------------
+// evaluation
+//-----------------------------------------------------------------------------
+static double KeyNumber(const CSVCMsg_GameEvent::key_t &key, int nKeyType) {
+    switch (nKeyType) {
+    case kKey_Float:
+        return key.val_float();
+    case kKey_Long:
+        return key.val_long();
+    case kKey_Short:
+        return key.val_short();
+    case kKey_Byte:
+        return key.val_byte();
+    case kKey_Bool:
+        return key.val_bool();
+    case kKey_Uint64:
+        return (double)key.val_uint64();
+    default:
+        return 0;
+    }
+}
+
+template <typename T>
+static bool CompareValues(const T &a, const T &b, int cmp) {
+    switch (cmp) {
+    case 0: // kCmp_Eq
+        return a == b;
+    case 1: // kCmp_Ne
+        return !(a == b);
+    case 2: // kCmp_Lt
+        return a < b;
+    case 3: // kCmp_Le
+        return !(b < a);
+    case 4: // kCmp_Gt
+        return b < a;
+    case 5: // kCmp_Ge
+        return !(a < b);
+    default:
+        return false;
+    }
+}
+
+bool CEventFilter::RunCompare(const Instruction &instruction,
+                              const CSVCMsg_GameEvent::key_t &key) const {
+    // kCmp_In: equal to any of the values
+    int cmp = instruction.cmp == kCmp_In ? (int)kCmp_Eq : instruction.cmp;
+    for (int i = 0; i < instruction.nCount; i++) {
+        const Value &value = m_values[instruction.nArg + i];
+        bool bResult;
+        if (instruction.nKeyType == kKey_String)
+            bResult = CompareValues(key.val_string(), value.str, cmp);
+        else if (instruction.nKeyType == kKey_WString)
+            bResult = CompareValues(key.val_wstring(), value.str, cmp);
+        else if (instruction.nKeyType == kKey_Uint64)
+            bResult = CompareValues(key.val_uint64(), value.u64, cmp);
+        else
+            bResult = CompareValues(KeyNumber(key, instruction.nKeyType), value.num, cmp);
+        if (bResult)
+            return true;
+    }
+    return false;
+}
+
+bool CEventFilter::RunXuid(const Instruction &instruction,
+                           const Program &program,
+                           const CSVCMsg_GameEvent &msg,
+                           XuidFn xuidOf) const {
+    // != holds when no player of the event has the xuid, the others when any player matches
+    bool bNotEqual = instruction.cmp == kCmp_Ne;
+    int cmp = bNotEqual || instruction.cmp == kCmp_In ? (int)kCmp_Eq : instruction.cmp;
+    for (size_t k = 0; k < program.playerKeys.size(); k++) {
+        int nKey = program.playerKeys[k];
+        if (nKey >= msg.keys_size())
+            continue;
+        const CSVCMsg_GameEvent::key_t &key = msg.keys(nKey);
+        uint64 xuid = xuidOf((int)KeyNumber(key, program.playerKeyTypes[k]));
+        for (int i = 0; i < instruction.nCount; i++) {
+            if (CompareValues(xuid, m_values[instruction.nArg + i].u64, cmp))
+                return !bNotEqual;
+        }
+    }
+    return bNotEqual;
+}
+
+bool CEventFilter::Matches(const CSVCMsg_GameEvent &msg, XuidFn xuidOf) const {
+    if (!m_pRoot || msg.eventid() < 0 || (size_t)msg.eventid() >= m_programs.size())
+        return true;
+    const Program &program = m_programs[msg.eventid()];
+    if (!program.bCompiled)
+        return true;
+    if (program.nConst >= 0)
+        return program.nConst != 0;
+
+    bool stack[EVENTFILTER_MAX_TERMS];
+    int nDepth = 0;
+    for (size_t i = 0; i < program.code.size(); i++) {
+        const Instruction &instruction = program.code[i];
+        switch (instruction.op) {
+        case kOp_Compare:
+        case kOp_In:
+        case kOp_Truthy: {
+            bool bResult = false;
+            if (instruction.nKey < msg.keys_size()) {
+                const CSVCMsg_GameEvent::key_t &key = msg.keys(instruction.nKey);
+                if (instruction.op != kOp_Truthy)
+                    bResult = RunCompare(instruction, key);
+                else if (instruction.nKeyType == kKey_String)
+                    bResult = !key.val_string().empty();
+                else if (instruction.nKeyType == kKey_WString)
+                    bResult = !key.val_wstring().empty();
+                else if (instruction.nKeyType == kKey_Uint64)
+                    bResult = key.val_uint64() != 0;
+                else
+                    bResult = KeyNumber(key, instruction.nKeyType) != 0;
+            }
+            stack[nDepth++] = bResult;
+        } break;
+        case kOp_Xuid:
+            stack[nDepth++] = RunXuid(instruction, program, msg, xuidOf);
+            break;
+        case kOp_Not:
+            stack[nDepth - 1] = !stack[nDepth - 1];
+            break;
+        case kOp_And:
+            nDepth--;
+            stack[nDepth - 1] = stack[nDepth - 1] && stack[nDepth];
+            break;
+        case kOp_Or:
+            nDepth--;
+            stack[nDepth - 1] = stack[nDepth - 1] || stack[nDepth];
+            break;
+        }
+    }
+    return nDepth > 0 && stack[nDepth - 1];
+}
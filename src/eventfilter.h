@@ -0,0 +1,94 @@
+#ifndef EVENTFILTER_H
+#define EVENTFILTER_H
+
+#include <string>
+#include <vector>
+#include "demofile.h"
+#include "netmessages.pb.h"
+
+// -where: a boolean expression over game events, e.g.
+//
+//   player_death and weapon in (awp, ssg08) and headshot
+//   xuid == 76561197960287930 or event == round_end
+//
+// Terms are an event name, a key (true when non zero / non empty), key <op> value with
+// ==, =, !=, <, <=, >, >=, key in (value, ...), and the pseudo keys event (the event name) and
+// xuid (any of userid, attacker, assister). They combine with and, or, not, &&, ||, ! and
+// parentheses.
+//
+// The expression is parsed once, then compiled to a short program per event descriptor when the
+// game event list arrives, with key names resolved to key indices, values converted to the key's
+// type and every term that only depends on the event name folded away.
+class CEventFilter {
+public:
+    typedef uint64 (*XuidFn)(int userid);
+
+    CEventFilter();
+    ~CEventFilter();
+
+    // False and a description of the problem in error if the expression doesn't parse.
+    bool Parse(const char *pExpression, std::string &error);
+
+    void Compile(const CSVCMsg_GameEventList &list);
+
+    // Whether msg passes the filter. Events without a descriptor in the compiled list pass.
+    bool Matches(const CSVCMsg_GameEvent &msg, XuidFn xuidOf) const;
+
+    // parse tree, built by the parser in eventfilter.cpp
+    struct Node;
+    enum Cmp { kCmp_Eq, kCmp_Ne, kCmp_Lt, kCmp_Le, kCmp_Gt, kCmp_Ge, kCmp_In };
+
+private:
+    struct Value {
+        std::string str;
+        double num;
+        uint64 u64;
+        bool bNumeric;
+    };
+    enum Op {
+        kOp_Compare, // push key nKey <cmp> values[nArg]
+        kOp_In,      // push key nKey in values[nArg, nArg + nCount)
+        kOp_Truthy,  // push key nKey != 0
+        kOp_Xuid,    // push xuid of any player key <cmp> / in values
+        kOp_Not,
+        kOp_And,
+        kOp_Or,
+    };
+    struct Instruction {
+        unsigned char op;
+        unsigned char cmp;
+        // key index, and its type from the descriptor
+        short nKey;
+        short nKeyType;
+        int nArg;
+        int nCount;
+    };
+    struct Program {
+        Program() : bCompiled(false), nConst(-1) {}
+        bool bCompiled;
+        // -1 when the code has to run, else the result for every event of this type
+        int nConst;
+        std::vector<Instruction> code;
+        // indices and types of userid, attacker and assister, for xuid
+        std::vector<short> playerKeys;
+        std::vector<short> playerKeyTypes;
+    };
+
+    int CompileNode(const Node *pNode,
+                    const CSVCMsg_GameEventList::descriptor_t &descriptor,
+                    Program &program);
+    void AddValues(const Node *pNode, int nKeyType, Instruction &instruction);
+    bool RunCompare(const Instruction &instruction, const CSVCMsg_GameEvent::key_t &key) const;
+    bool RunXuid(const Instruction &instruction,
+                 const Program &program,
+                 const CSVCMsg_GameEvent &msg,
+                 XuidFn xuidOf) const;
+
+    Node *m_pRoot;
+    std::vector<std::string> m_eventNames;
+    // indexed by eventid
+    std::vector<Program> m_programs;
+    std::vector<Value> m_values;
+};
+
+#endif // EVENTFILTER_H
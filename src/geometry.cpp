@@ -1,6 +1,12 @@
 #include "geometry.h"
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
+#include <limits>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEOMETRY_X86_SIMD
+#include <immintrin.h>
+#endif
 
 const double epsilon = 0.0001;
 
@@ -65,3 +71,359 @@ bool intersects(Point line1, Point line2, Point center, double radius, double he
     }
     return false;
 }
+
+//-----------------------------------------------------------------------------
+// batched intersects(): one line against n cylinders given as center arrays
+//-----------------------------------------------------------------------------
+
+// The SIMD versions do the same double precision operations in the same order as intersects(),
+// so every variant gives the same answers.
+typedef void (*IntersectsBatchFn)(const Point &line1, const Point &line2, const double *cx,
+                                  const double *cy, const double *cz, int n, double radius,
+                                  double height, unsigned char *hit);
+
+static void intersectsScalar(const Point &line1, const Point &line2, const double *cx,
+                             const double *cy, const double *cz, int n, double radius,
+                             double height, unsigned char *hit) {
+    for (int i = 0; i < n; ++i)
+        hit[i] = intersects(line1, line2, Point(cx[i], cy[i], cz[i]), radius, height);
+}
+
+#ifdef GEOMETRY_X86_SIMD
+__attribute__((target("sse2"))) static void intersectsSSE2(const Point &line1, const Point &line2,
+                                                           const double *cx, const double *cy,
+                                                           const double *cz, int n, double radius,
+                                                           double height, unsigned char *hit) {
+    Point direction = line2 - line1;
+    const __m128d dx = _mm_set1_pd(direction.x / radius);
+    const __m128d dy = _mm_set1_pd(direction.y / radius);
+    const __m128d dz = _mm_set1_pd(direction.z / height);
+    const __m128d r = _mm_set1_pd(radius), h = _mm_set1_pd(height);
+    const __m128d lx = _mm_set1_pd(line1.x), ly = _mm_set1_pd(line1.y), lz = _mm_set1_pd(line1.z);
+    const __m128d two = _mm_set1_pd(2), one = _mm_set1_pd(1), minus_one = _mm_set1_pd(-1);
+    const __m128d zero = _mm_setzero_pd(), minus_eps = _mm_set1_pd(-epsilon);
+    const __m128d a = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    const __m128d a4 = _mm_mul_pd(_mm_set1_pd(4), a);
+    const __m128d a2 = _mm_mul_pd(two, a);
+
+    int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d sx = _mm_div_pd(_mm_sub_pd(lx, _mm_loadu_pd(cx + i)), r);
+        __m128d sy = _mm_div_pd(_mm_sub_pd(ly, _mm_loadu_pd(cy + i)), r);
+        __m128d sz = _mm_div_pd(_mm_sub_pd(lz, _mm_loadu_pd(cz + i)), h);
+        __m128d b = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(two, sx), dx),
+                               _mm_mul_pd(_mm_mul_pd(two, sy), dy));
+        __m128d c = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(sx, sx), _mm_mul_pd(sy, sy)), one);
+        __m128d b24ac = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(a4, c));
+        __m128d sq = _mm_sqrt_pd(b24ac);
+        __m128d minus_b = _mm_xor_pd(b, _mm_set1_pd(-0.0));
+        __m128d t0 = _mm_div_pd(_mm_add_pd(minus_b, sq), a2);
+        __m128d t1 = _mm_div_pd(_mm_sub_pd(minus_b, sq), a2);
+        __m128d swap = _mm_cmpgt_pd(t0, t1);
+        __m128d lo = _mm_or_pd(_mm_and_pd(swap, t1), _mm_andnot_pd(swap, t0));
+        __m128d hi = _mm_or_pd(_mm_and_pd(swap, t0), _mm_andnot_pd(swap, t1));
+        __m128d y0 = _mm_add_pd(sz, _mm_mul_pd(lo, dz));
+        __m128d y1 = _mm_add_pd(sz, _mm_mul_pd(hi, dz));
+        __m128d span = _mm_sub_pd(hi, lo), dy01 = _mm_sub_pd(y0, y1);
+
+        // below: hit the bottom cap
+        __m128d th = _mm_add_pd(lo, _mm_div_pd(_mm_mul_pd(span, _mm_add_pd(y0, one)), dy01));
+        __m128d below = _mm_and_pd(_mm_cmplt_pd(y0, minus_one),
+                                   _mm_and_pd(_mm_cmpnlt_pd(y1, minus_one),
+                                              _mm_cmpnle_pd(th, minus_eps)));
+        // inside: hit the cylinder bit
+        __m128d inside = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(y0, minus_one), _mm_cmple_pd(y0, one)),
+                                    _mm_and_pd(_mm_cmpge_pd(lo, zero), _mm_cmple_pd(lo, one)));
+        inside = _mm_and_pd(inside, _mm_cmpnlt_pd(lo, minus_eps));
+        // above: hit the top cap
+        th = _mm_add_pd(lo, _mm_div_pd(_mm_mul_pd(span, _mm_sub_pd(y0, one)), dy01));
+        __m128d above = _mm_and_pd(_mm_cmpgt_pd(y0, one),
+                                   _mm_and_pd(_mm_cmpngt_pd(y1, one), _mm_cmpnle_pd(th, zero)));
+
+        __m128d result = _mm_or_pd(below, _mm_or_pd(inside, above));
+        result = _mm_and_pd(result, _mm_cmpnlt_pd(b24ac, zero));
+        int mask = _mm_movemask_pd(result);
+        hit[i] = mask & 1;
+        hit[i + 1] = (mask >> 1) & 1;
+    }
+    intersectsScalar(line1, line2, cx + i, cy + i, cz + i, n - i, radius, height, hit + i);
+}
+
+__attribute__((target("avx2"))) static void intersectsAVX2(const Point &line1, const Point &line2,
+                                                           const double *cx, const double *cy,
+                                                           const double *cz, int n, double radius,
+                                                           double height, unsigned char *hit) {
+    Point direction = line2 - line1;
+    const __m256d dx = _mm256_set1_pd(direction.x / radius);
+    const __m256d dy = _mm256_set1_pd(direction.y / radius);
+    const __m256d dz = _mm256_set1_pd(direction.z / height);
+    const __m256d r = _mm256_set1_pd(radius), h = _mm256_set1_pd(height);
+    const __m256d lx = _mm256_set1_pd(line1.x), ly = _mm256_set1_pd(line1.y);
+    const __m256d lz = _mm256_set1_pd(line1.z);
+    const __m256d two = _mm256_set1_pd(2), one = _mm256_set1_pd(1);
+    const __m256d minus_one = _mm256_set1_pd(-1);
+    const __m256d zero = _mm256_setzero_pd(), minus_eps = _mm256_set1_pd(-epsilon);
+    const __m256d a = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    const __m256d a4 = _mm256_mul_pd(_mm256_set1_pd(4), a);
+    const __m256d a2 = _mm256_mul_pd(two, a);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d sx = _mm256_div_pd(_mm256_sub_pd(lx, _mm256_loadu_pd(cx + i)), r);
+        __m256d sy = _mm256_div_pd(_mm256_sub_pd(ly, _mm256_loadu_pd(cy + i)), r);
+        __m256d sz = _mm256_div_pd(_mm256_sub_pd(lz, _mm256_loadu_pd(cz + i)), h);
+        __m256d b = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, sx), dx),
+                                  _mm256_mul_pd(_mm256_mul_pd(two, sy), dy));
+        __m256d c =
+            _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(sx, sx), _mm256_mul_pd(sy, sy)), one);
+        __m256d b24ac = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a4, c));
+        __m256d sq = _mm256_sqrt_pd(b24ac);
+        __m256d minus_b = _mm256_xor_pd(b, _mm256_set1_pd(-0.0));
+        __m256d t0 = _mm256_div_pd(_mm256_add_pd(minus_b, sq), a2);
+        __m256d t1 = _mm256_div_pd(_mm256_sub_pd(minus_b, sq), a2);
+        __m256d swap = _mm256_cmp_pd(t0, t1, _CMP_GT_OQ);
+        __m256d lo = _mm256_blendv_pd(t0, t1, swap);
+        __m256d hi = _mm256_blendv_pd(t1, t0, swap);
+        __m256d y0 = _mm256_add_pd(sz, _mm256_mul_pd(lo, dz));
+        __m256d y1 = _mm256_add_pd(sz, _mm256_mul_pd(hi, dz));
+        __m256d span = _mm256_sub_pd(hi, lo), dy01 = _mm256_sub_pd(y0, y1);
+
+        // below: hit the bottom cap
+        __m256d th =
+            _mm256_add_pd(lo, _mm256_div_pd(_mm256_mul_pd(span, _mm256_add_pd(y0, one)), dy01));
+        __m256d below = _mm256_and_pd(
+            _mm256_cmp_pd(y0, minus_one, _CMP_LT_OQ),
+            _mm256_and_pd(_mm256_cmp_pd(y1, minus_one, _CMP_NLT_UQ),
+                          _mm256_cmp_pd(th, minus_eps, _CMP_NLE_UQ)));
+        // inside: hit the cylinder bit
+        __m256d inside = _mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(y0, minus_one, _CMP_GE_OQ),
+                          _mm256_cmp_pd(y0, one, _CMP_LE_OQ)),
+            _mm256_and_pd(_mm256_cmp_pd(lo, zero, _CMP_GE_OQ), _mm256_cmp_pd(lo, one, _CMP_LE_OQ)));
+        inside = _mm256_and_pd(inside, _mm256_cmp_pd(lo, minus_eps, _CMP_NLT_UQ));
+        // above: hit the top cap
+        th = _mm256_add_pd(lo, _mm256_div_pd(_mm256_mul_pd(span, _mm256_sub_pd(y0, one)), dy01));
+        __m256d above = _mm256_and_pd(_mm256_cmp_pd(y0, one, _CMP_GT_OQ),
+                                      _mm256_and_pd(_mm256_cmp_pd(y1, one, _CMP_NGT_UQ),
+                                                    _mm256_cmp_pd(th, zero, _CMP_NLE_UQ)));
+
+        __m256d result = _mm256_or_pd(below, _mm256_or_pd(inside, above));
+        result = _mm256_and_pd(result, _mm256_cmp_pd(b24ac, zero, _CMP_NLT_UQ));
+        int mask = _mm256_movemask_pd(result);
+        for (int k = 0; k < 4; ++k)
+            hit[i + k] = (mask >> k) & 1;
+    }
+    intersectsSSE2(line1, line2, cx + i, cy + i, cz + i, n - i, radius, height, hit + i);
+}
+#endif
+
+static IntersectsBatchFn pickIntersectsBatch() {
+#ifdef GEOMETRY_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return intersectsAVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return intersectsSSE2;
+#endif
+    return intersectsScalar;
+}
+
+static const IntersectsBatchFn intersectsBatch = pickIntersectsBatch();
+
+//-----------------------------------------------------------------------------
+// SmokeIndex
+//-----------------------------------------------------------------------------
+const double smoke_cell_size = 256;
+
+static int cellOf(double v) {
+    return (int)std::floor(v / smoke_cell_size);
+}
+
+static unsigned long long cellKey(int cx, int cy) {
+    return ((unsigned long long)(unsigned)cx << 32) | (unsigned)cy;
+}
+
+SmokeIndex::SmokeIndex(double radius_, double height_)
+    : radius(radius_), height(height_), mark(0) {
+    clear();
+}
+
+void SmokeIndex::clear() {
+    xs.clear();
+    ys.clear();
+    zs.clear();
+    ids.clear();
+    marks.clear();
+    slot_of.clear();
+    grid.clear();
+    min_cx = min_cy = std::numeric_limits<int>::max();
+    max_cx = max_cy = std::numeric_limits<int>::min();
+}
+
+void SmokeIndex::addToGrid(int slot) {
+    int x0 = cellOf(xs[slot] - radius), x1 = cellOf(xs[slot] + radius);
+    int y0 = cellOf(ys[slot] - radius), y1 = cellOf(ys[slot] + radius);
+    for (int x = x0; x <= x1; ++x)
+        for (int y = y0; y <= y1; ++y)
+            grid[cellKey(x, y)].push_back(slot);
+    min_cx = std::min(min_cx, x0);
+    min_cy = std::min(min_cy, y0);
+    max_cx = std::max(max_cx, x1);
+    max_cy = std::max(max_cy, y1);
+}
+
+void SmokeIndex::removeFromGrid(int slot) {
+    int x0 = cellOf(xs[slot] - radius), x1 = cellOf(xs[slot] + radius);
+    int y0 = cellOf(ys[slot] - radius), y1 = cellOf(ys[slot] + radius);
+    for (int x = x0; x <= x1; ++x) {
+        for (int y = y0; y <= y1; ++y) {
+            auto cell = grid.find(cellKey(x, y));
+            if (cell == grid.end())
+                continue;
+            std::vector<int> &cell_slots = cell->second;
+            auto it = std::find(cell_slots.begin(), cell_slots.end(), slot);
+            if (it != cell_slots.end()) {
+                *it = cell_slots.back();
+                cell_slots.pop_back();
+            }
+            if (cell_slots.empty())
+                grid.erase(cell);
+        }
+    }
+}
+
+void SmokeIndex::add(int id, const Point &center) {
+    remove(id);
+    int slot = (int)ids.size();
+    xs.push_back(center.x);
+    ys.push_back(center.y);
+    zs.push_back(center.z);
+    ids.push_back(id);
+    marks.push_back(mark);
+    slot_of[id] = slot;
+    addToGrid(slot);
+}
+
+void SmokeIndex::remove(int id) {
+    auto found = slot_of.find(id);
+    if (found == slot_of.end())
+        return;
+    int slot = found->second;
+    int last = (int)ids.size() - 1;
+    slot_of.erase(found);
+    removeFromGrid(slot);
+    if (slot != last) {
+        // move the last smoke into the hole
+        removeFromGrid(last);
+        xs[slot] = xs[last];
+        ys[slot] = ys[last];
+        zs[slot] = zs[last];
+        ids[slot] = ids[last];
+        slot_of[ids[slot]] = slot;
+        addToGrid(slot);
+    }
+    xs.pop_back();
+    ys.pop_back();
+    zs.pop_back();
+    ids.pop_back();
+    marks.pop_back();
+}
+
+Point SmokeIndex::center(int id) const {
+    int slot = slot_of.at(id);
+    return Point(xs[slot], ys[slot], zs[slot]);
+}
+
+// Slots of the smokes in the cells crossed by the part of the line intersects() can report a hit
+// on: t >= -epsilon, and t <= 1 unless the line can hit a cap, which needs a vertical component.
+void SmokeIndex::candidates(const Point &line1, const Point &line2, std::vector<int> &out) {
+    out.clear();
+    Point d = line2 - line1;
+    if (ids.empty() || (d.x == 0 && d.y == 0))
+        return;
+
+    double t_min = -epsilon;
+    double t_max = d.z == 0 ? 1 : std::numeric_limits<double>::infinity();
+    // clip to the occupied cells, with a unit of slack for rounding
+    const double lo[2] = {min_cx * smoke_cell_size - 1, min_cy * smoke_cell_size - 1};
+    const double hi[2] = {(max_cx + 1) * smoke_cell_size + 1, (max_cy + 1) * smoke_cell_size + 1};
+    const double p[2] = {line1.x, line1.y};
+    const double dir[2] = {d.x, d.y};
+    for (int axis = 0; axis < 2; ++axis) {
+        if (dir[axis] == 0) {
+            if (p[axis] < lo[axis] || p[axis] > hi[axis])
+                return;
+            continue;
+        }
+        double ta = (lo[axis] - p[axis]) / dir[axis];
+        double tb = (hi[axis] - p[axis]) / dir[axis];
+        t_min = std::max(t_min, std::min(ta, tb));
+        t_max = std::min(t_max, std::max(ta, tb));
+    }
+    if (t_min > t_max)
+        return;
+
+    double xa = line1.x + t_min * d.x, xb = line1.x + t_max * d.x;
+    double ya = line1.y + t_min * d.y, yb = line1.y + t_max * d.y;
+    int x0 = std::max(min_cx, cellOf(std::min(xa, xb) - 1));
+    int x1 = std::min(max_cx, cellOf(std::max(xa, xb) + 1));
+    int y0 = std::max(min_cy, cellOf(std::min(ya, yb) - 1));
+    int y1 = std::min(max_cy, cellOf(std::max(ya, yb) + 1));
+
+    ++mark;
+    for (int x = x0; x <= x1; ++x) {
+        for (int y = y0; y <= y1; ++y) {
+            auto cell = grid.find(cellKey(x, y));
+            if (cell == grid.end())
+                continue;
+            for (int slot : cell->second) {
+                if (marks[slot] != mark) {
+                    marks[slot] = mark;
+                    out.push_back(slot);
+                }
+            }
+        }
+    }
+}
+
+void SmokeIndex::blocking(const Point *line1,
+                          const Point *line2,
+                          int count,
+                          std::vector<int> &blocked) {
+    if (count <= 0)
+        return;
+    candidates(line1[0], line2[0], slots);
+
+    int n = (int)slots.size();
+    cx.resize(n);
+    cy.resize(n);
+    cz.resize(n);
+    hits.resize(n);
+    for (int i = 0; i < n; ++i) {
+        cx[i] = xs[slots[i]];
+        cy[i] = ys[slots[i]];
+        cz[i] = zs[slots[i]];
+    }
+
+    // every line only needs to be tested against the smokes all previous lines went through
+    for (int line = 0; line < count && n > 0; ++line) {
+        intersectsBatch(line1[line], line2[line], &cx[0], &cy[0], &cz[0], n, radius, height,
+                        &hits[0]);
+        int kept = 0;
+        for (int i = 0; i < n; ++i) {
+            if (hits[i]) {
+                cx[kept] = cx[i];
+                cy[kept] = cy[i];
+                cz[kept] = cz[i];
+                slots[kept] = slots[i];
+                ++kept;
+            }
+        }
+        n = kept;
+    }
+
+    size_t first = blocked.size();
+    for (int i = 0; i < n; ++i)
+        blocked.push_back(ids[slots[i]]);
+    std::sort(blocked.begin() + first, blocked.end());
+}
@@ -1,3 +1,9 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <unordered_map>
+#include <vector>
+
 struct Point {
     double x, y, z;
     Point() {}
@@ -5,4 +11,47 @@ struct Point {
     Point operator-(const Point &p) const { return Point(x - p.x, y - p.y, z - p.z); }
 };
 
-bool intersects(Point line1, Point line2, Point center, double radius, double height);
\ No newline at end of file
+bool intersects(Point line1, Point line2, Point center, double radius, double height);
+
+// Active smokes, all with the same radius and height, stored as arrays of center coordinates
+// with a uniform XY grid over them. blocking() gives the same answers as calling intersects()
+// on every smoke, but only tests the smokes near the lines and tests several at once.
+class SmokeIndex {
+public:
+    SmokeIndex(double radius, double height);
+
+    void add(int id, const Point &center);
+    void remove(int id);
+    void clear();
+    bool empty() const { return ids.empty(); }
+
+    // Appends to blocked the ids, in ascending order, of the smokes that every line1[i] -> line2[i]
+    // goes through.
+    void blocking(const Point *line1, const Point *line2, int count, std::vector<int> &blocked);
+
+    Point center(int id) const;
+
+private:
+    void addToGrid(int slot);
+    void removeFromGrid(int slot);
+    void candidates(const Point &line1, const Point &line2, std::vector<int> &slots);
+
+    double radius, height;
+    // one entry per smoke
+    std::vector<double> xs, ys, zs;
+    std::vector<int> ids;
+    std::vector<unsigned> marks;
+    unsigned mark;
+    std::unordered_map<int, int> slot_of;
+    // cell key to slots of the smokes that overlap the cell
+    std::unordered_map<unsigned long long, std::vector<int>> grid;
+    // bounds of the occupied cells, only shrinks on clear()
+    int min_cx, min_cy, max_cx, max_cy;
+
+    // scratch for blocking()
+    std::vector<int> slots;
+    std::vector<double> cx, cy, cz;
+    std::vector<unsigned char> hits;
+};
+
+#endif // GEOMETRY_H
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include "matchstats.h"
+
+// health every player starts a round with
+#define MATCHSTATS_HEALTH 100
+
+static int KeyInt(const CSVCMsg_GameEvent &msg, int nKey) {
+    if (nKey < 0 || nKey >= msg.keys_size())
+        return 0;
+    const CSVCMsg_GameEvent::key_t &key = msg.keys(nKey);
+    if (key.has_val_short())
+        return key.val_short();
+    if (key.has_val_byte())
+        return key.val_byte();
+    if (key.has_val_long())
+        return key.val_long();
+    if (key.has_val_bool())
+        return key.val_bool();
+    if (key.has_val_float())
+        return (int)key.val_float();
+    return 0;
+}
+
+CMatchStats::CMatchStats() : m_nTradeTicks((int)(MATCHSTATS_TRADE_SECONDS * 64)) { Clear(); }
+
+void CMatchStats::Clear() {
+    m_playerIndices.clear();
+    m_xuids.clear();
+    m_health.clear();
+    m_kills.clear();
+    m_bRoundOpen = false;
+    m_bRoundEnded = false;
+    m_nRounds = 0;
+    m_round = Round();
+    m_last = Round();
+    m_match = Round();
+}
+
+void CMatchStats::Compile(const CSVCMsg_GameEventList &list) {
+    static const char *const s_keyNames[kKey_Count] = {
+        "userid", "attacker", "assister", "health", "dmg_health", "headshot", "winner",
+    };
+
+    m_events.clear();
+    for (int i = 0; i < list.descriptors_size(); i++) {
+        const CSVCMsg_GameEventList::descriptor_t &descriptor = list.descriptors(i);
+        EventKeys keys;
+        const std::string &name = descriptor.name();
+        if (name == "player_hurt")
+            keys.kind = kKind_Hurt;
+        else if (name == "player_death")
+            keys.kind = kKind_Death;
+        else if (name == "round_start")
+            keys.kind = kKind_RoundStart;
+        else if (name == "round_end")
+            keys.kind = kKind_RoundEnd;
+        else if (name == "round_announce_match_start")
+            keys.kind = kKind_MatchStart;
+        else
+            continue;
+
+        for (int j = 0; j < descriptor.keys_size(); j++) {
+            for (int k = 0; k < kKey_Count; k++) {
+                if (descriptor.keys(j).name() == s_keyNames[k])
+                    keys.keys[k] = j;
+            }
+        }
+        if (descriptor.eventid() < 0)
+            continue;
+        if (descriptor.eventid() >= (int)m_events.size())
+            m_events.resize(descriptor.eventid() + 1);
+        m_events[descriptor.eventid()] = keys;
+    }
+}
+
+// Re-lays the damage matrix out for nPlayers, which only grows.
+void CMatchStats::Grow(Round &round, int nPlayers) {
+    int nOld = (int)round.players.size();
+    std::vector<int> damage(nPlayers * nPlayers, 0);
+    for (int i = 0; i < nOld; i++) {
+        for (int j = 0; j < nOld; j++)
+            damage[i * nPlayers + j] = round.damage[i * nOld + j];
+    }
+    round.damage.swap(damage);
+    round.players.resize(nPlayers);
+}
+
+int CMatchStats::PlayerIndex(uint64 xuid) {
+    std::unordered_map<uint64, int>::const_iterator i = m_playerIndices.find(xuid);
+    if (i != m_playerIndices.end())
+        return i->second;
+
+    int nPlayer = (int)m_xuids.size();
+    m_playerIndices[xuid] = nPlayer;
+    m_xuids.push_back(xuid);
+    m_health.push_back(MATCHSTATS_HEALTH);
+    Grow(m_round, nPlayer + 1);
+    Grow(m_match, nPlayer + 1);
+    return nPlayer;
+}
+
+void CMatchStats::OpenRound(int tick) {
+    int nPlayers = NumPlayers();
+    m_round.nRound = ++m_nRounds;
+    m_round.nStartTick = tick;
+    m_round.nEndTick = tick;
+    m_round.winner = 0;
+    m_round.players.assign(nPlayers, Player());
+    m_round.damage.assign(nPlayers * nPlayers, 0);
+    m_health.assign(nPlayers, MATCHSTATS_HEALTH);
+    m_kills.clear();
+    m_bRoundOpen = true;
+    m_bRoundEnded = false;
+}
+
+void CMatchStats::CloseRound(int tick) {
+    if (!m_bRoundEnded)
+        m_round.nEndTick = tick;
+    m_bRoundOpen = false;
+
+    for (int i = 0; i < NumPlayers(); i++) {
+        const Player &player = m_round.players[i];
+        Player &total = m_match.players[i];
+        total.kills += player.kills;
+        total.deaths += player.deaths;
+        total.assists += player.assists;
+        total.headshots += player.headshots;
+        total.damage += player.damage;
+        total.teamDamage += player.teamDamage;
+        total.trades += player.trades;
+        total.traded += player.traded;
+        if (player.kills > 0)
+            total.multikills[std::min(player.kills, 5) - 1]++;
+    }
+    for (size_t i = 0; i < m_round.damage.size(); i++)
+        m_match.damage[i] += m_round.damage[i];
+    m_match.nRound = m_nRounds;
+    m_match.nEndTick = m_round.nEndTick;
+    m_last = m_round;
+}
+
+void CMatchStats::Hurt(int nVictim, int nAttacker, bool bTeammate, int nDamage, int nHealth) {
+    int nDealt = std::max(std::min(nDamage, m_health[nVictim]), 0);
+    m_health[nVictim] = nHealth;
+    if (nAttacker < 0 || nAttacker == nVictim)
+        return;
+
+    if (bTeammate) {
+        m_round.players[nAttacker].teamDamage += nDealt;
+    } else {
+        m_round.players[nAttacker].damage += nDealt;
+        m_round.damage[nAttacker * NumPlayers() + nVictim] += nDealt;
+    }
+}
+
+void CMatchStats::Death(int tick,
+                        int nVictim,
+                        int victimTeam,
+                        int nAttacker,
+                        int attackerTeam,
+                        int nAssister,
+                        bool bHeadshot) {
+    m_round.players[nVictim].deaths++;
+    m_health[nVictim] = 0;
+    if (nAttacker < 0 || nAttacker == nVictim)
+        return;
+    // teams are unknown without the player entities, count those kills as enemy kills
+    if (victimTeam && victimTeam == attackerTeam)
+        return;
+
+    Player &attacker = m_round.players[nAttacker];
+    attacker.kills++;
+    if (bHeadshot)
+        attacker.headshots++;
+    if (nAssister >= 0 && nAssister != nAttacker)
+        m_round.players[nAssister].assists++;
+
+    // the victim had just killed one of the attacker's teammates
+    for (size_t i = m_kills.size(); attackerTeam && i-- > 0;) {
+        Kill &kill = m_kills[i];
+        if (tick - kill.tick > m_nTradeTicks)
+            break;
+        if (kill.nKiller == nVictim && kill.victimTeam == attackerTeam) {
+            attacker.trades++;
+            m_round.players[kill.nVictim].traded++;
+            // traded once
+            kill.nKiller = -1;
+            break;
+        }
+    }
+    Kill kill = {tick, nAttacker, nVictim, victimTeam};
+    m_kills.push_back(kill);
+}
+
+bool CMatchStats::Event(const CSVCMsg_GameEvent &msg, int tick, XuidFn xuidOf, TeamFn teamOf) {
+    if (msg.eventid() < 0 || msg.eventid() >= (int)m_events.size())
+        return false;
+    const EventKeys &event = m_events[msg.eventid()];
+
+    switch (event.kind) {
+    case kKind_None:
+        return false;
+    case kKind_MatchStart:
+        // everything so far was warmup
+        Clear();
+        return false;
+    case kKind_RoundStart: {
+        bool bClosed = m_bRoundOpen;
+        if (bClosed)
+            CloseRound(tick);
+        OpenRound(tick);
+        return bClosed;
+    }
+    case kKind_RoundEnd:
+        if (!m_bRoundOpen || m_bRoundEnded)
+            return false;
+        m_round.nEndTick = tick;
+        m_round.winner = KeyInt(msg, event.keys[kKey_Winner]);
+        m_bRoundEnded = true;
+        return false;
+    default:
+        break;
+    }
+
+    // player_hurt and player_death; userid 0 is the world
+    int victimId = KeyInt(msg, event.keys[kKey_UserId]);
+    int attackerId = KeyInt(msg, event.keys[kKey_Attacker]);
+    if (victimId <= 0)
+        return false;
+    int nVictim = PlayerIndex(xuidOf(victimId));
+    int nAttacker = attackerId > 0 ? PlayerIndex(xuidOf(attackerId)) : -1;
+    int victimTeam = teamOf(victimId);
+    int attackerTeam = attackerId > 0 ? teamOf(attackerId) : 0;
+    if (!m_bRoundOpen)
+        OpenRound(tick);
+
+    if (event.kind == kKind_Hurt) {
+        Hurt(nVictim, nAttacker, victimTeam && victimTeam == attackerTeam,
+             KeyInt(msg, event.keys[kKey_DmgHealth]), KeyInt(msg, event.keys[kKey_Health]));
+    } else {
+        int assisterId = KeyInt(msg, event.keys[kKey_Assister]);
+        int nAssister = assisterId > 0 ? PlayerIndex(xuidOf(assisterId)) : -1;
+        Death(tick, nVictim, victimTeam, nAttacker, attackerTeam, nAssister,
+              KeyInt(msg, event.keys[kKey_Headshot]) != 0);
+    }
+    return false;
+}
+
+bool CMatchStats::Finish(int tick) {
+    if (!m_bRoundOpen)
+        return false;
+    CloseRound(tick);
+    return true;
+}
@@ -0,0 +1,139 @@
+#ifndef MATCHSTATS_H
+#define MATCHSTATS_H
+
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+#include "demofile.h"
+#include "netmessages.pb.h"
+
+// killing the killer of a teammate within this is a trade
+#define MATCHSTATS_TRADE_SECONDS 5.0
+
+// -stats: kills, deaths, assists, headshots, damage, trades and multikills per player, and
+// damage per attacker and victim, added up from player_hurt and player_death as they come, so
+// the per round and per match summaries replace the raw events.
+//
+// Players are xuids (userids for bots) mapped to dense indices; per player and per pair counters
+// live in flat arrays indexed by them. Event keys are resolved to key indices once per game event
+// list, like -where does.
+//
+// A round runs from round_start to the next one, so kills after round_end still count for it, and
+// is closed then. Events before the first round_start open a round of their own, and
+// round_announce_match_start throws away everything before it (the warmup).
+class CMatchStats {
+public:
+    typedef uint64 (*XuidFn)(int userid);
+    // team number of the player, 0 if unknown
+    typedef int (*TeamFn)(int userid);
+
+    struct Player {
+        Player() { memset(this, 0, sizeof(*this)); }
+
+        int kills;
+        int deaths;
+        int assists;
+        int headshots;
+        // health taken from enemies, at most what they had left
+        int damage;
+        int teamDamage;
+        // kills of an enemy who had just killed a teammate, and deaths such a kill avenged
+        int trades;
+        int traded;
+        // match totals only: rounds with 1, 2, 3, 4 and 5 or more kills
+        int multikills[5];
+    };
+
+    struct Round {
+        int nRound;
+        int nStartTick;
+        // round_end's tick and winning team number, or the closing tick and 0 without one
+        int nEndTick;
+        int winner;
+        // by player index
+        std::vector<Player> players;
+        // health attacker took from victim, at [attacker * players.size() + victim]
+        std::vector<int> damage;
+    };
+
+    CMatchStats();
+
+    void Clear();
+    void Compile(const CSVCMsg_GameEventList &list);
+    // MATCHSTATS_TRADE_SECONDS in ticks. Default is 64 tick.
+    void SetTradeWindow(int nTicks) { m_nTradeTicks = nTicks; }
+
+    // Adds the event up. True when it closed a round, which is then LastRound().
+    bool Event(const CSVCMsg_GameEvent &msg, int tick, XuidFn xuidOf, TeamFn teamOf);
+    // Closes the round still open at the end of the demo. True if there was one.
+    bool Finish(int tick);
+
+    int NumPlayers() const { return (int)m_xuids.size(); }
+    uint64 Xuid(int nPlayer) const { return m_xuids[nPlayer]; }
+    const Round &LastRound() const { return m_last; }
+    int NumRounds() const { return m_nRounds; }
+    // whole match, multikills included
+    const Round &Match() const { return m_match; }
+
+private:
+    enum Kind {
+        kKind_None,
+        kKind_Hurt,
+        kKind_Death,
+        kKind_RoundStart,
+        kKind_RoundEnd,
+        kKind_MatchStart,
+    };
+    enum Key {
+        kKey_UserId,
+        kKey_Attacker,
+        kKey_Assister,
+        kKey_Health,
+        kKey_DmgHealth,
+        kKey_Headshot,
+        kKey_Winner,
+        kKey_Count
+    };
+    struct EventKeys {
+        EventKeys() : kind(kKind_None) {
+            for (int i = 0; i < kKey_Count; i++)
+                keys[i] = -1;
+        }
+        Kind kind;
+        // key index in the descriptor, -1 when it doesn't have it
+        int keys[kKey_Count];
+    };
+    struct Kill {
+        int tick;
+        int nKiller;
+        int nVictim;
+        int victimTeam;
+    };
+
+    int PlayerIndex(uint64 xuid);
+    void Grow(Round &round, int nPlayers);
+    void OpenRound(int tick);
+    void CloseRound(int tick);
+    void Hurt(int nVictim, int nAttacker, bool bTeammate, int nDamage, int nHealth);
+    void Death(int tick, int nVictim, int victimTeam, int nAttacker, int attackerTeam,
+               int nAssister, bool bHeadshot);
+
+    // by event id
+    std::vector<EventKeys> m_events;
+    std::unordered_map<uint64, int> m_playerIndices;
+    std::vector<uint64> m_xuids;
+    // health left this round, by player index
+    std::vector<int> m_health;
+    // kills of this round, for trades
+    std::vector<Kill> m_kills;
+    int m_nTradeTicks;
+    bool m_bRoundOpen;
+    // round_end came, the round closes on the next round_start
+    bool m_bRoundEnded;
+    int m_nRounds;
+    Round m_round;
+    Round m_last;
+    Round m_match;
+};
+
+#endif // MATCHSTATS_H
@@ -0,0 +1,171 @@
+#include "memstats.h"
+
+#ifdef DEMOINFOGO_MEMSTATS
+
+#include <atomic>
+#include <new>
+#include <signal.h>
+#include <stdlib.h>
+#if defined(_WIN32) || defined(_WIN64)
+#define MEM_THREAD_LOCAL __declspec(thread)
+#else
+#define MEM_THREAD_LOCAL __thread
+#endif
+
+struct MemCounters {
+    std::atomic<long long> live;
+    std::atomic<long long> peak;
+    std::atomic<long long> allocs;
+    std::atomic<long long> frees;
+};
+
+struct MessageCounters {
+    const char *pName;
+    std::atomic<long long> messages;
+    std::atomic<long long> allocs;
+    std::atomic<long long> bytes;
+};
+
+static const char *const s_TagNames[kMem_Count] = {
+    "other", "file buffer", "schema", "entities", "string tables", "events", "output", "protobuf",
+};
+
+// zero initialized before any constructor runs, so allocations of static constructors count too
+static MemCounters s_tags[kMem_Count];
+static MemCounters s_total;
+static MessageCounters s_messages[MEMSTATS_MAX_MESSAGES];
+
+static MEM_THREAD_LOCAL int s_nTag;
+// net message being handled + 1, 0 for none
+static MEM_THREAD_LOCAL int s_nMessage;
+
+static volatile sig_atomic_t s_bReportRequested;
+
+// In front of every block: its size and tag. 16 bytes, so blocks keep the alignment of malloc.
+#define MEM_HEADER_SIZE 16
+
+static void AddLive(MemCounters &counters, long long nBytes) {
+    long long live = counters.live.fetch_add(nBytes, std::memory_order_relaxed) + nBytes;
+    long long peak = counters.peak.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !counters.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+static void *CountedAlloc(size_t nBytes) {
+    char *pBlock = (char *)malloc(nBytes + MEM_HEADER_SIZE);
+    if (!pBlock)
+        return NULL;
+
+    int nTag = s_nTag;
+    *(size_t *)pBlock = nBytes;
+    *(int *)(pBlock + sizeof(size_t)) = nTag;
+
+    AddLive(s_tags[nTag], nBytes);
+    AddLive(s_total, nBytes);
+    s_tags[nTag].allocs.fetch_add(1, std::memory_order_relaxed);
+    s_total.allocs.fetch_add(1, std::memory_order_relaxed);
+    if (s_nMessage) {
+        MessageCounters &message = s_messages[s_nMessage - 1];
+        message.allocs.fetch_add(1, std::memory_order_relaxed);
+        message.bytes.fetch_add(nBytes, std::memory_order_relaxed);
+    }
+    return pBlock + MEM_HEADER_SIZE;
+}
+
+static void CountedFree(void *p) {
+    if (!p)
+        return;
+
+    char *pBlock = (char *)p - MEM_HEADER_SIZE;
+    long long nBytes = *(size_t *)pBlock;
+    int nTag = *(int *)(pBlock + sizeof(size_t));
+    s_tags[nTag].live.fetch_sub(nBytes, std::memory_order_relaxed);
+    s_total.live.fetch_sub(nBytes, std::memory_order_relaxed);
+    s_tags[nTag].frees.fetch_add(1, std::memory_order_relaxed);
+    s_total.frees.fetch_add(1, std::memory_order_relaxed);
+    free(pBlock);
+}
+
+void *operator new(size_t nBytes) {
+    void *p = CountedAlloc(nBytes);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t nBytes) {
+    void *p = CountedAlloc(nBytes);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new(size_t nBytes, const std::nothrow_t &) throw() { return CountedAlloc(nBytes); }
+void *operator new[](size_t nBytes, const std::nothrow_t &) throw() {
+    return CountedAlloc(nBytes);
+}
+void operator delete(void *p) throw() { CountedFree(p); }
+void operator delete[](void *p) throw() { CountedFree(p); }
+void operator delete(void *p, const std::nothrow_t &) throw() { CountedFree(p); }
+void operator delete[](void *p, const std::nothrow_t &) throw() { CountedFree(p); }
+
+CMemScope::CMemScope(MemTag tag) : m_previous((MemTag)s_nTag) { s_nTag = tag; }
+
+CMemScope::~CMemScope() { s_nTag = m_previous; }
+
+CMemMessageScope::CMemMessageScope(int nCmd, const char *pName) : m_nPrevious(s_nMessage) {
+    if (nCmd >= 0 && nCmd < MEMSTATS_MAX_MESSAGES) {
+        s_messages[nCmd].pName = pName;
+        s_messages[nCmd].messages.fetch_add(1, std::memory_order_relaxed);
+        s_nMessage = nCmd + 1;
+    }
+}
+
+CMemMessageScope::~CMemMessageScope() { s_nMessage = m_nPrevious; }
+
+void MemStatsReport(FILE *fp) {
+    fprintf(fp, "memstats: %-14s %14s %14s %12s %12s\n", "subsystem", "live bytes", "peak bytes",
+            "allocs", "frees");
+    for (int i = 0; i <= kMem_Count; i++) {
+        const MemCounters &counters = i < kMem_Count ? s_tags[i] : s_total;
+        fprintf(fp, "memstats: %-14s %14lld %14lld %12lld %12lld\n",
+                i < kMem_Count ? s_TagNames[i] : "total", counters.live.load(),
+                counters.peak.load(), counters.allocs.load(), counters.frees.load());
+    }
+
+    fprintf(fp, "memstats: %-24s %10s %12s %12s %12s\n", "net message", "count", "allocs",
+            "allocs/msg", "bytes/msg");
+    for (int i = 0; i < MEMSTATS_MAX_MESSAGES; i++) {
+        const MessageCounters &message = s_messages[i];
+        long long nMessages = message.messages.load();
+        if (!nMessages)
+            continue;
+        fprintf(fp, "memstats: %-24s %10lld %12lld %12.1f %12.1f\n", message.pName, nMessages,
+                message.allocs.load(), (double)message.allocs.load() / nMessages,
+                (double)message.bytes.load() / nMessages);
+    }
+    fflush(fp);
+}
+
+static void ReportAtExit() { MemStatsReport(stderr); }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void RequestReport(int) { s_bReportRequested = 1; }
+#endif
+
+void MemStatsStart() {
+    atexit(ReportAtExit);
+#if !defined(_WIN32) && !defined(_WIN64)
+    signal(SIGUSR1, RequestReport);
+#endif
+}
+
+void MemStatsPoll() {
+    if (s_bReportRequested) {
+        s_bReportRequested = 0;
+        MemStatsReport(stderr);
+    }
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+// -memstats: live and peak bytes and allocation counts per subsystem, and allocations per net
+// message type, printed to stderr at exit and whenever the process gets SIGUSR1.
+//
+// Every operator new is counted against the subsystem of the innermost MEM_SCOPE(tag) of the
+// allocating thread, kMem_Other outside of any, and its operator delete against the same one.
+// MEM_MESSAGE_SCOPE(nCmd, pName) also counts allocations against the net message being handled.
+// malloc() isn't counted.
+//
+// Only compiled in with -DMEMSTATS=ON (DEMOINFOGO_MEMSTATS), which replaces the global operator
+// new and delete. Otherwise the macros are empty and -memstats only prints a warning.
+
+#include <stdio.h>
+
+enum MemTag {
+    kMem_Other,
+    kMem_FileBuffer,
+    kMem_Schema,
+    kMem_Entities,
+    kMem_StringTables,
+    kMem_Events,
+    kMem_Output,
+    kMem_Protobuf,
+    kMem_Count
+};
+
+#ifdef DEMOINFOGO_MEMSTATS
+
+#define MEMSTATS_MAX_MESSAGES 64
+
+class CMemScope {
+public:
+    explicit CMemScope(MemTag tag);
+    ~CMemScope();
+
+private:
+    MemTag m_previous;
+};
+
+class CMemMessageScope {
+public:
+    CMemMessageScope(int nCmd, const char *pName);
+    ~CMemMessageScope();
+
+private:
+    int m_nPrevious;
+};
+
+#define MEM_CONCAT2(a, b) a##b
+#define MEM_CONCAT(a, b) MEM_CONCAT2(a, b)
+#define MEM_SCOPE(tag) CMemScope MEM_CONCAT(memScope, __LINE__)(tag)
+#define MEM_MESSAGE_SCOPE(nCmd, pName) CMemMessageScope MEM_CONCAT(memMessage, __LINE__)(nCmd, pName)
+
+// Prints the report at exit and on SIGUSR1.
+void MemStatsStart();
+// Prints the report if SIGUSR1 came since the last call. Cheap, called once per frame.
+void MemStatsPoll();
+void MemStatsReport(FILE *fp);
+
+#else
+
+#define MEM_SCOPE(tag)
+#define MEM_MESSAGE_SCOPE(nCmd, pName)
+
+inline void MemStatsStart() {
+    fprintf(stderr, "-memstats: demoinfogo was built without -DMEMSTATS=ON, not counting.\n");
+}
+inline void MemStatsPoll() {}
+inline void MemStatsReport(FILE *fp) {}
+
+#endif
+
+#endif // MEMSTATS_H
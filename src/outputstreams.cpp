@@ -0,0 +1,62 @@
+#include <errno.h>
+#include <string.h>
+#include "outputstreams.h"
+
+// stdio buffer of every opened stream
+#define OUTPUT_STREAM_BUFFER_SIZE (1 << 20)
+
+FILE *g_pOutputStreams[kOutput_Count] = {stdout, stdout, stdout, stdout, stdout,
+                                         stdout, stdout, stdout, stdout, stdout};
+
+static const char *const s_kindNames[kOutput_Count] = {
+    "gameevents", "deaths",  "stringtables", "datatables", "packetentities",
+    "netmessages", "samples", "stateat",      "stats",      "json",
+};
+
+int OutputKindByName(const char *pName, size_t nLength) {
+    for (int i = 0; i < kOutput_Count; i++) {
+        if (strlen(s_kindNames[i]) == nLength && !strncasecmp(pName, s_kindNames[i], nLength))
+            return i;
+    }
+    return -1;
+}
+
+const char *OutputKindNames() {
+    return "gameevents, deaths, stringtables, datatables, packetentities, netmessages, samples, "
+           "stateat, stats, json";
+}
+
+bool OutputStreamOpen(OutputKind kind, const char *pPath, std::string &error) {
+    FILE *fp = fopen(pPath, "wb");
+    if (!fp) {
+        error = std::string("couldn't open ") + pPath + ": " + strerror(errno);
+        return false;
+    }
+    setvbuf(fp, NULL, _IOFBF, OUTPUT_STREAM_BUFFER_SIZE);
+    if (g_pOutputStreams[kind] != stdout)
+        fclose(g_pOutputStreams[kind]);
+    g_pOutputStreams[kind] = fp;
+    return true;
+}
+
+void OutputStreamsClose() {
+    for (int i = 0; i < kOutput_Count; i++) {
+        if (g_pOutputStreams[i] == stdout)
+            continue;
+        if (fclose(g_pOutputStreams[i]) != 0)
+            fprintf(stderr, "Couldn't write %s output: %s\n", s_kindNames[i], strerror(errno));
+        g_pOutputStreams[i] = stdout;
+    }
+}
+
+COutputWideBuf::int_type COutputWideBuf::overflow(int_type c) {
+    if (c != traits_type::eof())
+        putc((char)c, m_fp);
+    return traits_type::not_eof(c);
+}
+
+std::streamsize COutputWideBuf::xsputn(const wchar_t *pData, std::streamsize nCount) {
+    for (std::streamsize i = 0; i < nCount; i++)
+        putc((char)pData[i], m_fp);
+    return nCount;
+}
@@ -0,0 +1,56 @@
+#ifndef OUTPUTSTREAMS_H
+#define OUTPUTSTREAMS_H
+
+#include <stdio.h>
+#include <streambuf>
+#include <string>
+
+// -out:kind=path: each kind of output can go to a file of its own instead of stdout, so one
+// parse writes, say, the deaths CSV, the JSON events and the sampled positions that used to take
+// a parse each. Every kind prints to OutputStream(kind), which is stdout unless redirected.
+//
+// Files are plain and written through a large stdio buffer of their own; stdout still goes
+// through the output writer and -o.
+enum OutputKind {
+    kOutput_GameEvents,
+    kOutput_Deaths,
+    kOutput_StringTables,
+    kOutput_DataTables,
+    kOutput_PacketEntities,
+    kOutput_NetMessages,
+    kOutput_Samples,
+    kOutput_StateAt,
+    kOutput_Stats,
+    kOutput_Json,
+    kOutput_Count
+};
+
+extern FILE *g_pOutputStreams[kOutput_Count];
+
+inline FILE *OutputStream(OutputKind kind) { return g_pOutputStreams[kind]; }
+
+// kind for its -out name (gameevents, deaths, ...), -1 if there's none
+int OutputKindByName(const char *pName, size_t nLength);
+// Comma separated list of the kind names, for messages.
+const char *OutputKindNames();
+
+// Opens path for kind. False, with error set, if it can't be written.
+bool OutputStreamOpen(OutputKind kind, const char *pPath, std::string &error);
+// Flushes and closes every opened stream, they go back to stdout.
+void OutputStreamsClose();
+
+// Wide character output (json_spirit writes to a std::wostream) onto a FILE *, narrowed the way
+// std::wcout narrows ASCII.
+class COutputWideBuf : public std::wstreambuf {
+public:
+    explicit COutputWideBuf(FILE *fp) : m_fp(fp) {}
+
+protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(const wchar_t *pData, std::streamsize nCount);
+
+private:
+    FILE *m_fp;
+};
+
+#endif // OUTPUTSTREAMS_H
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include "outputwriter.h"
+#include "trace.h"
+#ifdef DEMOINFOGO_ZLIB
+#include <zlib.h>
+#endif
+#ifdef DEMOINFOGO_ZSTD
+#include <zstd.h>
+#endif
+
+enum OutputCompression { kCompress_None, kCompress_Gzip, kCompress_Zstd };
+
+// gzip level, faster levels keep up with the parse better than they lose in size
+#define OUTPUT_GZIP_LEVEL 1
+#define OUTPUT_ZSTD_LEVEL 3
+
+// Compression the file name asks for, false with error set if this build can't do it.
+static bool CompressionOf(const char *pFileName, OutputCompression &compression,
+                          std::string &error) {
+    size_t nLength = strlen(pFileName);
+    compression = kCompress_None;
+    if (nLength > 3 && !strcmp(pFileName + nLength - 3, ".gz")) {
+        compression = kCompress_Gzip;
+#ifndef DEMOINFOGO_ZLIB
+        error = "this build has no zlib for .gz";
+        return false;
+#endif
+    } else if (nLength > 4 && !strcmp(pFileName + nLength - 4, ".zst")) {
+        compression = kCompress_Zstd;
+#ifndef DEMOINFOGO_ZSTD
+        error = "this build has no zstd for .zst";
+        return false;
+#endif
+    }
+    return true;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+bool OutputWriterStart() { return false; }
+
+bool OutputWriterStartFile(const char *pFileName, std::string &error) {
+    OutputCompression compression;
+    if (!CompressionOf(pFileName, compression, error))
+        return false;
+    if (compression != kCompress_None) {
+        error = "compressed output needs the output writer";
+        return false;
+    }
+    if (!freopen(pFileName, "wb", stdout)) {
+        error = std::string("couldn't open ") + pFileName;
+        return false;
+    }
+    return true;
+}
+
+void OutputWriterStop() { fflush(stdout); }
+
+void OutputWriterTee(int nTee) {}
+
+bool OutputWriterTeeOk() { return false; }
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <thread>
+
+// a bigger pipe lets the parse run further ahead, Linux only
+#define OUTPUT_PIPE_SIZE (1 << 20)
+#define OUTPUT_WRITE_SIZE (1 << 16)
+
+static std::thread s_writer;
+// stdout is redirected, through s_writer or straight to a plain -o file
+static bool s_bRedirected = false;
+// read end of the pipe, where the writer writes, and with -o where stdout pointed before
+static int s_nPipeRead = -1;
+static int s_nOutput = -1;
+static int s_nStdout = -1;
+// -cache's copy of the output, and whether every write to it worked
+static int s_nTee = -1;
+static bool s_bTeeOk = true;
+
+static bool WriteAll(int fd, const char *pData, size_t nBytes) {
+    while (nBytes) {
+        ssize_t nWritten = write(fd, pData, nBytes);
+        if (nWritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        pData += nWritten;
+        nBytes -= nWritten;
+    }
+    return true;
+}
+
+// Takes what the parse wrote, compresses it if asked to and writes it to nOutput. Called with
+// no data once the pipe is drained, to end the compressed stream.
+class COutputEncoder {
+public:
+    virtual ~COutputEncoder() {}
+    virtual bool Write(int nOutput, const char *pData, size_t nBytes, bool bEnd) = 0;
+};
+
+class CPlainEncoder : public COutputEncoder {
+public:
+    virtual bool Write(int nOutput, const char *pData, size_t nBytes, bool bEnd) {
+        return WriteAll(nOutput, pData, nBytes);
+    }
+};
+
+#ifdef DEMOINFOGO_ZLIB
+class CGzipEncoder : public COutputEncoder {
+public:
+    CGzipEncoder() {
+        memset(&m_stream, 0, sizeof(m_stream));
+        // 16 on top of the window bits asks for a gzip header and trailer
+        deflateInit2(&m_stream, OUTPUT_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    }
+    virtual ~CGzipEncoder() { deflateEnd(&m_stream); }
+
+    virtual bool Write(int nOutput, const char *pData, size_t nBytes, bool bEnd) {
+        m_stream.next_in = (Bytef *)pData;
+        m_stream.avail_in = (uInt)nBytes;
+        int result;
+        do {
+            m_stream.next_out = (Bytef *)m_out;
+            m_stream.avail_out = sizeof(m_out);
+            result = deflate(&m_stream, bEnd ? Z_FINISH : Z_NO_FLUSH);
+            if (result == Z_STREAM_ERROR)
+                return false;
+            if (!WriteAll(nOutput, m_out, sizeof(m_out) - m_stream.avail_out))
+                return false;
+        } while (m_stream.avail_out == 0 || (bEnd && result != Z_STREAM_END));
+        return true;
+    }
+
+private:
+    z_stream m_stream;
+    char m_out[OUTPUT_WRITE_SIZE];
+};
+#endif
+
+#ifdef DEMOINFOGO_ZSTD
+class CZstdEncoder : public COutputEncoder {
+public:
+    CZstdEncoder() : m_pContext(ZSTD_createCCtx()) {
+        ZSTD_CCtx_setParameter(m_pContext, ZSTD_c_compressionLevel, OUTPUT_ZSTD_LEVEL);
+    }
+    virtual ~CZstdEncoder() { ZSTD_freeCCtx(m_pContext); }
+
+    virtual bool Write(int nOutput, const char *pData, size_t nBytes, bool bEnd) {
+        ZSTD_inBuffer in = {pData, nBytes, 0};
+        size_t nLeft;
+        do {
+            ZSTD_outBuffer out = {m_out, sizeof(m_out), 0};
+            nLeft = ZSTD_compressStream2(m_pContext, &out, &in,
+                                         bEnd ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(nLeft))
+                return false;
+            if (!WriteAll(nOutput, m_out, out.pos))
+                return false;
+        } while (bEnd ? nLeft != 0 : in.pos < in.size);
+        return true;
+    }
+
+private:
+    ZSTD_CCtx *m_pContext;
+    char m_out[OUTPUT_WRITE_SIZE];
+};
+#endif
+
+static COutputEncoder *NewEncoder(OutputCompression compression) {
+    switch (compression) {
+#ifdef DEMOINFOGO_ZLIB
+    case kCompress_Gzip:
+        return new CGzipEncoder();
+#endif
+#ifdef DEMOINFOGO_ZSTD
+    case kCompress_Zstd:
+        return new CZstdEncoder();
+#endif
+    default:
+        return new CPlainEncoder();
+    }
+}
+
+static void WriterThread(int nPipeRead, int nOutput, int nTee, COutputEncoder *pEncoder) {
+    static char s_buffer[OUTPUT_WRITE_SIZE];
+    bool bFailed = false;
+    while (true) {
+        ssize_t nRead = read(nPipeRead, s_buffer, sizeof(s_buffer));
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+            break;
+        TRACE_SCOPE_ARG("WriteOutput", "bytes", nRead);
+        if (nTee >= 0 && s_bTeeOk && !WriteAll(nTee, s_buffer, nRead))
+            s_bTeeOk = false;
+        // keep draining after a failed write, so the parse never blocks on a full pipe
+        if (!bFailed && !pEncoder->Write(nOutput, s_buffer, nRead, false)) {
+            fprintf(stderr, "Couldn't write output: %s\n", strerror(errno));
+            bFailed = true;
+        }
+    }
+    if (!bFailed && !pEncoder->Write(nOutput, NULL, 0, true))
+        fprintf(stderr, "Couldn't write output: %s\n", strerror(errno));
+    delete pEncoder;
+}
+
+// Points stdout at a new pipe whose other end the writer drains into nOutput, which it owns from
+// here on.
+static bool StartWriter(int nOutput, OutputCompression compression) {
+    static bool s_bAtExit = false;
+
+    int fds[2];
+    fflush(stdout);
+    if (pipe(fds) != 0) {
+        close(nOutput);
+        return false;
+    }
+#ifdef F_SETPIPE_SZ
+    fcntl(fds[1], F_SETPIPE_SZ, OUTPUT_PIPE_SIZE);
+#endif
+    if (dup2(fds[1], STDOUT_FILENO) < 0) {
+        close(nOutput);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    close(fds[1]);
+    s_nPipeRead = fds[0];
+    s_nOutput = nOutput;
+    s_writer =
+        std::thread(WriterThread, s_nPipeRead, s_nOutput, s_nTee, NewEncoder(compression));
+
+    s_bRedirected = true;
+    if (!s_bAtExit) {
+        atexit(OutputWriterStop);
+        s_bAtExit = true;
+    }
+    return true;
+}
+
+// Points stdout at nOutput, a plain file, and closes it.
+static bool RedirectStdout(int nOutput) {
+    fflush(stdout);
+    bool bOk = dup2(nOutput, STDOUT_FILENO) >= 0;
+    close(nOutput);
+    s_bRedirected = bOk;
+    return bOk;
+}
+
+bool OutputWriterStart() {
+    if (s_writer.joinable())
+        return true;
+    if (s_bRedirected)
+        return false;
+
+    int nOutput = dup(STDOUT_FILENO);
+    return nOutput >= 0 && StartWriter(nOutput, kCompress_None);
+}
+
+bool OutputWriterStartFile(const char *pFileName, std::string &error) {
+    OutputCompression compression;
+    if (!CompressionOf(pFileName, compression, error))
+        return false;
+    if (s_bRedirected) {
+        error = "output is already redirected";
+        return false;
+    }
+
+    int nOutput = open(pFileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (nOutput < 0) {
+        error = std::string("couldn't open ") + pFileName + ": " + strerror(errno);
+        return false;
+    }
+    s_nStdout = dup(STDOUT_FILENO);
+    bool bDirect = compression == kCompress_None && s_nTee < 0;
+    if (s_nStdout < 0 ||
+        !(bDirect ? RedirectStdout(nOutput) : StartWriter(nOutput, compression))) {
+        if (s_nStdout >= 0)
+            close(s_nStdout);
+        s_nStdout = -1;
+        error = std::string("couldn't redirect output to ") + pFileName;
+        return false;
+    }
+    return true;
+}
+
+void OutputWriterTee(int nTee) {
+    s_nTee = nTee;
+    s_bTeeOk = true;
+}
+
+bool OutputWriterTeeOk() { return s_bTeeOk; }
+
+void OutputWriterStop() {
+    if (!s_bRedirected)
+        return;
+    s_bRedirected = false;
+
+    std::wcout.flush();
+    fflush(stdout);
+    if (!s_writer.joinable()) {
+        // a plain -o file, closed by putting stdout back
+        dup2(s_nStdout, STDOUT_FILENO);
+        close(s_nStdout);
+        s_nStdout = -1;
+        return;
+    }
+
+    // closes the last write end of the pipe, the writer ends once it has drained it
+    dup2(s_nStdout >= 0 ? s_nStdout : s_nOutput, STDOUT_FILENO);
+    s_writer.join();
+    close(s_nPipeRead);
+    close(s_nOutput);
+    if (s_nStdout >= 0)
+        close(s_nStdout);
+    s_nPipeRead = -1;
+    s_nOutput = -1;
+    s_nStdout = -1;
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+// Writer stage of the dump, for output that takes work past the printf: while started, stdout
+// goes through a pipe to a thread that compresses it for -o, .gz (gzip, needs zlib) or .zst
+// (needs zstd), and copies it for -cache. printf and std::wcout are both covered, they end up on
+// file descriptor 1. The pipe is the bounded queue between the two: the parse only blocks when
+// the writer is a whole pipe behind.
+//
+// Plain output has nothing to take off the parse, moving it through the pipe only adds a copy:
+// a plain -o file becomes stdout itself and the writer isn't started.
+//
+// POSIX only, elsewhere output stays synchronous and -o can only write plain files.
+
+#include <string>
+
+// Starts redirecting stdout through the writer. False, and output stays synchronous, if it can't.
+bool OutputWriterStart();
+// Starts redirecting stdout to pFileName, through the writer if it's compressed or teed. False,
+// with error set, if it can't.
+bool OutputWriterStartFile(const char *pFileName, std::string &error);
+// Flushes stdout, waits until the writer has written everything and puts stdout back. Also runs
+// at exit, so output of a fatal error isn't lost.
+void OutputWriterStop();
+// From the next start on, the writer also writes everything, uncompressed, to nTee, which stays
+// the caller's. -1 for none. Not on Windows.
+void OutputWriterTee(int nTee);
+// False if a write to the tee failed since OutputWriterTee.
+bool OutputWriterTeeOk();
+
+#endif // OUTPUTWRITER_H
@@ -0,0 +1,85 @@
+#include <string.h>
+#include "playerregistry.h"
+
+// Userids and slots are indices into plain arrays. Game events carry userids as shorts and string
+// tables have at most 1 << 16 entries, so nothing real goes past this.
+#define PLAYERREGISTRY_MAX_INDEX (1 << 16)
+
+static bool InRange(int nIndex) { return nIndex >= 0 && nIndex < PLAYERREGISTRY_MAX_INDEX; }
+
+void CPlayerRegistry::Clear() {
+    ClearSlots();
+    m_userIdSeen.clear();
+    m_seen.clear();
+    m_xuidSlots.clear();
+}
+
+void CPlayerRegistry::ClearSlots() {
+    m_slots.clear();
+    m_userIdSlots.clear();
+}
+
+void CPlayerRegistry::UnmapUserId(int userId, int nSlot) {
+    if (InRange(userId) && userId < (int)m_userIdSlots.size() && m_userIdSlots[userId] == nSlot)
+        m_userIdSlots[userId] = -1;
+}
+
+bool CPlayerRegistry::Set(const player_info_t &info) {
+    int nSlot = info.entityID;
+    if (!InRange(nSlot))
+        return false;
+
+    if (nSlot >= (int)m_slots.size())
+        m_slots.resize(nSlot + 1);
+    Slot &slot = m_slots[nSlot];
+    bool bAdded = !slot.bUsed;
+    if (slot.bUsed)
+        UnmapUserId(slot.info.userID, nSlot);
+    slot.bUsed = true;
+    slot.info = info;
+
+    if (InRange(info.userID)) {
+        if (info.userID >= (int)m_userIdSlots.size())
+            m_userIdSlots.resize(info.userID + 1, -1);
+        if (info.userID >= (int)m_userIdSeen.size())
+            m_userIdSeen.resize(info.userID + 1, 0);
+        m_userIdSlots[info.userID] = nSlot;
+        if (!m_userIdSeen[info.userID]) {
+            m_seen.push_back(info);
+            m_userIdSeen[info.userID] = (int)m_seen.size();
+        } else {
+            m_seen[m_userIdSeen[info.userID] - 1] = info;
+        }
+    }
+    if (!info.fakeplayer && !info.ishltv)
+        m_xuidSlots[info.xuid] = nSlot;
+    return bAdded;
+}
+
+void CPlayerRegistry::Disconnect(player_info_t *pInfo) {
+    UnmapUserId(pInfo->userID, pInfo->entityID);
+    strcpy(pInfo->name, "disconnected");
+    pInfo->userID = -1;
+    pInfo->guid[0] = 0;
+}
+
+player_info_t *CPlayerRegistry::FindByEntity(int nSlot) {
+    if (nSlot < 0 || nSlot >= (int)m_slots.size() || !m_slots[nSlot].bUsed)
+        return NULL;
+    return &m_slots[nSlot].info;
+}
+
+player_info_t *CPlayerRegistry::FindByUserId(int userId) {
+    if (userId < 0 || userId >= (int)m_userIdSlots.size() || m_userIdSlots[userId] < 0)
+        return NULL;
+    return &m_slots[m_userIdSlots[userId]].info;
+}
+
+std::vector<const player_info_t *> CPlayerRegistry::SeenUserIds() const {
+    std::vector<const player_info_t *> players;
+    for (size_t i = 0; i < m_userIdSeen.size(); i++) {
+        if (m_userIdSeen[i])
+            players.push_back(&m_seen[m_userIdSeen[i] - 1]);
+    }
+    return players;
+}
@@ -0,0 +1,55 @@
+#ifndef PLAYERREGISTRY_H
+#define PLAYERREGISTRY_H
+
+#include <unordered_map>
+#include <vector>
+#include "demofiledump.h"
+
+// Every player of the demo, found by entity slot (the userinfo string table entry, entity index
+// - 1), by userid or by xuid in constant time. Userinfo string table updates and player_connect /
+// player_disconnect events keep it up to date as they come.
+//
+// Slots hold the current players. Besides them it remembers the latest info of every userid and
+// the slot of every human xuid seen since Clear(), disconnected or not, for the -hsbox output.
+class CPlayerRegistry {
+public:
+    // Forgets everything, for the next demo.
+    void Clear();
+    // Empties the slots, for a full userinfo table. Seen userids and xuids stay.
+    void ClearSlots();
+
+    // Puts the player in its slot, info.entityID, replacing whoever was there. True if the slot
+    // was empty.
+    bool Set(const player_info_t &info);
+    // Marks the player in pInfo's slot as disconnected: it keeps the slot, but loses its userid.
+    void Disconnect(player_info_t *pInfo);
+
+    player_info_t *FindByEntity(int nSlot);
+    // The current player with userId, NULL if none.
+    player_info_t *FindByUserId(int userId);
+
+    // Latest info of every userid seen, in userid order.
+    std::vector<const player_info_t *> SeenUserIds() const;
+    // Slot of every human xuid seen.
+    const std::unordered_map<uint64, int> &XuidSlots() const { return m_xuidSlots; }
+
+private:
+    struct Slot {
+        Slot() : bUsed(false) {}
+
+        bool bUsed;
+        player_info_t info;
+    };
+
+    void UnmapUserId(int userId, int nSlot);
+
+    std::vector<Slot> m_slots;
+    // userid to slot, -1 for none
+    std::vector<int> m_userIdSlots;
+    // userid to index in m_seen + 1, 0 for never seen
+    std::vector<int> m_userIdSeen;
+    std::vector<player_info_t> m_seen;
+    std::unordered_map<uint64, int> m_xuidSlots;
+};
+
+#endif // PLAYERREGISTRY_H
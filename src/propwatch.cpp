@@ -0,0 +1,106 @@
+#include <algorithm>
+#include "propwatch.h"
+
+CPropWatch::CPropWatch() : m_nDirty(0) {}
+
+void CPropWatch::Clear() {
+    m_targets.clear();
+    m_watched.clear();
+    m_callbacks.clear();
+    m_nDirty = 0;
+    m_oldValues.clear();
+}
+
+void CPropWatch::Watch(const char *pDTName, const char *pPropName, Callback callback) {
+    Target target;
+    target.dtName = pDTName;
+    target.propName = pPropName;
+    target.callback = callback;
+    m_targets.push_back(target);
+}
+
+void CPropWatch::Resolve(const std::vector<ServerClass_t> &classes) {
+    m_watched.assign(classes.size(), std::vector<int>());
+    m_callbacks.clear();
+    m_nDirty = 0;
+    m_oldValues.clear();
+    for (const Target &target : m_targets) {
+        for (size_t uClass = 0; uClass < classes.size(); uClass++) {
+            const ServerClass_t &serverClass = classes[uClass];
+            if (target.dtName != serverClass.strDTName)
+                continue;
+            std::vector<int> &watched = m_watched[uClass];
+            watched.resize(serverClass.flattenedProps.size(), -1);
+            for (size_t i = 0; i < serverClass.flattenedProps.size(); i++) {
+                if (serverClass.flattenedProps[i].m_prop->var_name() != target.propName)
+                    continue;
+                if (watched[i] < 0) {
+                    watched[i] = (int)m_callbacks.size();
+                    m_callbacks.push_back(std::vector<Callback>());
+                }
+                m_callbacks[watched[i]].push_back(target.callback);
+            }
+        }
+    }
+}
+
+void CPropWatch::Changed(EntityEntry *pEntity,
+                         int nProp,
+                         const PropEntry *pEntry,
+                         const Prop_t *pReplaced) {
+    // a slot left from before a Clear() or Resolve() may be someone else's by now
+    size_t nSlot = (size_t)pEntity->m_nWatchSlot;
+    if (pEntity->m_nWatchSlot < 0 || nSlot >= m_nDirty || m_dirty[nSlot].pEntity != pEntity) {
+        if (m_nDirty == m_dirty.size())
+            m_dirty.push_back(DirtyEntity());
+        nSlot = m_nDirty++;
+        pEntity->m_nWatchSlot = (int)nSlot;
+        m_dirty[nSlot].pEntity = pEntity;
+        m_dirty[nSlot].bits.assign((m_watched[pEntity->m_uClass].size() + 63) / 64, 0);
+        m_dirty[nSlot].old.clear();
+    }
+    DirtyEntity &dirty = m_dirty[nSlot];
+
+    uint64 &word = dirty.bits[nProp / 64];
+    uint64 bit = (uint64)1 << (nProp % 64);
+    // the value before the first change is the old one
+    if (word & bit)
+        return;
+    word |= bit;
+
+    OldValue old;
+    old.nProp = nProp;
+    old.pEntry = pEntry;
+    old.nFirst = m_oldValues.size();
+    old.nElements = 0;
+    if (pReplaced) {
+        old.nElements = pReplaced->NumProps();
+        m_oldValues.insert(m_oldValues.end(), pReplaced, pReplaced + old.nElements);
+    }
+    dirty.old.push_back(old);
+}
+
+void CPropWatch::Forget(const EntityEntry *pEntity) {
+    size_t nSlot = (size_t)pEntity->m_nWatchSlot;
+    if (pEntity->m_nWatchSlot >= 0 && nSlot < m_nDirty && m_dirty[nSlot].pEntity == pEntity)
+        m_dirty[nSlot].pEntity = NULL;
+}
+
+void CPropWatch::Flush() {
+    for (size_t i = 0; i < m_nDirty; i++) {
+        DirtyEntity &dirty = m_dirty[i];
+        if (!dirty.pEntity)
+            continue;
+        dirty.pEntity->m_nWatchSlot = -1;
+        const std::vector<int> &watched = m_watched[dirty.pEntity->m_uClass];
+        std::sort(dirty.old.begin(), dirty.old.end(),
+                  [](const OldValue &a, const OldValue &b) { return a.nProp < b.nProp; });
+        for (const OldValue &old : dirty.old) {
+            const Prop_t *pOldValue = old.nElements ? &m_oldValues[old.nFirst] : NULL;
+            for (Callback callback : m_callbacks[watched[old.nProp]])
+                callback(dirty.pEntity, pOldValue, old.pEntry->m_pPropValue);
+        }
+    }
+    m_nDirty = 0;
+    m_oldValues.clear();
+}
@@ -0,0 +1,72 @@
+#ifndef PROPWATCH_H
+#define PROPWATCH_H
+
+#include <string>
+#include <vector>
+#include "demofiledump.h"
+
+// Prop change callbacks. Consumers Watch() a prop of a data table by name, Resolve() turns that
+// into a table by server class and flattened prop index once the data tables are flattened, so
+// the decode loop only looks up the index of each decoded prop, without comparing names.
+//
+// While a PacketEntities message is decoded, Changed() marks the prop in a dirty bitset of the
+// entity, found through its m_nWatchSlot, and keeps the value it had before along with the entry
+// holding the new one. Flush(), at the end of the message (one per tick),
+// calls the callbacks once per changed prop with the old and the new value, entity by entity in
+// the order they changed and props by index, which is the order they were decoded in.
+class CPropWatch {
+public:
+    // pOld is NULL when the entity didn't have the prop yet
+    typedef void (*Callback)(const EntityEntry *pEntity, const Prop_t *pOld, const Prop_t *pNew);
+
+    CPropWatch();
+
+    // Forgets the watches and anything not flushed yet.
+    void Clear();
+    void Watch(const char *pDTName, const char *pPropName, Callback callback);
+    void Resolve(const std::vector<ServerClass_t> &classes);
+
+    bool IsWatched(uint32 uClass, int nProp) const {
+        return uClass < m_watched.size() && nProp < (int)m_watched[uClass].size() &&
+               m_watched[uClass][nProp] >= 0;
+    }
+    // After the entity's prop nProp is set, pEntry being its entry and pReplaced the value it had,
+    // NULL for a new prop.
+    void Changed(EntityEntry *pEntity, int nProp, const PropEntry *pEntry,
+                 const Prop_t *pReplaced);
+    // The entity is going away, it doesn't get its callbacks.
+    void Forget(const EntityEntry *pEntity);
+    void Flush();
+
+private:
+    struct Target {
+        std::string dtName;
+        std::string propName;
+        Callback callback;
+    };
+    struct OldValue {
+        int nProp;
+        const PropEntry *pEntry;
+        // elements in m_oldValues, none without an old value
+        size_t nFirst;
+        int nElements;
+    };
+    struct DirtyEntity {
+        EntityEntry *pEntity;
+        // by flattened prop index
+        std::vector<uint64> bits;
+        // in the order changed, sorted by nProp when flushed
+        std::vector<OldValue> old;
+    };
+
+    std::vector<Target> m_targets;
+    // by server class and flattened prop index, its callbacks in m_callbacks or -1
+    std::vector<std::vector<int>> m_watched;
+    std::vector<std::vector<Callback>> m_callbacks;
+    // entities changed in this message, the first m_nDirty, by their m_nWatchSlot
+    std::vector<DirtyEntity> m_dirty;
+    size_t m_nDirty;
+    std::vector<Prop_t> m_oldValues;
+};
+
+#endif // PROPWATCH_H
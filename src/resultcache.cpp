@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <string.h>
+#include "outputwriter.h"
+#include "resultcache.h"
+
+// bumped when entries written by older builds can't be trusted any more
+#define RESULTCACHE_VERSION 1
+// fingerprint samples past the signon data, and how big each is
+#define RESULTCACHE_SAMPLES 16
+#define RESULTCACHE_SAMPLE_SIZE (64 * 1024)
+// -cachefull hashes the file in pieces of this
+#define RESULTCACHE_CHUNK_SIZE (1024 * 1024)
+#define RESULTCACHE_SUFFIX ".out"
+// temporary copies older than this were left by a run that was killed
+#define RESULTCACHE_STALE_SECONDS (24 * 60 * 60)
+
+#if defined(_WIN32) || defined(_WIN64)
+
+CResultCache::CResultCache(const char *pDir, uint64 nMaxBytes)
+    : m_dir(pDir ? pDir : ""), m_nMaxBytes(nMaxBytes), m_nTemp(-1) {}
+
+CResultCache::~CResultCache() {}
+
+bool CResultCache::Key(const char *pDemo, const std::string &flags, bool bFull,
+                       std::string &error) {
+    error = "-cache isn't supported on Windows";
+    return false;
+}
+
+bool CResultCache::Replay(const char *pOutputFile) { return false; }
+
+bool CResultCache::Begin(const char *pOutputFile) { return false; }
+
+void CResultCache::Store() {}
+
+void CResultCache::Abandon() {}
+
+void CResultCache::Trim() {}
+
+#else
+
+#include <algorithm>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+static const uint64 XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64 XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64 XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64 XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64 XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64 Rotl64(uint64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64 Read64(const unsigned char *p) {
+    uint64 x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint32 Read32(const unsigned char *p) {
+    uint32 x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint64 XXH64Round(uint64 acc, uint64 input) {
+    acc += input * XXH_PRIME64_2;
+    return Rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64 XXH64Merge(uint64 acc, uint64 val) {
+    acc ^= XXH64Round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64 of nBytes at pData, little endian hosts only.
+static uint64 XXH64(const void *pData, size_t nBytes, uint64 seed) {
+    const unsigned char *p = (const unsigned char *)pData;
+    const unsigned char *pEnd = p + nBytes;
+    uint64 h;
+
+    if (nBytes >= 32) {
+        uint64 v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64 v2 = seed + XXH_PRIME64_2;
+        uint64 v3 = seed;
+        uint64 v4 = seed - XXH_PRIME64_1;
+        for (; p + 32 <= pEnd; p += 32) {
+            v1 = XXH64Round(v1, Read64(p));
+            v2 = XXH64Round(v2, Read64(p + 8));
+            v3 = XXH64Round(v3, Read64(p + 16));
+            v4 = XXH64Round(v4, Read64(p + 24));
+        }
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = XXH64Merge(h, v1);
+        h = XXH64Merge(h, v2);
+        h = XXH64Merge(h, v3);
+        h = XXH64Merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += nBytes;
+
+    for (; p + 8 <= pEnd; p += 8) {
+        h ^= XXH64Round(0, Read64(p));
+        h = Rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= pEnd) {
+        h ^= Read32(p) * XXH_PRIME64_1;
+        h = Rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < pEnd; p++) {
+        h ^= *p * XXH_PRIME64_5;
+        h = Rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static void AppendValue(std::string &out, const void *pValue, size_t nBytes) {
+    out.append((const char *)pValue, nBytes);
+}
+
+// Hashes nBytes of fp from nOffset on, in pieces of at most RESULTCACHE_CHUNK_SIZE, onto out.
+static bool HashRange(FILE *fp, uint64 nOffset, uint64 nBytes, std::string &buffer,
+                      std::string &out) {
+    if (fseeko(fp, (off_t)nOffset, SEEK_SET) != 0)
+        return false;
+    while (nBytes) {
+        size_t nChunk = (size_t)std::min<uint64>(nBytes, RESULTCACHE_CHUNK_SIZE);
+        buffer.resize(nChunk);
+        if (fread(&buffer[0], 1, nChunk, fp) != nChunk)
+            return false;
+        uint64 hash = XXH64(buffer.data(), nChunk, 0);
+        AppendValue(out, &hash, sizeof(hash));
+        nBytes -= nChunk;
+    }
+    return true;
+}
+
+// the copy of a dump that exit()s halfway, removed at exit
+static std::string s_pendingTemp;
+
+static void RemovePendingTemp() {
+    if (!s_pendingTemp.empty())
+        unlink(s_pendingTemp.c_str());
+    s_pendingTemp.clear();
+}
+
+static bool CopyToStdout(int fd, uint64 nBytes) {
+#ifdef __linux__
+    // straight from the page cache when stdout takes it, a file or a pipe
+    while (nBytes) {
+        size_t nChunk = (size_t)std::min<uint64>(nBytes, 1 << 30);
+        ssize_t nSent = sendfile(STDOUT_FILENO, fd, NULL, nChunk);
+        if (nSent < 0 && errno == EINTR)
+            continue;
+        if (nSent <= 0)
+            break;
+        nBytes -= nSent;
+    }
+    if (!nBytes)
+        return true;
+#endif
+    char buffer[64 * 1024];
+    while (nBytes) {
+        ssize_t nRead = read(fd, buffer, sizeof(buffer));
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+            return false;
+        for (char *p = buffer; nRead > 0;) {
+            ssize_t nWritten = write(STDOUT_FILENO, p, nRead);
+            if (nWritten < 0 && errno == EINTR)
+                continue;
+            if (nWritten < 0)
+                return false;
+            p += nWritten;
+            nRead -= nWritten;
+            nBytes -= nWritten;
+        }
+    }
+    return true;
+}
+
+CResultCache::CResultCache(const char *pDir, uint64 nMaxBytes)
+    : m_dir(pDir ? pDir : ""), m_nMaxBytes(nMaxBytes), m_nTemp(-1) {}
+
+CResultCache::~CResultCache() { Abandon(); }
+
+bool CResultCache::Key(const char *pDemo, const std::string &flags, bool bFull,
+                       std::string &error) {
+    FILE *fp = fopen(pDemo, "rb");
+    if (!fp) {
+        error = std::string("couldn't open ") + pDemo;
+        return false;
+    }
+    struct stat demoStat;
+    demoheader_t header;
+    if (fstat(fileno(fp), &demoStat) != 0 || fread(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        error = std::string(pDemo) + " is too small for a demo";
+        return false;
+    }
+
+    std::string fingerprint;
+    char version[32];
+    snprintf(version, sizeof(version), "demoinfogo %d", RESULTCACHE_VERSION);
+    fingerprint.append(version);
+    fingerprint.push_back('\0');
+    // the build that writes the output, by size and time of the binary
+    struct stat exeStat;
+    if (stat("/proc/self/exe", &exeStat) == 0) {
+        AppendValue(fingerprint, &exeStat.st_size, sizeof(exeStat.st_size));
+        AppendValue(fingerprint, &exeStat.st_mtime, sizeof(exeStat.st_mtime));
+    }
+    fingerprint.append(flags);
+    fingerprint.push_back('\0');
+
+    uint64 nSize = demoStat.st_size;
+    AppendValue(fingerprint, &nSize, sizeof(nSize));
+    AppendValue(fingerprint, &header, sizeof(header));
+
+    std::string buffer;
+    uint64 nSignonEnd = std::min<uint64>(sizeof(header) + std::max(header.signonlength, 0), nSize);
+    bool bRead;
+    if (bFull) {
+        bRead = HashRange(fp, sizeof(header), nSize - sizeof(header), buffer, fingerprint);
+    } else {
+        bRead = HashRange(fp, sizeof(header), nSignonEnd - sizeof(header), buffer, fingerprint);
+        // evenly spread over the frames, the last one ending at the end of the file
+        uint64 nFrames = nSize - nSignonEnd;
+        uint64 nSample = std::min<uint64>(nFrames, RESULTCACHE_SAMPLE_SIZE);
+        for (int i = 0; bRead && nSample && i < RESULTCACHE_SAMPLES; i++) {
+            uint64 nOffset = nSignonEnd + (nFrames - nSample) * i / (RESULTCACHE_SAMPLES - 1);
+            bRead = HashRange(fp, nOffset, nSample, buffer, fingerprint);
+        }
+    }
+    fclose(fp);
+    if (!bRead) {
+        error = std::string("couldn't read ") + pDemo;
+        return false;
+    }
+
+    char key[33];
+    snprintf(key, sizeof(key), "%016llx%016llx",
+             (unsigned long long)XXH64(fingerprint.data(), fingerprint.size(), 0),
+             (unsigned long long)XXH64(fingerprint.data(), fingerprint.size(), XXH_PRIME64_1));
+    m_key = key;
+    return true;
+}
+
+bool CResultCache::Replay(const char *pOutputFile) {
+    std::string path = m_dir + "/" + m_key + RESULTCACHE_SUFFIX;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat entryStat;
+    if (fstat(fd, &entryStat) != 0) {
+        close(fd);
+        return false;
+    }
+    // most recently used now
+    utimes(path.c_str(), NULL);
+
+    // the dump then fails on -o the same way
+    std::string error;
+    if (pOutputFile && !OutputWriterStartFile(pOutputFile, error)) {
+        close(fd);
+        return false;
+    }
+    fflush(stdout);
+    if (!CopyToStdout(fd, entryStat.st_size))
+        fprintf(stderr, "Couldn't write output: %s\n", strerror(errno));
+    close(fd);
+    OutputWriterStop();
+    return true;
+}
+
+bool CResultCache::Begin(const char *pOutputFile) {
+    mkdir(m_dir.c_str(), 0755);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+    m_tempPath = m_dir + "/" + m_key + suffix;
+    m_nTemp = open(m_tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_nTemp < 0) {
+        fprintf(stderr, "-cache: couldn't create %s: %s\n", m_tempPath.c_str(), strerror(errno));
+        return false;
+    }
+    if (s_pendingTemp.empty())
+        atexit(RemovePendingTemp);
+    s_pendingTemp = m_tempPath;
+
+    OutputWriterTee(m_nTemp);
+    // -json output too has to go through the writer to be copied; -o starts it itself
+    if (!pOutputFile && !OutputWriterStart()) {
+        Abandon();
+        return false;
+    }
+    return true;
+}
+
+void CResultCache::Store() {
+    if (m_nTemp < 0)
+        return;
+    bool bOk = OutputWriterTeeOk();
+    OutputWriterTee(-1);
+    bOk = close(m_nTemp) == 0 && bOk;
+    m_nTemp = -1;
+    std::string path = m_dir + "/" + m_key + RESULTCACHE_SUFFIX;
+    if (!bOk || rename(m_tempPath.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "-cache: couldn't store %s\n", path.c_str());
+        unlink(m_tempPath.c_str());
+    }
+    s_pendingTemp.clear();
+    m_tempPath.clear();
+    Trim();
+}
+
+void CResultCache::Abandon() {
+    if (m_nTemp < 0)
+        return;
+    OutputWriterTee(-1);
+    close(m_nTemp);
+    unlink(m_tempPath.c_str());
+    m_nTemp = -1;
+    m_tempPath.clear();
+    s_pendingTemp.clear();
+}
+
+void CResultCache::Trim() {
+    struct Entry {
+        std::string path;
+        time_t mtime;
+        uint64 nBytes;
+
+        bool operator<(const Entry &other) const { return mtime < other.mtime; }
+    };
+
+    DIR *pDir = opendir(m_dir.c_str());
+    if (!pDir)
+        return;
+    std::vector<Entry> entries;
+    uint64 nTotal = 0;
+    time_t now = time(NULL);
+    size_t nSuffix = strlen(RESULTCACHE_SUFFIX);
+    while (struct dirent *pEntry = readdir(pDir)) {
+        size_t nName = strlen(pEntry->d_name);
+        bool bEntry = nName > nSuffix &&
+                      !strcmp(pEntry->d_name + nName - nSuffix, RESULTCACHE_SUFFIX);
+        bool bTemp = nName > 4 && !strcmp(pEntry->d_name + nName - 4, ".tmp");
+        if (!bEntry && !bTemp)
+            continue;
+        Entry entry;
+        entry.path = m_dir + "/" + pEntry->d_name;
+        struct stat entryStat;
+        if (stat(entry.path.c_str(), &entryStat) != 0 || !S_ISREG(entryStat.st_mode))
+            continue;
+        if (bTemp) {
+            if (now - entryStat.st_mtime > RESULTCACHE_STALE_SECONDS)
+                unlink(entry.path.c_str());
+            continue;
+        }
+        entry.mtime = entryStat.st_mtime;
+        entry.nBytes = entryStat.st_size;
+        nTotal += entry.nBytes;
+        entries.push_back(entry);
+    }
+    closedir(pDir);
+
+    // least recently used first
+    std::sort(entries.begin(), entries.end());
+    for (size_t i = 0; i < entries.size() && nTotal > m_nMaxBytes; i++) {
+        if (unlink(entries[i].path.c_str()) == 0)
+            nTotal -= entries[i].nBytes;
+    }
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <string>
+#include "demofile.h"
+
+// size cap of the cache directory unless -cachesize says otherwise
+#define RESULTCACHE_DEFAULT_MB 1024
+
+// -cache dir: output of earlier runs, by demo and flags, so a demo that comes in again (an upload
+// of a match we already have from GOTV) is streamed from the cache instead of parsed.
+//
+// Entries are keyed by a fingerprint of the demo, the flags that change the output and the
+// demoinfogo binary. The fingerprint hashes the header, the signon data, the file size and
+// RESULTCACHE_SAMPLES blocks spread over the rest of the file, which reads a few MB at most, or
+// with -cachefull every byte of it. The hash is XXH64.
+//
+// An entry is the uncompressed output, copied by the output writer as the dump writes it and
+// renamed into place once the dump is done, so concurrent runs and dumps that die never leave a
+// partial entry. A hit refreshes the entry's mtime; after every store the oldest entries go until
+// the directory is under the size cap.
+//
+// POSIX only.
+class CResultCache {
+public:
+    CResultCache(const char *pDir, uint64 nMaxBytes);
+    // Abandons an entry begun and not stored.
+    ~CResultCache();
+
+    // Fingerprints pDemo. flags are the options that change the output, in order. False, with
+    // error set, if the demo can't be read.
+    bool Key(const char *pDemo, const std::string &flags, bool bFull, std::string &error);
+    // On a hit writes the entry to stdout, or to pOutputFile like -o does, and returns true.
+    bool Replay(const char *pOutputFile);
+    // On a miss, before the dump: starts copying the output the dump writes. False if it can't,
+    // the dump then just isn't cached.
+    bool Begin(const char *pOutputFile);
+    // After the dump has stopped the output writer: stores the copy and trims the cache.
+    void Store();
+
+    const std::string &GetKey() const { return m_key; }
+
+private:
+    void Abandon();
+    void Trim();
+
+    std::string m_dir;
+    uint64 m_nMaxBytes;
+    std::string m_key;
+    // copy of the output being written, and its name until Store() renames it
+    int m_nTemp;
+    std::string m_tempPath;
+};
+
+#endif // RESULTCACHE_H
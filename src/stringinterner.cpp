@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include "stringinterner.h"
+
+#define INTERNER_BLOCK_SIZE (64 * 1024)
+#define INTERNER_MIN_SLOTS 256
+
+CStringInterner g_StringInterner;
+
+// FNV-1a
+static uint32 HashBytes(const char *pString, size_t nLength) {
+    uint32 uHash = 2166136261u;
+    for (size_t i = 0; i < nLength; i++) {
+        uHash ^= (unsigned char)pString[i];
+        uHash *= 16777619u;
+    }
+    return uHash;
+}
+
+CStringInterner::CStringInterner() : m_nCount(0), m_pFree(NULL), m_nFree(0) {}
+
+CStringInterner::~CStringInterner() { Clear(); }
+
+void CStringInterner::Clear() {
+    for (char *pBlock : m_blocks)
+        free(pBlock);
+    m_blocks.clear();
+    m_slots.clear();
+    m_nCount = 0;
+    m_pFree = NULL;
+    m_nFree = 0;
+}
+
+char *CStringInterner::Allocate(size_t nBytes) {
+    // keeps the id and length of the next string aligned
+    nBytes = (nBytes + 3) & ~(size_t)3;
+    if (nBytes > m_nFree) {
+        size_t nBlock = nBytes > INTERNER_BLOCK_SIZE / 4 ? nBytes : INTERNER_BLOCK_SIZE;
+        char *pBlock = (char *)malloc(nBlock);
+        m_blocks.push_back(pBlock);
+        // a string of its own leaves the current block to the next small ones
+        if (nBlock != INTERNER_BLOCK_SIZE)
+            return pBlock;
+        m_pFree = pBlock;
+        m_nFree = nBlock;
+    }
+    char *pResult = m_pFree;
+    m_pFree += nBytes;
+    m_nFree -= nBytes;
+    return pResult;
+}
+
+void CStringInterner::Grow() {
+    std::vector<Slot> slots(m_slots.empty() ? INTERNER_MIN_SLOTS : m_slots.size() * 2);
+    size_t nMask = slots.size() - 1;
+    for (const Slot &slot : m_slots) {
+        if (!slot.pString)
+            continue;
+        size_t i = slot.uHash & nMask;
+        while (slots[i].pString)
+            i = (i + 1) & nMask;
+        slots[i] = slot;
+    }
+    m_slots.swap(slots);
+}
+
+const char *CStringInterner::Intern(const char *pString, size_t nLength) {
+    if ((m_nCount + 1) * 2 > m_slots.size())
+        Grow();
+
+    uint32 uHash = HashBytes(pString, nLength);
+    size_t nMask = m_slots.size() - 1;
+    size_t i = uHash & nMask;
+    for (; m_slots[i].pString; i = (i + 1) & nMask) {
+        const char *pInterned = m_slots[i].pString;
+        if (m_slots[i].uHash == uHash && Length(pInterned) == nLength &&
+            memcmp(pInterned, pString, nLength) == 0)
+            return pInterned;
+    }
+
+    char *pEntry = Allocate(2 * sizeof(uint32) + nLength + 1);
+    ((uint32 *)pEntry)[0] = (uint32)m_nCount;
+    ((uint32 *)pEntry)[1] = (uint32)nLength;
+    char *pInterned = pEntry + 2 * sizeof(uint32);
+    memcpy(pInterned, pString, nLength);
+    pInterned[nLength] = 0;
+
+    m_slots[i].pString = pInterned;
+    m_slots[i].uHash = uHash;
+    m_nCount++;
+    return pInterned;
+}
@@ -0,0 +1,51 @@
+#ifndef STRINGINTERNER_H
+#define STRINGINTERNER_H
+
+#include <string.h>
+#include <vector>
+#include "demofile.h"
+
+// Every distinct string stored once. Intern() hashes the bytes and returns the same stable,
+// NUL terminated copy for the same bytes, so decoding a string prop or an event value costs a
+// lookup instead of an allocation, and interned strings compare by pointer. Each also has an id,
+// dense from 0 in interning order, for tables of what's derived from the string (its wide form
+// for -json, say).
+//
+// The dump interns into g_StringInterner, which CDemoFileDump::Reset() clears: pointers and ids
+// are per demo. Not thread safe.
+class CStringInterner {
+public:
+    CStringInterner();
+    ~CStringInterner();
+
+    const char *Intern(const char *pString, size_t nLength);
+    const char *Intern(const char *pString) { return Intern(pString, strlen(pString)); }
+
+    // of a pointer Intern() returned
+    static uint32 Id(const char *pInterned) { return ((const uint32 *)pInterned)[-2]; }
+    static uint32 Length(const char *pInterned) { return ((const uint32 *)pInterned)[-1]; }
+
+    size_t Count() const { return m_nCount; }
+    void Clear();
+
+private:
+    struct Slot {
+        const char *pString;
+        uint32 uHash;
+    };
+
+    char *Allocate(size_t nBytes);
+    void Grow();
+
+    // open addressing, a power of two at most half full
+    std::vector<Slot> m_slots;
+    size_t m_nCount;
+    // strings are an id and a length, then the bytes and a NUL, in blocks that never move
+    std::vector<char *> m_blocks;
+    char *m_pFree;
+    size_t m_nFree;
+};
+
+extern CStringInterner g_StringInterner;
+
+#endif // STRINGINTERNER_H
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "stringtableparser.h"
+
+// Updates can start an entry's string with a prefix of one of the last strings of the update.
+#define STRING_HISTORY_SIZE 32
+
+template <typename T>
+static void SwapBytes(T *output, const T *input) {
+    unsigned char temp[sizeof(T)];
+    for (unsigned int i = 0; i < sizeof(T); i++) {
+        temp[i] = ((const unsigned char *)input)[sizeof(T) - (i + 1)];
+    }
+    memcpy(output, temp, sizeof(T));
+}
+
+bool ParseStringTableUpdate(CBitRead &buf, int nEntries, int nMaxEntries, int nUserDataSize,
+                            int nUserDataSizeBits, int nUserDataFixedSize,
+                            StringTableEntryFn entryFn, void *pContext, std::string &error) {
+    char message[256];
+
+    // perform integer log2() to set nEntryBits
+    int nTemp = nMaxEntries;
+    int nEntryBits = 0;
+    while (nTemp >>= 1)
+        ++nEntryBits;
+
+    if (buf.ReadOneBit()) {
+        error = "Encoded with dictionaries, unable to decode.";
+        return false;
+    }
+
+    // the last strings, oldest first from nHistoryFirst, only as long as a prefix can be
+    char history[STRING_HISTORY_SIZE][1 << SUBSTRING_BITS];
+    int nHistory = 0;
+    int nHistoryFirst = 0;
+
+    int lastEntry = -1;
+    for (int i = 0; i < nEntries && !buf.IsOverflowed(); i++) {
+        int entryIndex = lastEntry + 1;
+        if (!buf.ReadOneBit()) {
+            entryIndex = buf.ReadUBitLong(nEntryBits);
+        }
+        lastEntry = entryIndex;
+
+        if (entryIndex < 0 || entryIndex >= nMaxEntries) {
+            snprintf(message, sizeof(message), "bogus string index %i", entryIndex);
+            error = message;
+            return false;
+        }
+
+        char entry[1024];
+        entry[0] = 0;
+        if (buf.ReadOneBit()) {
+            if (buf.ReadOneBit()) {
+                int index = buf.ReadUBitLong(5);
+                if (index >= nHistory) {
+                    snprintf(message, sizeof(message), "Invalid index %d, expected < %u", index,
+                             (unsigned)nHistory);
+                    error = message;
+                    return false;
+                }
+                int bytestocopy = buf.ReadUBitLong(SUBSTRING_BITS);
+                const char *pPrefix = history[(nHistoryFirst + index) % STRING_HISTORY_SIZE];
+                size_t nPrefix = std::min(strlen(pPrefix), (size_t)bytestocopy);
+                memcpy(entry, pPrefix, nPrefix);
+                buf.ReadString(entry + nPrefix, sizeof(entry) - nPrefix);
+            } else {
+                buf.ReadString(entry, sizeof(entry));
+            }
+        }
+
+        unsigned char tempbuf[MAX_USERDATA_SIZE];
+        const unsigned char *pUserData = NULL;
+        int nBytes = 0;
+        if (buf.ReadOneBit()) {
+            memset(tempbuf, 0, sizeof(tempbuf));
+            if (nUserDataFixedSize) {
+                // Don't need to read length, it's fixed length and the length was networked down
+                // already.
+                nBytes = nUserDataSize;
+                if (nBytes < 0 || size_t(nBytes) >= sizeof(tempbuf) || nUserDataSizeBits < 0 ||
+                    nUserDataSizeBits > 8 * nBytes) {
+                    snprintf(message, sizeof(message), "bad user data size (%d bytes, %d bits).",
+                             nBytes, nUserDataSizeBits);
+                    error = message;
+                    return false;
+                }
+                buf.ReadBits(tempbuf, nUserDataSizeBits);
+            } else {
+                nBytes = buf.ReadUBitLong(MAX_USERDATA_BITS);
+                if (size_t(nBytes) >= sizeof(tempbuf)) {
+                    snprintf(message, sizeof(message), "user data too large (%d bytes).", nBytes);
+                    error = message;
+                    return false;
+                }
+                buf.ReadBytes(tempbuf, nBytes);
+            }
+            pUserData = tempbuf;
+        }
+
+        StringTableEntry tableEntry = {entryIndex, entry, pUserData, nBytes, false};
+        entryFn(pContext, tableEntry);
+
+        char *pSlot;
+        if (nHistory < STRING_HISTORY_SIZE) {
+            pSlot = history[nHistory++];
+        } else {
+            pSlot = history[nHistoryFirst];
+            nHistoryFirst = (nHistoryFirst + 1) % STRING_HISTORY_SIZE;
+        }
+        size_t nLength = std::min(strlen(entry), sizeof(history[0]) - 1);
+        memcpy(pSlot, entry, nLength);
+        pSlot[nLength] = 0;
+    }
+    return true;
+}
+
+// The server's entries of a snapshot table, or its client side ones.
+static void ParseSnapshotEntries(CBitRead &buf, int nEntries, bool bClientSide,
+                                 StringTableEntryFn entryFn, void *pContext,
+                                 std::vector<unsigned char> &userData) {
+    for (int i = 0; i < nEntries && !buf.IsOverflowed(); i++) {
+        char stringname[4096];
+        buf.ReadString(stringname, sizeof(stringname));
+
+        StringTableEntry entry = {i, stringname, NULL, 0, bClientSide};
+        if (buf.ReadOneBit() == 1) {
+            entry.nUserDataBytes = (int)buf.ReadWord();
+            userData.assign(entry.nUserDataBytes + 1, 0);
+            buf.ReadBytes(&userData[0], entry.nUserDataBytes);
+            entry.pUserData = &userData[0];
+        }
+        entryFn(pContext, entry);
+    }
+}
+
+void ParseStringTableSnapshot(CBitRead &buf, StringTableFn tableFn, StringTableEntryFn entryFn,
+                              void *pContext) {
+    std::vector<unsigned char> userData;
+    int numTables = buf.ReadByte();
+    for (int i = 0; i < numTables && !buf.IsOverflowed(); i++) {
+        char tablename[256];
+        buf.ReadString(tablename, sizeof(tablename));
+
+        int numstrings = buf.ReadWord();
+        tableFn(pContext, tablename, numstrings);
+        ParseSnapshotEntries(buf, numstrings, false, entryFn, pContext, userData);
+
+        if (buf.ReadOneBit() == 1) {
+            numstrings = buf.ReadWord();
+            ParseSnapshotEntries(buf, numstrings, true, entryFn, pContext, userData);
+        }
+    }
+}
+
+void PlayerInfoFromEntry(const StringTableEntry &entry, player_info_t &info) {
+    // short user data leaves the rest of the info zero
+    memset(&info, 0, sizeof(info));
+    memcpy(&info, entry.pUserData, std::min(entry.nUserDataBytes, (int)sizeof(info)));
+    info.entityID = entry.nIndex;
+    SwapBytes(&info.xuid, &info.xuid);
+    SwapBytes(&info.userID, &info.userID);
+    SwapBytes(&info.friendsID, &info.friendsID);
+    info.name[sizeof(info.name) - 1] = 0;
+}
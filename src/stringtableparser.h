@@ -0,0 +1,39 @@
+#ifndef STRINGTABLEPARSER_H
+#define STRINGTABLEPARSER_H
+
+#include <string>
+#include "demofilebitbuf.h"
+#include "demofiledump.h"
+
+// The two string table encodings of a demo, walked entry by entry for the dump and -catalog: the
+// string_data of svc_CreateStringTable and svc_UpdateStringTable, and the dem_stringtables
+// snapshot of every table. The parsers only decode; what an entry means (a player info for the
+// userinfo table) is up to the callback.
+struct StringTableEntry {
+    int nIndex;
+    // "" when the entry has no string
+    const char *pString;
+    // NULL when the entry has no user data, zero terminated otherwise
+    const unsigned char *pUserData;
+    int nUserDataBytes;
+    // dem_stringtables only: one of the entries the client adds, after the server's
+    bool bClientSide;
+};
+
+typedef void (*StringTableFn)(void *pContext, const char *pName, int nEntries);
+typedef void (*StringTableEntryFn)(void *pContext, const StringTableEntry &entry);
+
+// Calls entryFn for each of the nEntries entries of an update of a table created with
+// nMaxEntries and the user data sizes. False, with error set, when the rest can't be decoded.
+bool ParseStringTableUpdate(CBitRead &buf, int nEntries, int nMaxEntries, int nUserDataSize,
+                            int nUserDataSizeBits, int nUserDataFixedSize,
+                            StringTableEntryFn entryFn, void *pContext, std::string &error);
+
+// Calls tableFn for every table of a dem_stringtables snapshot, then entryFn for its entries.
+void ParseStringTableSnapshot(CBitRead &buf, StringTableFn tableFn, StringTableEntryFn entryFn,
+                              void *pContext);
+
+// The player info of a userinfo entry, in host byte order, its entityID the entry index.
+void PlayerInfoFromEntry(const StringTableEntry &entry, player_info_t &info);
+
+#endif // STRINGTABLEPARSER_H
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include "textformat.h"
+
+static const char s_digitPairs[] = "00010203040506070809"
+                                   "10111213141516171819"
+                                   "20212223242526272829"
+                                   "30313233343536373839"
+                                   "40414243444546474849"
+                                   "50515253545556575859"
+                                   "60616263646566676869"
+                                   "70717273747576777879"
+                                   "80818283848586878889"
+                                   "90919293949596979899";
+
+static const uint64 s_powersOf10[TEXTFORMAT_MAX_DECIMALS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+char *FormatUInt64(char *p, uint64 value) {
+    // two digits at a time from the end of a scratch buffer
+    char digits[20];
+    char *pDigits = digits + sizeof(digits);
+    while (value >= 100) {
+        unsigned int nPair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        pDigits -= 2;
+        pDigits[0] = s_digitPairs[nPair];
+        pDigits[1] = s_digitPairs[nPair + 1];
+    }
+    if (value >= 10) {
+        pDigits -= 2;
+        pDigits[0] = s_digitPairs[value * 2];
+        pDigits[1] = s_digitPairs[value * 2 + 1];
+    } else {
+        *--pDigits = (char)('0' + value);
+    }
+    size_t nLength = digits + sizeof(digits) - pDigits;
+    memcpy(p, pDigits, nLength);
+    return p + nLength;
+}
+
+char *FormatInt64(char *p, int64 value) {
+    if (value < 0) {
+        *p++ = '-';
+        return FormatUInt64(p, 0 - (uint64)value);
+    }
+    return FormatUInt64(p, (uint64)value);
+}
+
+char *FormatInt(char *p, int value) { return FormatInt64(p, value); }
+
+char *FormatFixed(char *p, float value, int nDecimals) {
+    uint32 uBits;
+    memcpy(&uBits, &value, sizeof(uBits));
+    int nExponent = (uBits >> 23) & 0xFF;
+    uint64 uMantissa = uBits & 0x7FFFFF;
+    // value is uMantissa * 2^nShift, denormals share the smallest exponent
+    if (nExponent)
+        uMantissa |= 1 << 23;
+    else
+        nExponent = 1;
+    int nShift = nExponent - 150;
+
+    // the value in units of the last decimal is uScaled * 2^nShift, uScaled < 2^54. Integers
+    // from 2^33 on, infinities and NaNs are left to printf.
+    if (nExponent == 0xFF || nShift > 9 || nDecimals < 0 || nDecimals > TEXTFORMAT_MAX_DECIMALS)
+        return p + snprintf(p, TEXTFORMAT_FIXED_CHARS, "%.*f", nDecimals, value);
+    uint64 uScaled = uMantissa * s_powersOf10[nDecimals];
+    uint64 uUnits;
+    if (nShift >= 0) {
+        uUnits = uScaled << nShift;
+    } else if (nShift > -64) {
+        uUnits = uScaled >> -nShift;
+        uint64 uRemainder = uScaled & ((1ULL << -nShift) - 1);
+        uint64 uHalf = 1ULL << (-nShift - 1);
+        if (uRemainder > uHalf || (uRemainder == uHalf && (uUnits & 1)))
+            uUnits++;
+    } else {
+        // under 2^-10 units, rounds to 0
+        uUnits = 0;
+    }
+
+    // like printf, -0.000000 for -0 and for negative values that round to 0
+    if (uBits >> 31)
+        *p++ = '-';
+    p = FormatUInt64(p, uUnits / s_powersOf10[nDecimals]);
+    if (nDecimals) {
+        *p++ = '.';
+        uint64 uFraction = uUnits % s_powersOf10[nDecimals];
+        for (int i = nDecimals - 1; i >= 0; i--) {
+            p[i] = (char)('0' + uFraction % 10);
+            uFraction /= 10;
+        }
+        p += nDecimals;
+    }
+    return p;
+}
@@ -0,0 +1,32 @@
+#ifndef TEXTFORMAT_H
+#define TEXTFORMAT_H
+
+#include <string.h>
+#include "demofile.h"
+
+// most FormatFixed() writes: sign, 39 integer digits of FLT_MAX, point and decimals
+#define TEXTFORMAT_FIXED_CHARS 64
+#define TEXTFORMAT_MAX_DECIMALS 9
+
+// Decimal formatting for the text outputs, without printf's format parsing and locale. Each
+// function writes at p and returns the end of what it wrote, no terminator, so a line is built
+// in a buffer and written with one fwrite.
+//
+// The text is what printf writes for the same value: FormatInt() is %d, FormatFixed() is %.6f
+// of the float promoted to double, rounded half to even from its exact binary value. Prints of
+// the dump that are hot enough to matter (props, entity headers, deaths, samples) use them, the
+// output doesn't change.
+char *FormatUInt64(char *p, uint64 value);
+char *FormatInt64(char *p, int64 value);
+char *FormatInt(char *p, int value);
+// printf("%.*f", nDecimals, value), fixed point with nDecimals up to TEXTFORMAT_MAX_DECIMALS.
+// Writes at most TEXTFORMAT_FIXED_CHARS.
+char *FormatFixed(char *p, float value, int nDecimals = 6);
+
+inline char *FormatText(char *p, const char *pText) {
+    size_t nLength = strlen(pText);
+    memcpy(p, pText, nLength);
+    return p + nLength;
+}
+
+#endif // TEXTFORMAT_H
@@ -0,0 +1,111 @@
+#include "trace.h"
+
+#ifdef DEMOINFOGO_TRACE
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#if defined(_WIN32) || defined(_WIN64)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#include <unistd.h>
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+std::atomic<bool> g_bTraceEnabled(false);
+
+struct TraceEvent {
+    const char *pName;
+    const char *pArg;
+    int64 nValue;
+    int64 nStart;
+    int64 nDuration;
+};
+
+struct TraceBuffer {
+    int nThread;
+    std::vector<TraceEvent> events;
+};
+
+static FILE *s_pTraceFile = NULL;
+static std::chrono::steady_clock::time_point s_traceStart;
+// every thread's buffer, only locked when a thread records its first span
+static std::mutex s_buffersMutex;
+static std::vector<TraceBuffer *> s_buffers;
+static TRACE_THREAD_LOCAL TraceBuffer *s_pThreadBuffer;
+
+int64 CTraceScope::TraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                s_traceStart)
+        .count();
+}
+
+void CTraceScope::Record() {
+    TraceBuffer *pBuffer = s_pThreadBuffer;
+    if (!pBuffer) {
+        pBuffer = new TraceBuffer;
+        pBuffer->events.reserve(1 << 16);
+        std::lock_guard<std::mutex> lock(s_buffersMutex);
+        pBuffer->nThread = (int)s_buffers.size() + 1;
+        s_buffers.push_back(pBuffer);
+        s_pThreadBuffer = pBuffer;
+    }
+
+    TraceEvent event;
+    event.pName = m_pName;
+    event.pArg = m_pArg;
+    event.nValue = m_nValue;
+    event.nStart = m_nStart;
+    event.nDuration = TraceNow() - m_nStart;
+    pBuffer->events.push_back(event);
+}
+
+bool TraceStart(const char *filename) {
+    s_pTraceFile = fopen(filename, "w");
+    if (!s_pTraceFile) {
+        fprintf(stderr, "-trace: couldn't open '%s'\n", filename);
+        return false;
+    }
+    s_traceStart = std::chrono::steady_clock::now();
+    g_bTraceEnabled = true;
+    return true;
+}
+
+void TraceStop() {
+    if (!s_pTraceFile)
+        return;
+    g_bTraceEnabled = false;
+
+#if defined(_WIN32) || defined(_WIN64)
+    int pid = 1;
+#else
+    int pid = (int)getpid();
+#endif
+    std::lock_guard<std::mutex> lock(s_buffersMutex);
+    fprintf(s_pTraceFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool bFirst = true;
+    for (size_t i = 0; i < s_buffers.size(); i++) {
+        const TraceBuffer &buffer = *s_buffers[i];
+        for (size_t j = 0; j < buffer.events.size(); j++) {
+            const TraceEvent &event = buffer.events[j];
+            // timestamps are in microseconds
+            fprintf(s_pTraceFile,
+                    "%s{\"name\":\"%s\",\"cat\":\"demoinfogo\",\"ph\":\"X\",\"pid\":%d,"
+                    "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    bFirst ? "" : ",\n", event.pName, pid, buffer.nThread, event.nStart / 1000.0,
+                    event.nDuration / 1000.0);
+            if (event.pArg)
+                fprintf(s_pTraceFile, ",\"args\":{\"%s\":%lld}", event.pArg,
+                        (long long)event.nValue);
+            fprintf(s_pTraceFile, "}");
+            bFirst = false;
+        }
+        delete s_buffers[i];
+    }
+    fprintf(s_pTraceFile, "\n]}\n");
+    fclose(s_pTraceFile);
+    s_pTraceFile = NULL;
+    s_buffers.clear();
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// -trace out.json: a timeline of the parse in the Chrome Trace Event format, for chrome://tracing
+// or Perfetto.
+//
+// TRACE_SCOPE(name) records a span from there to the end of the enclosing scope, and
+// TRACE_SCOPE_ARG(name, arg, value) one with an integer argument. name and arg have to outlive
+// the trace, string literals in practice. Every thread records into its own buffer, without
+// locks, and TraceStop() writes them all out.
+//
+// Spans are only compiled in with -DTRACE=ON (DEMOINFOGO_TRACE). Otherwise the macros are empty
+// and -trace only prints a warning.
+
+#include <stdio.h>
+
+#ifdef DEMOINFOGO_TRACE
+
+#include <atomic>
+#include "demofile.h"
+
+// read by every thread that records spans
+extern std::atomic<bool> g_bTraceEnabled;
+
+class CTraceScope {
+public:
+    CTraceScope(const char *pName, const char *pArg = NULL, int64 nValue = 0)
+        : m_pName(pName), m_pArg(pArg), m_nValue(nValue), m_nStart(-1) {
+        if (g_bTraceEnabled.load(std::memory_order_relaxed))
+            m_nStart = TraceNow();
+    }
+    ~CTraceScope() {
+        if (m_nStart >= 0)
+            Record();
+    }
+
+    static int64 TraceNow();
+
+private:
+    void Record();
+
+    const char *m_pName;
+    const char *m_pArg;
+    int64 m_nValue;
+    // nanoseconds since TraceStart(), -1 when not tracing
+    int64 m_nStart;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) CTraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, arg, value)                                                          \
+    CTraceScope TRACE_CONCAT(traceScope, __LINE__)(name, arg, value)
+
+// Starts recording. False if filename can't be written.
+bool TraceStart(const char *filename);
+// Writes what every thread recorded and stops recording. Threads that record spans have to be
+// done by then.
+void TraceStop();
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_ARG(name, arg, value)
+
+inline bool TraceStart(const char *filename) {
+    fprintf(stderr, "-trace: demoinfogo was built without -DTRACE=ON, not tracing.\n");
+    return false;
+}
+inline void TraceStop() {}
+
+#endif
+
+#endif // TRACE_H